@@ -2,9 +2,12 @@
 //
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include "dict.h"
@@ -16,6 +19,9 @@
 #include "util.h"
 #include "zterp.h"
 
+// Dictionaries are indexed once, with a hash table from each encoded
+// word to its entry, and kept for as long as they stay valid; see
+// get_dictionary() below.
 struct Dictionary {
     explicit Dictionary(uint16_t addr) :
         m_addr(addr),
@@ -30,6 +36,14 @@ struct Dictionary {
             for (uint8_t i = 0; i < m_num_separators; i++) {
                 m_separators[byte(m_addr + 1 + i)] = true;
             }
+
+            // The first matching entry wins, which is what a linear
+            // search of an unsorted dictionary would find.
+            m_index.reserve(labs(m_num_entries));
+            for (long i = 0; i < labs(m_num_entries); i++) {
+                uint16_t entry = m_base + (i * m_entry_length);
+                m_index.emplace(key(&memory[entry]), entry);
+            }
         }
 
     uint16_t find(const uint8_t *token, size_t len) const;
@@ -38,13 +52,29 @@ struct Dictionary {
         return m_separators[c];
     };
 
+    // One past the last byte of the dictionary.
+    uint32_t end() const {
+        return m_base + (labs(m_num_entries) * m_entry_length);
+    }
+
 private:
+    static uint64_t key(const uint8_t *encoded) {
+        uint64_t k = 0;
+
+        for (int i = 0; i < (zversion <= 3 ? 4 : 6); i++) {
+            k = (k << 8) | encoded[i];
+        }
+
+        return k;
+    }
+
     uint16_t m_addr;
     uint8_t m_num_separators;
     std::array<bool, UINT8_MAX + 1> m_separators{};
     uint8_t m_entry_length;
     long m_num_entries;
     uint16_t m_base;
+    std::unordered_map<uint64_t, uint16_t> m_index;
 };
 
 // Encode the text at “s”, of length “len” (there is not necessarily a
@@ -114,31 +144,75 @@ static std::array<uint8_t, 6> encode_string(const uint8_t *s, size_t len)
 }
 
 uint16_t Dictionary::find(const uint8_t *token, size_t len) const {
-    const uint8_t *ret = nullptr;
-    auto dict_compar = [](const void *a, const void *b) {
-        return std::memcmp(a, b, zversion <= 3 ? 4 : 6);
-    };
-
     auto encoded = encode_string(token, len);
+    auto it = m_index.find(key(encoded.data()));
 
-    if (m_num_entries > 0) {
-        ret = static_cast<uint8_t *>(std::bsearch(encoded.data(), &memory[m_base], m_num_entries, m_entry_length, dict_compar));
-    } else {
-        for (long i = 0; i < -m_num_entries; i++) {
-            const uint8_t *entry = &memory[m_base + (i * m_entry_length)];
+    if (it == m_index.end()) {
+        return 0;
+    }
+
+    return it->second;
+}
 
-            if (dict_compar(encoded.data(), entry) == 0) {
-                ret = entry;
-                break;
+// Return the dictionary at “addr”, indexing it if it hasn’t been seen
+// before or if it has changed since it was last indexed.
+//
+// A dictionary in static memory can’t change, but one in dynamic
+// memory (such as a user dictionary for @tokenise) might be rewritten
+// by the game at any point. The range that dynamic dictionaries cover
+// is watched by store_byte() and store_word(), and if anything is
+// stored there, they are all thrown away.
+static const Dictionary &get_dictionary(uint16_t addr)
+{
+    static std::unordered_map<uint16_t, std::unique_ptr<Dictionary>> dictionaries;
+
+    if (dictionary_written) {
+        for (auto it = dictionaries.begin(); it != dictionaries.end(); ) {
+            if (it->first < header.static_start) {
+                it = dictionaries.erase(it);
+            } else {
+                ++it;
             }
         }
+
+        dictionary_start = dictionary_size = 0;
+        dictionary_written = false;
     }
 
-    if (ret == nullptr) {
-        return 0;
+    auto it = dictionaries.find(addr);
+    if (it != dictionaries.end()) {
+        return *it->second;
+    }
+
+    // Games only ever use a handful of dictionaries, but there’s no
+    // reason to let a misbehaving one build up an unlimited number.
+    if (dictionaries.size() >= 16) {
+        dictionaries.clear();
+        dictionary_start = dictionary_size = 0;
+    }
+
+    auto &dictionary = dictionaries[addr];
+    dictionary = std::make_unique<Dictionary>(addr);
+
+    if (addr < header.static_start) {
+        uint32_t start = addr, end = dictionary->end();
+
+        if (dictionary_size != 0) {
+            start = std::min(start, dictionary_start);
+            end = std::max(end, dictionary_start + dictionary_size);
+        }
+
+        dictionary_start = start;
+        dictionary_size = end - start;
+
+        // store_global() doesn’t watch for dictionaries, so one that
+        // overlaps the globals table is only good for this lookup.
+        if (start < header.globals + 480U && end > header.globals) {
+            dictionary_written = true;
+        }
     }
 
-    return m_base + (ret - &memory[m_base]);
+    return *dictionary;
 }
 
 static uint16_t lookup_replacement(uint16_t original, const std::vector<uint8_t> &replacement, const Dictionary &dictionary)
@@ -225,7 +299,7 @@ void tokenize(uint16_t text, uint16_t parse, uint16_t dictaddr, bool ignore_unkn
 
     ZASSERT(dictaddr != 0, "attempt to tokenize without a valid dictionary");
 
-    Dictionary dictionary(dictaddr);
+    const Dictionary &dictionary = get_dictionary(dictaddr);
 
     if (zversion >= 5) {
         text_len = user_byte(text + 1);
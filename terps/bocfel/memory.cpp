@@ -2,6 +2,7 @@
 //
 // SPDX-License-Identifier: MIT
 
+#include <array>
 #include <cstdlib>
 #include <iomanip>
 #include <ios>
@@ -28,14 +29,25 @@
 std::vector<uint8_t> memory, dynamic_memory;
 uint32_t memory_size;
 
-bool in_globals(uint16_t addr)
-{
-    return addr >= header.globals && addr < header.globals + 480;
-}
+std::array<uint16_t, 240> globals;
+
+uint32_t dictionary_start, dictionary_size;
+bool dictionary_written = false;
+
+#ifndef ZTERP_NO_CHEAT
+bool memory_frozen = false;
+#endif
+#ifndef ZTERP_NO_WATCHPOINTS
+bool memory_watched = false;
+#endif
 
-bool is_global(uint16_t addr)
+void load_globals()
 {
-    return in_globals(addr) && (addr - header.globals) % 2 == 0;
+    for (size_t i = 0; i < globals.size(); i++) {
+        globals[i] = raw_word(header.globals + (i * 2));
+    }
+
+    dictionary_written = true;
 }
 
 static unsigned long addr_to_global(uint16_t addr)
@@ -56,23 +68,6 @@ std::string addrstring(uint16_t addr)
     return ss.str();
 }
 
-uint8_t byte(uint32_t addr)
-{
-    return memory[addr];
-}
-
-void store_byte(uint32_t addr, uint8_t val)
-{
-    memory[addr] = val;
-}
-
-uint8_t user_byte(uint16_t addr)
-{
-    ZASSERT(addr < header.static_end, "attempt to read out-of-bounds address 0x%lx", static_cast<unsigned long>(addr));
-
-    return byte(addr);
-}
-
 void user_store_byte(uint16_t addr, uint8_t v)
 {
     // If safety checks are off, there’s no point in checking these
@@ -105,40 +100,12 @@ void user_store_byte(uint16_t addr, uint8_t v)
     store_byte(addr, v);
 }
 
-uint16_t word(uint32_t addr)
-{
-#ifndef ZTERP_NO_CHEAT
-    uint16_t cheat_val;
-    if (cheat_find_freeze(addr, cheat_val)) {
-        return cheat_val;
-    }
-#endif
-    return (memory[addr] << 8) | memory[addr + 1];
-}
-
-void store_word(uint32_t addr, uint16_t val)
-{
-#ifndef ZTERP_NO_WATCHPOINTS
-    if (addr < header.static_start - 1) {
-        watch_check(addr, word(addr), val);
-    }
-#endif
-
-    memory[addr + 0] = val >> 8;
-    memory[addr + 1] = val & 0xff;
-}
-
-uint16_t user_word(uint16_t addr)
-{
-    ZASSERT(addr < header.static_end - 1, "attempt to read out-of-bounds address 0x%lx", static_cast<unsigned long>(addr));
-
-    return word(addr);
-}
-
 void user_store_word(uint16_t addr, uint16_t v)
 {
 #ifndef ZTERP_NO_WATCHPOINTS
-    watch_check(addr, user_word(addr), v);
+    if (memory_watched) {
+        watch_check(addr, user_word(addr), v);
+    }
 #endif
 
     user_store_byte(addr + 0, v >> 8);
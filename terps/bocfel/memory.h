@@ -3,26 +3,165 @@
 #ifndef ZTERP_MEMORY_H
 #define ZTERP_MEMORY_H
 
+#include <array>
 #include <string>
 #include <vector>
 
+#include "meta.h"
 #include "types.h"
+#include "util.h"
+#include "zterp.h"
 
 extern std::vector<uint8_t> memory, dynamic_memory;
 extern uint32_t memory_size;
 
-bool in_globals(uint16_t addr);
-bool is_global(uint16_t addr);
+// The global variables, in native byte order. This is kept in step
+// with the globals table: stores into the table all go through
+// store_byte() or store_word(), which update it, and anything that
+// replaces dynamic memory wholesale (restart, restore, undo) calls
+// load_globals() afterward.
+extern std::array<uint16_t, 240> globals;
+void load_globals();
+
+// Dictionaries in dynamic memory are indexed once and kept until the
+// game changes them (see dict.cpp). This is the range of memory the
+// kept ones cover; a store into it, or a call to load_globals(), sets
+// dictionary_written so that they’re indexed again before next use.
+extern uint32_t dictionary_start, dictionary_size;
+extern bool dictionary_written;
+
+// Freezes and watchpoints need every word read or write to be looked
+// up, which is far slower than the access itself. These are true only
+// while any are set, so the fast paths can skip the lookups.
+#ifndef ZTERP_NO_CHEAT
+extern bool memory_frozen;
+#endif
+#ifndef ZTERP_NO_WATCHPOINTS
+extern bool memory_watched;
+#endif
+
+inline bool in_globals(uint16_t addr)
+{
+    return addr >= header.globals && addr < header.globals + 480;
+}
+
+inline bool is_global(uint16_t addr)
+{
+    return in_globals(addr) && (addr - header.globals) % 2 == 0;
+}
+
 std::string addrstring(uint16_t addr);
 
-uint8_t byte(uint32_t addr);
-void store_byte(uint32_t addr, uint8_t val);
-uint8_t user_byte(uint16_t addr);
+// If a store to addr touched the globals table, refresh the shadow copy
+// of the global containing it.
+inline void sync_global(uint32_t addr)
+{
+    uint32_t offset = addr - header.globals;
+
+    if (offset < 480) {
+        uint32_t base = header.globals + (offset & ~1UL);
+        globals[offset / 2] = (memory[base] << 8) | memory[base + 1];
+    }
+}
+
+// If a store to addr touched a kept dictionary, mark it as changed.
+inline void sync_dictionary(uint32_t addr)
+{
+    if (addr - dictionary_start < dictionary_size) {
+        dictionary_written = true;
+    }
+}
+
+inline uint8_t byte(uint32_t addr)
+{
+    return memory[addr];
+}
+
+inline void store_byte(uint32_t addr, uint8_t val)
+{
+    memory[addr] = val;
+    sync_global(addr);
+    sync_dictionary(addr);
+}
+
+// Read a word, ignoring freezes. This is for the instruction stream
+// and other static or high memory, which freezes aren’t meant for.
+inline uint16_t raw_word(uint32_t addr)
+{
+    return (memory[addr] << 8) | memory[addr + 1];
+}
+
+inline uint16_t word(uint32_t addr)
+{
+#ifndef ZTERP_NO_CHEAT
+    uint16_t cheat_val;
+    if (memory_frozen && cheat_find_freeze(addr, cheat_val)) {
+        return cheat_val;
+    }
+#endif
+    return raw_word(addr);
+}
+
+inline void store_word(uint32_t addr, uint16_t val)
+{
+#ifndef ZTERP_NO_WATCHPOINTS
+    if (memory_watched && addr < header.static_start - 1) {
+        watch_check(addr, word(addr), val);
+    }
+#endif
+
+    memory[addr + 0] = val >> 8;
+    memory[addr + 1] = val & 0xff;
+    sync_global(addr);
+    sync_global(addr + 1);
+    sync_dictionary(addr);
+    sync_dictionary(addr + 1);
+}
+
+// Global variable n (0 to 239). These are as fast as a local variable
+// unless a freeze or watchpoint means the slow path has to be taken.
+inline uint16_t global(uint8_t n)
+{
+#ifndef ZTERP_NO_CHEAT
+    if (memory_frozen) {
+        return word(header.globals + (n * 2));
+    }
+#endif
+    return globals[n];
+}
+
+inline void store_global(uint8_t n, uint16_t val)
+{
+    uint32_t addr = header.globals + (n * 2);
+
+#ifndef ZTERP_NO_WATCHPOINTS
+    if (memory_watched) {
+        store_word(addr, val);
+        return;
+    }
+#endif
+
+    memory[addr + 0] = val >> 8;
+    memory[addr + 1] = val & 0xff;
+    globals[n] = val;
+}
+
+inline uint8_t user_byte(uint16_t addr)
+{
+    ZASSERT(addr < header.static_end, "attempt to read out-of-bounds address 0x%lx", static_cast<unsigned long>(addr));
+
+    return byte(addr);
+}
+
 void user_store_byte(uint16_t addr, uint8_t v);
 
-uint16_t word(uint32_t addr);
-void store_word(uint32_t addr, uint16_t val);
-uint16_t user_word(uint16_t addr);
+inline uint16_t user_word(uint16_t addr)
+{
+    ZASSERT(addr < header.static_end - 1, "attempt to read out-of-bounds address 0x%lx", static_cast<unsigned long>(addr));
+
+    return word(addr);
+}
+
 void user_store_word(uint16_t addr, uint16_t v);
 
 void zcopy_table();
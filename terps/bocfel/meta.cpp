@@ -272,6 +272,7 @@ bool cheat_add(const std::string &how, bool print)
         }
 
         frozen_addresses[addr] = value;
+        memory_frozen = true;
     } else {
         return false;
     }
@@ -285,7 +286,10 @@ bool cheat_add(const std::string &how, bool print)
 
 static bool cheat_remove(uint16_t addr)
 {
-    return frozen_addresses.erase(addr) > 0;
+    bool removed = frozen_addresses.erase(addr) > 0;
+    memory_frozen = !frozen_addresses.empty();
+
+    return removed;
 }
 
 bool cheat_find_freeze(uint32_t addr, uint16_t &val)
@@ -356,6 +360,7 @@ static std::set<uint16_t> watch_addresses;
 static void watch_add(uint16_t addr)
 {
     watch_addresses.insert(addr);
+    memory_watched = true;
 }
 
 static void watch_all()
@@ -363,16 +368,21 @@ static void watch_all()
     for (unsigned long addr = 0; addr < UINT16_MAX + 1UL; addr++) {
         watch_addresses.insert(addr);
     }
+    memory_watched = true;
 }
 
 static bool watch_remove(uint16_t addr)
 {
-    return watch_addresses.erase(addr) == 1;
+    bool removed = watch_addresses.erase(addr) == 1;
+    memory_watched = !watch_addresses.empty();
+
+    return removed;
 }
 
 static void watch_none()
 {
     watch_addresses.clear();
+    memory_watched = false;
 }
 
 void watch_check(uint16_t addr, unsigned long oldval, unsigned long newval)
@@ -4,6 +4,7 @@
 
 #include <array>
 #include <functional>
+#include <vector>
 
 #ifdef ZTERP_GLK_TICK
 extern "C" {
@@ -52,40 +53,114 @@ bool in_interrupt()
     return processing_level > 1 && !interrupt_override;
 }
 
+bool internal_return = false;
+
+static std::array<void(*)(), 256> opcodes;
+static std::array<void(*)(), 256> ext_opcodes;
+
+// An instruction with its form and operand types already worked out.
+// Operands are kept as they appear in the instruction: the value of a
+// constant, or the number of a variable, which has to be read each
+// time the instruction runs.
+struct Instruction {
+    uint32_t addr;      // Address of the opcode; 0 if this slot is unused.
+    uint32_t next;      // Address just past the operands.
+    void (*fn)();       // Handler, with extended opcodes already resolved.
+    uint8_t nargs;
+    uint8_t variables;  // Bit n is set if operand n is a variable.
+    std::array<uint16_t, 8> operands;
+};
+
+// Decoding an instruction means working through its form and operand
+// type bytes one at a time, so instructions are decoded once and kept
+// here, indexed by address. Only instructions in static or high memory
+// are kept, since those can never be changed by the game.
+static constexpr size_t INSTRUCTION_CACHE_SIZE = 16384;
+static std::vector<Instruction> instruction_cache;
+
 // Returns true if decoded, false otherwise (omitted)
-static bool decode_base(uint8_t type, uint16_t &loc)
+static bool decode_base(Instruction &insn, uint32_t &addr, uint8_t type)
 {
+    uint16_t &operand = insn.operands[insn.nargs];
+
     switch (type) {
     case 0: // Large constant.
-        loc = word(pc);
-        pc += 2;
+        operand = raw_word(addr);
+        addr += 2;
         break;
     case 1: // Small constant.
-        loc = byte(pc++);
+        operand = byte(addr++);
         break;
     case 2: // Variable.
-        loc = variable(byte(pc++));
+        operand = byte(addr++);
+        insn.variables |= 1 << insn.nargs;
         break;
     default: // Omitted.
         return false;
     }
 
+    insn.nargs++;
+
     return true;
 }
 
-static void decode_var(uint8_t types)
+static void decode_var(Instruction &insn, uint32_t &addr, uint8_t types)
 {
     for (int i = 6; i >= 0; i -= 2) {
-        uint16_t ret;
-        if (!decode_base((types >> i) & 0x03, ret)) {
+        if (!decode_base(insn, addr, (types >> i) & 0x03)) {
             return;
         }
-        zargs[znargs++] = ret;
     }
 }
 
-static std::array<void(*)(), 256> opcodes;
-static std::array<void(*)(), 256> ext_opcodes;
+static void decode(Instruction &insn, uint32_t addr)
+{
+    uint8_t opcode = byte(addr++);
+
+    insn.nargs = 0;
+    insn.variables = 0;
+    insn.fn = opcodes[opcode];
+
+    if (opcode < 0x80) { // long 2OP
+        decode_base(insn, addr, (opcode & 0x40) == 0x40 ? 2 : 1);
+        decode_base(insn, addr, (opcode & 0x20) == 0x20 ? 2 : 1);
+    } else if (opcode < 0xb0) { // short 1OP
+        decode_base(insn, addr, (opcode >> 4) & 0x03);
+    } else if (opcode == 0xbe && zversion >= 5) { // EXT
+        // This nifty trick is from Frotz.
+        insn.fn = ext_opcodes[byte(addr++)];
+        decode_var(insn, addr, byte(addr++));
+    } else if (opcode < 0xc0) { // short 0OP
+    } else if (opcode == 0xec || opcode == 0xfa) { // Double variable VAR
+        uint8_t types1 = byte(addr++);
+        uint8_t types2 = byte(addr++);
+
+        decode_var(insn, addr, types1);
+        decode_var(insn, addr, types2);
+    } else { // variable 2OP and VAR
+        decode_var(insn, addr, byte(addr++));
+    }
+
+    insn.next = addr;
+}
+
+static const Instruction &fetch(uint32_t addr)
+{
+    static Instruction uncached;
+
+    if (addr < header.static_start) {
+        decode(uncached, addr);
+        return uncached;
+    }
+
+    Instruction &insn = instruction_cache[addr % INSTRUCTION_CACHE_SIZE];
+    if (insn.addr != addr) {
+        decode(insn, addr);
+        insn.addr = addr;
+    }
+
+    return insn;
+}
 
 enum class Opcount {
     Zero,
@@ -95,16 +170,6 @@ enum class Opcount {
     Ext,
 };
 
-// This nifty trick is from Frotz.
-static void zextended()
-{
-    uint8_t opcode = byte(pc++);
-
-    decode_var(byte(pc++));
-
-    ext_opcodes[opcode]();
-}
-
 [[noreturn]]
 static void illegal_opcode()
 {
@@ -145,6 +210,7 @@ static void setup_single_opcode(int minver, int maxver, Opcount opcount, int opc
 void setup_opcodes()
 {
     opcodes.fill(illegal_opcode);
+    instruction_cache.assign(INSTRUCTION_CACHE_SIZE, Instruction());
 
     // §14.2.1
     ext_opcodes.fill(znop);
@@ -164,7 +230,6 @@ void setup_opcodes()
     setup_single_opcode(1, 6, Opcount::Zero, 0x0b, znew_line);
     setup_single_opcode(3, 3, Opcount::Zero, 0x0c, zshow_status);
     setup_single_opcode(3, 6, Opcount::Zero, 0x0d, zverify);
-    setup_single_opcode(5, 6, Opcount::Zero, 0x0e, zextended);
     setup_single_opcode(5, 6, Opcount::Zero, 0x0f, zpiracy);
 
     setup_single_opcode(1, 6, Opcount::One, 0x00, zjz);
@@ -312,51 +377,23 @@ void process_instructions()
 #endif
 
         current_instruction = pc;
-        uint8_t opcode = byte(pc++);
 
-        if (opcode < 0x80) { // long 2OP
-            znargs = 2;
+        const Instruction &insn = fetch(pc);
 
-            if ((opcode & 0x40) == 0x40) {
-                zargs[0] = variable(byte(pc++));
+        pc = insn.next;
+        znargs = insn.nargs;
+        for (int i = 0; i < znargs; i++) {
+            if ((insn.variables & (1 << i)) != 0) {
+                zargs[i] = variable(insn.operands[i]);
             } else {
-                zargs[0] = byte(pc++);
+                zargs[i] = insn.operands[i];
             }
-
-            if ((opcode & 0x20) == 0x20) {
-                zargs[1] = variable(byte(pc++));
-            } else {
-                zargs[1] = byte(pc++);
-            }
-        } else if (opcode < 0xb0) { // short 1OP
-            znargs = 1;
-
-            if ((opcode & 0x20) == 0x20) {
-                zargs[0] = variable(byte(pc++));
-            } else if ((opcode & 0x10) == 0x10) {
-                zargs[0] = byte(pc++);
-            } else {
-                zargs[0] = word(pc);
-                pc += 2;
-            }
-        } else if (opcode < 0xc0) { // short 0OP (plus EXT)
-            znargs = 0;
-        } else if (opcode == 0xec || opcode == 0xfa) { // Double variable VAR
-            uint8_t types1 = byte(pc++);
-            uint8_t types2 = byte(pc++);
-
-            znargs = 0;
-            decode_var(types1);
-            decode_var(types2);
-        } else { // variable 2OP and VAR
-            znargs = 0;
-
-            decode_var(byte(pc++));
         }
 
-        try {
-            opcodes[opcode]();
-        } catch (const Operation::Return &) {
+        insn.fn();
+
+        if (internal_return) {
+            internal_return = false;
             processing_level--;
             return;
         }
@@ -377,6 +414,7 @@ void process_loop()
             }
 
             processing_level = 0;
+            internal_return = false;
             process_instructions();
         } catch (const Operation::Restart &) {
             start_story();
@@ -13,11 +13,6 @@ static constexpr uint8_t JOURNEY_DIAL_EXT = 0xf0;
 static constexpr uint8_t SHOGUN_MENU_EXT = 0xf1;
 
 namespace Operation {
-// Jump back to the previous round of interpreting. This is used
-// when an interrupt routine returns.
-class Return : public std::exception {
-};
-
 // Jump back to the first round of processing and continue; this is
 // used for @restart, which is assumed to have put everything back
 // in a clean state.
@@ -47,6 +42,12 @@ extern int znargs;
 
 extern bool interrupt_override;
 
+// Set when an interrupt routine returns, telling the current round of
+// interpreting to hand control back to the previous one. This is
+// checked after each instruction rather than thrown as an exception,
+// since returns from internal calls are routine, not exceptional.
+extern bool internal_return;
+
 bool in_interrupt();
 void setup_opcodes();
 void process_instructions();
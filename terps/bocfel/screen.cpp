@@ -9,7 +9,6 @@
 #include <cstdarg>
 #include <cstdlib>
 #include <cstring>
-#include <deque>
 #include <functional>
 #include <initializer_list>
 #include <iomanip>
@@ -94,6 +93,7 @@ double round(double x) {
 #ifndef GLK_MODULE_UNICODE
 #define glk_put_char_uni(...)		die("bug %s:%d: glk_put_char_uni() called with no unicode", __FILE__, __LINE__)
 #define glk_put_char_stream_uni(...)	die("bug %s:%d: glk_put_char_stream_uni() called with no unicode", __FILE__, __LINE__)
+#define glk_put_buffer_uni(...)		die("bug %s:%d: glk_put_buffer_uni() called with no unicode", __FILE__, __LINE__)
 #define glk_request_char_event_uni(...)	die("bug %s:%d: glk_request_char_event_uni() called with no unicode", __FILE__, __LINE__)
 #define glk_request_line_event_uni(...)	die("bug %s:%d: glk_request_line_event_uni() called with no unicode", __FILE__, __LINE__)
 #endif
@@ -562,6 +562,21 @@ static void xglk_put_char_stream(strid_t s, uint32_t c)
         glk_put_char_stream_uni(s, c);
     }
 }
+
+static void xglk_put_buffer(std::vector<glui32> &buf)
+{
+    if (!have_unicode) {
+        std::vector<char> latin1(buf.size());
+
+        for (size_t i = 0; i < buf.size(); i++) {
+            latin1[i] = buf[i] > 255 ? LATIN1_QUESTIONMARK : buf[i];
+        }
+
+        glk_put_buffer(latin1.data(), latin1.size());
+    } else {
+        glk_put_buffer_uni(buf.data(), buf.size());
+    }
+}
 #endif
 
 static bool set_force_fixed = false;
@@ -652,60 +667,27 @@ static void set_current_style()
 // The following implements a circular buffer to track the state of the
 // screen so that recent history can be stored in save files for
 // playback on restore.
+//
+// Entries are kept already encoded as they appear in the Bfhs chunk:
+// a type byte followed by its payload, with characters in UTF-8. This
+// takes a few bytes per character rather than a full Entry object, and
+// writing the chunk is a straight copy out of the buffer.
 static constexpr size_t HISTORY_SIZE = 2000;
 
 class History {
 public:
-    struct Entry {
-// Suppress a dubious shadow warning (see https://gcc.gnu.org/bugzilla/show_bug.cgi?id=55776)
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wshadow"
-#endif
-        // These values are part of the Bfhs chunk so must remain stable.
-        enum class Type {
-            Style = 0,
-            FGColor = 1,
-            BGColor = 2,
-            InputStart = 3,
-            InputEnd = 4,
-            Char = 5,
-        } type;
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-
-        union Contents {
-            Color color;
-            uint8_t style;
-            uint32_t c;
-
-            Contents() : c(0) { }
-            explicit Contents(Color color_) : color(color_) { }
-            explicit Contents(uint8_t style_) : style(style_) { }
-            explicit Contents(uint32_t c_) : c(c_) { }
-        } contents;
-
-        explicit Entry(Type type_) : type(type_) { }
-        Entry(Type type_, const Color &color) : type(type_), contents(color) { }
-        Entry(Type type_, uint8_t style) : type(type_), contents(style) { }
-        Entry(Type type_, uint32_t c) : type(type_), contents(c) { }
-
-        static Entry style(uint8_t style) {
-            return {Type::Style, style};
-        }
-
-        static Entry color(Type color_type, const Color &color) {
-            return {color_type, color};
-        }
-
-        static Entry character(uint32_t c) {
-            return {Type::Char, c};
-        }
+    // These values are part of the Bfhs chunk so must remain stable.
+    enum class Type {
+        Style = 0,
+        FGColor = 1,
+        BGColor = 2,
+        InputStart = 3,
+        InputEnd = 4,
+        Char = 5,
     };
 
-    std::deque<Entry>::size_type size() const {
-        return m_entries.size();
+    size_t size() const {
+        return m_count;
     }
 
     void add_style() {
@@ -715,54 +697,148 @@ public:
             style.set(STYLE_FIXED);
         }
 
-        add(Entry::style(style.to_ulong()));
+        uint8_t entry[] = { static_cast<uint8_t>(Type::Style), static_cast<uint8_t>(style.to_ulong()) };
+        add(entry, sizeof entry);
     }
 
     void add_fg_color(const Color &color) {
-        add(Entry::color(Entry::Type::FGColor, color));
+        add_color(Type::FGColor, color);
     }
 
     void add_bg_color(const Color &color) {
-        add(Entry::color(Entry::Type::BGColor, color));
+        add_color(Type::BGColor, color);
     }
 
     void add_input(const uint16_t *string, size_t len) {
-        add(Entry(Entry::Type::InputStart));
+        add_input_start();
 
         for (size_t i = 0; i < len; i++) {
-            add(Entry::character(string[i]));
+            add_char(string[i]);
         }
 
-        add(Entry::character(UNICODE_LINEFEED));
-        add(Entry(Entry::Type::InputEnd));
+        add_char(UNICODE_LINEFEED);
+        add_input_end();
     }
 
     void add_input_start() {
-        add(Entry(Entry::Type::InputStart));
+        uint8_t entry = static_cast<uint8_t>(Type::InputStart);
+        add(&entry, 1);
     }
 
     void add_input_end() {
-        add(Entry(Entry::Type::InputEnd));
+        uint8_t entry = static_cast<uint8_t>(Type::InputEnd);
+        add(&entry, 1);
     }
 
+    // Encoded the same way as IO::putc().
     void add_char(uint32_t c) {
-        add(Entry::character(c));
+        uint8_t entry[5] = { static_cast<uint8_t>(Type::Char) };
+        size_t n = 1;
+
+        if (c >= 0x110000) {
+            c = UNICODE_REPLACEMENT;
+        }
+
+        if (c < 0x80) {
+            entry[n++] = c;
+        } else if (c < 0x800) {
+            entry[n++] = 0xc0 | ((c >> 6) & 0x1f);
+            entry[n++] = 0x80 | ((c     ) & 0x3f);
+        } else if (c < 0x10000) {
+            entry[n++] = 0xe0 | ((c >> 12) & 0x0f);
+            entry[n++] = 0x80 | ((c >>  6) & 0x3f);
+            entry[n++] = 0x80 | ((c      ) & 0x3f);
+        } else {
+            entry[n++] = 0xf0 | ((c >> 18) & 0x07);
+            entry[n++] = 0x80 | ((c >> 12) & 0x3f);
+            entry[n++] = 0x80 | ((c >>  6) & 0x3f);
+            entry[n++] = 0x80 | ((c      ) & 0x3f);
+        }
+
+        add(entry, n);
+    }
+
+    template <typename T>
+    void add_chars(const T *s, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            add_char(s[i]);
+        }
     }
 
-    const std::deque<Entry> &entries() const {
-        return m_entries;
+    // Write out all entries, oldest first, in Bfhs format.
+    void write(IO &io) const {
+        size_t first = std::min(m_used, BUFFER_SIZE - m_head);
+
+        io.write_exact(&m_buf[m_head], first);
+        io.write_exact(&m_buf[0], m_used - first);
     }
 
 private:
-    void add(const Entry &entry) {
-        while (m_entries.size() >= HISTORY_SIZE) {
-            m_entries.pop_front();
+    // The longest entry is a four-byte UTF-8 character plus its type.
+    static constexpr size_t BUFFER_SIZE = HISTORY_SIZE * 5;
+
+    std::array<uint8_t, BUFFER_SIZE> m_buf;
+    size_t m_head = 0;
+    size_t m_used = 0;
+    size_t m_count = 0;
+
+    uint8_t at(size_t i) const {
+        return m_buf[(m_head + i) % BUFFER_SIZE];
+    }
+
+    // The size of the oldest entry.
+    size_t front_size() const {
+        switch (static_cast<Type>(at(0))) {
+        case Type::Style:
+            return 2;
+        case Type::FGColor: case Type::BGColor:
+            return 4;
+        case Type::Char: {
+            uint8_t lead = at(1);
+
+            if (lead < 0x80) {
+                return 2;
+            } else if (lead < 0xe0) {
+                return 3;
+            } else if (lead < 0xf0) {
+                return 4;
+            } else {
+                return 5;
+            }
         }
+        default:
+            return 1;
+        }
+    }
 
-        m_entries.push_back(entry);
+    void add_color(Type type, const Color &color) {
+        uint8_t entry[] = {
+            static_cast<uint8_t>(type),
+            static_cast<uint8_t>(color.mode),
+            static_cast<uint8_t>(color.value >> 8),
+            static_cast<uint8_t>(color.value & 0xff),
+        };
+
+        add(entry, sizeof entry);
     }
 
-    std::deque<Entry> m_entries;
+    void add(const uint8_t *entry, size_t n) {
+        while (m_count >= HISTORY_SIZE) {
+            size_t front = front_size();
+
+            m_head = (m_head + front) % BUFFER_SIZE;
+            m_used -= front;
+            m_count--;
+        }
+
+        size_t tail = (m_head + m_used) % BUFFER_SIZE;
+        for (size_t i = 0; i < n; i++) {
+            m_buf[(tail + i) % BUFFER_SIZE] = entry[i];
+        }
+
+        m_used += n;
+        m_count++;
+    }
 };
 
 static History history;
@@ -927,6 +1003,49 @@ void put_char(uint8_t c)
     put_char_base(c, false);
 }
 
+// Print out a string of ZSCII characters. This is the same as calling
+// put_char() on each in turn, but in the usual case of plain text
+// going to the main window, the characters are converted and handed to
+// Glk in one go rather than working through put_char_base() for each.
+static void put_zscii(const uint8_t *s, size_t len)
+{
+#ifdef ZTERP_GLK
+    bool character_font = curwin->font == Window::Font::Character && !options.disable_graphics_font;
+
+    if (!streams.test(OSTREAM_MEMORY) && curwin == mainwin && !character_font) {
+        static std::vector<glui32> buf;
+
+        buf.clear();
+        for (size_t i = 0; i < len; i++) {
+            // See put_char_base() for tab and sentence space.
+            if (s[i] == 0 || (zversion != 6 && (s[i] == 9 || s[i] == 11))) {
+                continue;
+            }
+
+            uint16_t c = zscii_to_unicode[s[i]];
+            if (c != 0) {
+                buf.push_back(c);
+            }
+        }
+
+        if (streams.test(OSTREAM_SCREEN) && curwin->id != nullptr) {
+            xglk_put_buffer(buf);
+        }
+
+        history.add_chars(buf.data(), buf.size());
+        for (const auto &c : buf) {
+            transcribe(c);
+        }
+
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < len; i++) {
+        put_char(s[i]);
+    }
+}
+
 // Glk doesn’t allow control characters (apart from newline) to be
 // written (§2.2). In most cases this isn’t a problem, but there are a
 // couple of places where user-provided strings need to be printed out
@@ -1446,13 +1565,39 @@ static void check_terminators()
 }
 #endif
 
-// Decode and print a zcode string at address “addr”. This can be
-// called recursively thanks to abbreviations; the initial call should
-// have “in_abbr” set to false.
-// Each time a character is decoded, it is passed to the function
-// “outc”.
-static int print_zcode(uint32_t addr, bool in_abbr, void (*outc)(uint8_t))
+// A decoded string, as a series of ZSCII characters.
+struct ZString {
+    std::vector<uint8_t> text;
+
+    // The number of bytes the encoded string takes up.
+    int length = 0;
+
+    // Strings in static or high memory can’t change, so once decoded
+    // they can be kept and printed again without decoding them. But the
+    // abbreviations table is often in dynamic memory, and Inform’s
+    // dynamic strings (@00 and so on) work by changing entries in it, so
+    // this records each entry in dynamic memory that was used, and its
+    // value at the time; if any have since changed, the string has to
+    // be decoded again. If any part of the string itself came from
+    // dynamic memory, it is not kept at all.
+    std::vector<std::pair<uint32_t, uint16_t>> abbreviations;
+    bool cacheable = true;
+
+    bool valid() const {
+        return std::all_of(abbreviations.begin(), abbreviations.end(), [](const std::pair<uint32_t, uint16_t> &abbr) {
+            return word(abbr.first) == abbr.second;
+        });
+    }
+};
+
+// Decode a zcode string at address “addr”, appending it to “zstring”.
+// This can be called recursively thanks to abbreviations; the initial
+// call should have “in_abbr” set to false.
+static int decode_zcode(uint32_t addr, bool in_abbr, ZString &zstring)
 {
+    auto outc = [&zstring](uint8_t c) {
+        zstring.text.push_back(c);
+    };
     enum class TenBit { None, Start, Half } tenbit = TenBit::None;
     int abbrev = 0, shift = 0;
     int c, lastc = 0; // initialize to appease g++
@@ -1460,6 +1605,10 @@ static int print_zcode(uint32_t addr, bool in_abbr, void (*outc)(uint8_t))
     uint32_t counter = addr;
     int current_alphabet = 0;
 
+    if (addr < header.static_start) {
+        zstring.cacheable = false;
+    }
+
     do {
         ZASSERT(counter < memory_size - 1, "string runs beyond the end of memory");
 
@@ -1475,10 +1624,15 @@ static int print_zcode(uint32_t addr, bool in_abbr, void (*outc)(uint8_t))
                 outc((lastc << 5) | c);
                 tenbit = TenBit::None;
             } else if (abbrev != 0) {
-                uint32_t new_addr = user_word(header.abbr + 64 * (abbrev - 1) + 2 * c);
+                uint32_t entry = header.abbr + 64 * (abbrev - 1) + 2 * c;
+                uint32_t new_addr = user_word(entry);
+
+                if (entry < header.static_start) {
+                    zstring.abbreviations.emplace_back(entry, new_addr);
+                }
 
                 // new_addr is a word address, so multiply by 2
-                print_zcode(new_addr * 2, true, outc);
+                decode_zcode(new_addr * 2, true, zstring);
 
                 abbrev = 0;
             } else {
@@ -1540,14 +1694,50 @@ static int print_zcode(uint32_t addr, bool in_abbr, void (*outc)(uint8_t))
     return counter - addr;
 }
 
+// Decoded strings from static and high memory, by address.
+static std::unordered_map<uint32_t, ZString> zstring_cache;
+
 // Prints the string at addr “addr”.
 //
-// Returns the number of bytes the string took up. “outc” is passed as
-// the character-print function to print_zcode(); if it is null,
-// put_char is used.
+// Returns the number of bytes the string took up. Each character is
+// passed to “outc”; if it is null, the string is printed normally.
 int print_handler(uint32_t addr, void (*outc)(uint8_t))
 {
-    return print_zcode(addr, false, outc != nullptr ? outc : put_char);
+    ZString decoded;
+    const ZString *zstring = &decoded;
+    bool use_cache = true;
+
+#ifndef ZTERP_NO_CHEAT
+    // A freeze could change what the string reads as at any time.
+    use_cache = !memory_frozen;
+#endif
+
+    auto it = use_cache ? zstring_cache.find(addr) : zstring_cache.end();
+    if (it != zstring_cache.end() && it->second.valid()) {
+        zstring = &it->second;
+    } else {
+        decoded.length = decode_zcode(addr, false, decoded);
+
+        if (use_cache && decoded.cacheable) {
+            // There are only so many strings in a game, but don’t let
+            // the cache grow without limit.
+            if (zstring_cache.size() >= 8192) {
+                zstring_cache.clear();
+            }
+
+            zstring = &(zstring_cache[addr] = std::move(decoded));
+        }
+    }
+
+    if (outc != nullptr) {
+        for (const auto &c : zstring->text) {
+            outc(c);
+        }
+    } else {
+        put_zscii(zstring->text.data(), zstring->text.size());
+    }
+
+    return zstring->length;
 }
 
 void zprint()
@@ -4664,27 +4854,7 @@ IFF::TypeID screen_write_bfhs(IO &io)
 {
     io.write32(0); // version
     io.write32(history.size());
-
-    for (const auto &entry : history.entries()) {
-        switch (entry.type) {
-        case History::Entry::Type::Style:
-            io.write8(static_cast<uint8_t>(entry.type));
-            io.write8(entry.contents.style);
-            break;
-        case History::Entry::Type::FGColor: case History::Entry::Type::BGColor:
-            io.write8(static_cast<uint8_t>(entry.type));
-            io.write8(static_cast<uint8_t>(entry.contents.color.mode));
-            io.write16(entry.contents.color.value);
-            break;
-        case History::Entry::Type::InputStart: case History::Entry::Type::InputEnd:
-            io.write8(static_cast<uint8_t>(entry.type));
-            break;
-        case History::Entry::Type::Char:
-            io.write8(static_cast<uint8_t>(entry.type));
-            io.putc(entry.contents.c);
-            break;
-        }
-    };
+    history.write(io);
 
     return IFF::TypeID("Bfhs");
 }
@@ -4785,8 +4955,8 @@ void screen_read_bfhs(IO &io, bool autosave)
         // Each history entry is added to the history buffer. This is so
         // that new saves, after a restore, continue to include the
         // older save file’s history.
-        switch (static_cast<History::Entry::Type>(type)) {
-        case History::Entry::Type::Style: {
+        switch (static_cast<History::Type>(type)) {
+        case History::Type::Style: {
             uint8_t style;
 
             try {
@@ -4802,7 +4972,7 @@ void screen_read_bfhs(IO &io, bool autosave)
 
             break;
         }
-        case History::Entry::Type::FGColor: case History::Entry::Type::BGColor: {
+        case History::Type::FGColor: case History::Type::BGColor: {
             uint8_t mode;
             uint16_t value;
 
@@ -4813,12 +4983,12 @@ void screen_read_bfhs(IO &io, bool autosave)
                 return;
             }
 
-            Color &color = static_cast<History::Entry::Type>(type) == History::Entry::Type::FGColor ? mainwin->fg_color : mainwin->bg_color;
+            Color &color = static_cast<History::Type>(type) == History::Type::FGColor ? mainwin->fg_color : mainwin->bg_color;
 
             try_load_color(static_cast<Color::Mode>(mode), value, color);
             set_window_style(mainwin);
 
-            if (static_cast<History::Entry::Type>(type) == History::Entry::Type::FGColor) {
+            if (static_cast<History::Type>(type) == History::Type::FGColor) {
                 history.add_fg_color(color);
             } else {
                 history.add_bg_color(color);
@@ -4826,7 +4996,7 @@ void screen_read_bfhs(IO &io, bool autosave)
 
             break;
         }
-        case History::Entry::Type::InputStart:
+        case History::Type::InputStart:
             original_style = mainwin->style;
             mainwin->style.reset();
             set_window_style(mainwin);
@@ -4835,12 +5005,12 @@ void screen_read_bfhs(IO &io, bool autosave)
 #endif
             history.add_input_start();
             break;
-        case History::Entry::Type::InputEnd:
+        case History::Type::InputEnd:
             mainwin->style = original_style;
             set_window_style(mainwin);
             history.add_input_end();
             break;
-        case History::Entry::Type::Char:
+        case History::Type::Char:
             c = io.getc(false);
             if (c == -1) {
                 return;
@@ -78,11 +78,35 @@ static uint16_t pop_stack()
     return *--sp;
 }
 
+// @save_undo states never leave memory (unless an autosave is made),
+// so instead of Quetzal they hold a direct copy of the stacks, and of
+// dynamic memory split into pages. A page that hasn’t changed since the
+// previous undo state is shared with it, and a null page is the same as
+// in the story file, so an undo state costs little more than the pages
+// written to since the last one, and restoring one only has to copy the
+// pages that differ from what’s in memory now.
+static constexpr uint32_t UNDO_PAGE_SIZE = 256;
+
+using UndoPage = std::array<uint8_t, UNDO_PAGE_SIZE>;
+
+struct UndoState {
+    uint32_t pc;
+    std::vector<uint16_t> stack;
+
+    // The call frames, with their stack pointers pointing into “stack”.
+    // As when writing Quetzal, there is one extra frame at the end to
+    // mark the top of the evaluation stack.
+    std::vector<CallFrame> frames;
+
+    std::vector<std::shared_ptr<const UndoPage>> pages;
+};
+
 struct SaveState {
 public:
     SaveType savetype;
     std::vector<uint8_t> quetzal;
     std::string desc;
+    std::shared_ptr<const UndoState> undo;
 
     SaveState(SaveType savetype_, const char *desc_, std::vector<uint8_t> quetzal_) :
         savetype(savetype_),
@@ -91,6 +115,13 @@ public:
     {
     }
 
+    explicit SaveState(std::shared_ptr<const UndoState> undo_) :
+        savetype(SaveType::Normal),
+        desc(format_time()),
+        undo(std::move(undo_))
+    {
+    }
+
 private:
     static std::string format_time() {
         auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -175,8 +206,7 @@ uint16_t variable(uint16_t var)
         ZASSERT(var <= CURRENT_FRAME->nlocals, "attempting to read from nonexistent local variable %d: routine has %d", static_cast<int>(var), CURRENT_FRAME->nlocals);
         return CURRENT_FRAME->locals[var - 1];
     } else if (var <= 0xff) { // Globals
-        var -= 0x10;
-        return word(header.globals + (var * 2));
+        return global(var - 0x10);
     }
 
     // This is an “impossible” situation (ie, the game did something wrong).
@@ -195,8 +225,7 @@ void store_variable(uint16_t var, uint16_t n)
         ZASSERT(var <= CURRENT_FRAME->nlocals, "attempting to store to nonexistent local variable %d: routine has %d", static_cast<int>(var), CURRENT_FRAME->nlocals);
         CURRENT_FRAME->locals[var - 1] = n;
     } else if (var <= 0xff) { // Globals
-        var -= 0x10;
-        store_word(header.globals + (var * 2), n);
+        store_global(var - 0x10, n);
     }
 }
 
@@ -358,7 +387,7 @@ void do_return(uint16_t retval)
         store_variable(where, retval);
     } else if (where == 0xff + 2) {
         push_stack(retval);
-        throw Operation::Return();
+        internal_return = true;
     }
 }
 
@@ -442,9 +471,9 @@ void zpush_stack()
     branch_if(true);
 }
 
-// Compress dynamic memory according to Quetzal. On failure,
-// std::bad_alloc is thrown.
-static std::vector<uint8_t> compress_memory()
+// Compress dynamic memory (either the real thing or a copy) according
+// to Quetzal. On failure, std::bad_alloc is thrown.
+static std::vector<uint8_t> compress_memory(const uint8_t *mem)
 {
     long i = 0;
     std::vector<uint8_t> compressed;
@@ -457,7 +486,7 @@ static std::vector<uint8_t> compress_memory()
         // Count zeroes. Stop counting when:
         // • The end of dynamic memory is reached, or
         // • A non-zero value is found
-        while (i < header.static_start && (byte(i) ^ dynamic_memory[i]) == 0) {
+        while (i < header.static_start && (mem[i] ^ dynamic_memory[i]) == 0) {
             i++;
         }
 
@@ -477,7 +506,7 @@ static std::vector<uint8_t> compress_memory()
         }
 
         // The current byte differs from the story, so write it.
-        compressed.push_back(byte(i) ^ dynamic_memory[i]);
+        compressed.push_back(mem[i] ^ dynamic_memory[i]);
 
         i++;
     }
@@ -514,14 +543,14 @@ static bool uncompress_memory(const uint8_t *compressed, uint32_t size)
     return true;
 }
 
-static IFF::TypeID write_ifhd(IO &savefile)
+static IFF::TypeID write_ifhd(IO &savefile, uint32_t savepc)
 {
     savefile.write16(header.release);
     savefile.write_exact(header.serial, sizeof header.serial);
     savefile.write16(header.checksum);
-    savefile.write8((pc >> 16) & 0xff);
-    savefile.write8((pc >>  8) & 0xff);
-    savefile.write8((pc >>  0) & 0xff);
+    savefile.write8((savepc >> 16) & 0xff);
+    savefile.write8((savepc >>  8) & 0xff);
+    savefile.write8((savepc >>  0) & 0xff);
 
     return IFF::TypeID("IFhd");
 }
@@ -539,15 +568,14 @@ static IFF::TypeID write_intd(IO &savefile)
     return IFF::TypeID("IntD");
 }
 
-static IFF::TypeID write_mem(IO &savefile)
+static IFF::TypeID write_mem(IO &savefile, const uint8_t *mem)
 {
     std::vector<uint8_t> compressed;
     uint32_t memsize = header.static_start;
-    const uint8_t *mem = memory.data();
     IFF::TypeID type = IFF::TypeID("UMem");
 
     try {
-        compressed = compress_memory();
+        compressed = compress_memory(mem);
         // It is possible for the compressed memory size to be larger than
         // uncompressed; in this case, don’t use compressed memory.
         if (compressed.size() < header.static_start) {
@@ -564,12 +592,11 @@ static IFF::TypeID write_mem(IO &savefile)
 }
 
 // Quetzal save/restore functions.
-static IFF::TypeID write_stks(IO &savefile)
+// The frame at “end” is not written, but its stack pointer must mark
+// the top of the evaluation stack used by the last frame.
+static IFF::TypeID write_stks(IO &savefile, const CallFrame *begin, const CallFrame *end)
 {
-    // Add one more “fake” call frame with just enough information to
-    // calculate the evaluation stack used by the current routine.
-    fp->sp = sp;
-    for (CallFrame *p = BASE_OF_FRAMES; p != fp; p++) {
+    for (const CallFrame *p = begin; p != end; p++) {
         savefile.write8((p->pc >> 16) & 0xff);
         savefile.write8((p->pc >>  8) & 0xff);
         savefile.write8((p->pc >>  0) & 0xff);
@@ -624,6 +651,8 @@ static IFF::TypeID write_args(IO &savefile, SaveOpcode saveopcode)
     return IFF::TypeID("Args");
 }
 
+static std::vector<uint8_t> undo_state_quetzal(const UndoState &state);
+
 static void write_undo_msav(IO &savefile, SaveStackType type)
 {
     SaveStack &s = save_stacks[type];
@@ -643,8 +672,16 @@ static void write_undo_msav(IO &savefile, SaveStackType type)
             }
         }
 
-        savefile.write32(state->quetzal.size());
-        savefile.write_exact(state->quetzal.data(), state->quetzal.size());
+        // Undo states are kept in their own format in memory, but
+        // autosaves always store Quetzal.
+        if (state->undo != nullptr) {
+            auto quetzal = undo_state_quetzal(*state->undo);
+            savefile.write32(quetzal.size());
+            savefile.write_exact(quetzal.data(), quetzal.size());
+        } else {
+            savefile.write32(state->quetzal.size());
+            savefile.write_exact(state->quetzal.data(), state->quetzal.size());
+        }
     }
 }
 
@@ -662,8 +699,8 @@ static IFF::TypeID write_msav(IO &savefile)
     return IFF::TypeID("MSav");
 }
 
-template<typename... Types>
-static void write_chunk(IO &io, IFF::TypeID (*writefunc)(IO &savefile, Types... args), Types... args)
+template<typename... Types, typename... Args>
+static void write_chunk(IO &io, IFF::TypeID (*writefunc)(IO &savefile, Types... args), Args... args)
 {
     long chunk_pos = io.tell();
     // Type and size, to be filled in below.
@@ -700,10 +737,14 @@ static bool save_quetzal(IO &savefile, SaveType savetype, SaveOpcode saveopcode,
         savefile.write32(0); // to be filled in
         savefile.write_exact(is_bfzs ? "BFZS" : "IFZS", 4);
 
-        write_chunk(savefile, write_ifhd);
+        // Add one more “fake” call frame with just enough information to
+        // calculate the evaluation stack used by the current routine.
+        fp->sp = sp;
+
+        write_chunk(savefile, write_ifhd, pc);
         write_chunk(savefile, write_intd);
-        write_chunk(savefile, write_mem);
-        write_chunk(savefile, write_stks);
+        write_chunk(savefile, write_mem, memory.data());
+        write_chunk(savefile, write_stks, BASE_OF_FRAMES, fp);
         write_chunk(savefile, write_anno);
 
         // When saving to a stack (either for undo or for in-memory saves),
@@ -745,7 +786,113 @@ static bool save_quetzal(IO &savefile, SaveType savetype, SaveOpcode saveopcode,
         return true;
     } catch (const IO::IOError &) {
         return false;
+    } catch (const std::bad_alloc &) {
+        return false;
+    }
+}
+
+// Take a snapshot of the current state for @save_undo, sharing pages
+// with “prev”, the previous undo state, if there is one. On failure,
+// std::bad_alloc is thrown.
+static std::shared_ptr<UndoState> make_undo_state(const UndoState *prev)
+{
+    auto state = std::make_shared<UndoState>();
+
+    state->pc = pc;
+
+    state->stack.assign(BASE_OF_STACK, sp);
+
+    fp->sp = sp;
+    state->frames.assign(BASE_OF_FRAMES, fp + 1);
+    for (auto &frame : state->frames) {
+        frame.sp = state->stack.data() + (frame.sp - BASE_OF_STACK);
+    }
+
+    uint32_t npages = (header.static_start + UNDO_PAGE_SIZE - 1) / UNDO_PAGE_SIZE;
+    state->pages.resize(npages);
+
+    for (uint32_t i = 0; i < npages; i++) {
+        uint32_t addr = i * UNDO_PAGE_SIZE;
+        uint32_t n = std::min(UNDO_PAGE_SIZE, header.static_start - addr);
+        std::shared_ptr<const UndoPage> page = prev != nullptr ? prev->pages[i] : nullptr;
+        const uint8_t *old = page != nullptr ? page->data() : &dynamic_memory[addr];
+
+        if (std::memcmp(old, &memory[addr], n) != 0) {
+            auto newpage = std::make_shared<UndoPage>();
+            std::copy(&memory[addr], &memory[addr] + n, newpage->begin());
+            page = std::move(newpage);
+        }
+
+        state->pages[i] = std::move(page);
+    }
+
+    return state;
+}
+
+static void restore_undo_state(const UndoState &state)
+{
+    uint16_t flags2 = word(0x10);
+
+    for (uint32_t i = 0; i < state.pages.size(); i++) {
+        uint32_t addr = i * UNDO_PAGE_SIZE;
+        uint32_t n = std::min(UNDO_PAGE_SIZE, header.static_start - addr);
+        const uint8_t *saved = state.pages[i] != nullptr ? state.pages[i]->data() : &dynamic_memory[addr];
+
+        if (std::memcmp(saved, &memory[addr], n) != 0) {
+            std::copy(saved, saved + n, &memory[addr]);
+        }
+    }
+
+    load_globals();
+
+    std::copy(state.stack.begin(), state.stack.end(), BASE_OF_STACK);
+    sp = BASE_OF_STACK + state.stack.size();
+
+    fp = BASE_OF_FRAMES;
+    for (auto frame = state.frames.begin(); frame + 1 != state.frames.end(); ++frame) {
+        *fp = *frame;
+        fp->sp = BASE_OF_STACK + (frame->sp - state.stack.data());
+        fp++;
+    }
+
+    pc = state.pc;
+
+    // As in restore_quetzal().
+    write_header();
+    store_word(0x10, flags2);
+}
+
+// Convert an undo state to the Quetzal that save_quetzal() would have
+// written for it. On failure, std::bad_alloc is thrown.
+static std::vector<uint8_t> undo_state_quetzal(const UndoState &state)
+{
+    std::vector<uint8_t> mem(dynamic_memory.begin(), dynamic_memory.begin() + header.static_start);
+
+    for (uint32_t i = 0; i < state.pages.size(); i++) {
+        if (state.pages[i] != nullptr) {
+            uint32_t addr = i * UNDO_PAGE_SIZE;
+            uint32_t n = std::min(UNDO_PAGE_SIZE, header.static_start - addr);
+            std::copy(state.pages[i]->begin(), state.pages[i]->begin() + n, &mem[addr]);
+        }
     }
+
+    IO savefile(std::vector<uint8_t>(), IO::Mode::WriteOnly);
+
+    savefile.write_exact("FORM", 4);
+    savefile.write32(0); // to be filled in
+    savefile.write_exact("IFZS", 4);
+
+    write_chunk(savefile, write_ifhd, state.pc);
+    write_chunk(savefile, write_intd);
+    write_chunk(savefile, write_mem, mem.data());
+    write_chunk(savefile, write_stks, state.frames.data(), &state.frames.back());
+    write_chunk(savefile, write_anno);
+
+    long file_size = savefile.tell();
+    savefile.seek(4, IO::SeekFrom::Start);
+    savefile.write32(file_size - 8);
+
+    return savefile.get_memory();
 }
 
 static void read_mem(IFF &iff)
@@ -788,6 +935,8 @@ static void read_mem(IFF &iff)
     } else {
         throw RestoreError("no memory chunk found");
     }
+
+    load_globals();
 }
 
 static void read_stks(IFF &iff)
@@ -1318,6 +1467,15 @@ SaveResult push_save(SaveStackType type, SaveType savetype, SaveOpcode saveopcod
     }
 
     try {
+        // @save_undo states have their own in-memory format.
+        if (savetype == SaveType::Normal) {
+            const UndoState *prev = s.states.empty() ? nullptr : s.states.front().undo.get();
+
+            s.push(SaveState(make_undo_state(prev)));
+
+            return SaveResult::Success;
+        }
+
         IO savefile(std::vector<uint8_t>(), IO::Mode::WriteOnly);
 
         if (!save_quetzal(savefile, savetype, saveopcode, true)) {
@@ -1353,6 +1511,12 @@ bool pop_save(SaveStackType type, size_t saveno, SaveOpcode &saveopcode)
     auto p = std::move(s.states.front());
     s.states.pop_front();
 
+    if (p.undo != nullptr) {
+        restore_undo_state(*p.undo);
+        saveopcode = SaveOpcode::None;
+        return true;
+    }
+
     try {
         savefile = std::make_shared<IO>(p.quetzal, IO::Mode::ReadOnly);
     } catch (const IO::OpenError &) {
@@ -1495,6 +1659,7 @@ public:
         }
 
         std::copy(m_memory->begin(), m_memory->end(), memory.begin());
+        load_globals();
 
         return true;
     }
@@ -648,6 +648,7 @@ void start_story()
     store_word(0x10, flags2);
 
     write_header();
+    load_globals();
 
     // Put everything in a clean state.
     init_stack(first_run);
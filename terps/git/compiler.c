@@ -23,6 +23,8 @@ int gPeephole = 1;
 int gDebug = 0;
 int gCacheRAM = 0;
 
+size_t gMaxCacheSize = 0;
+
 BlockHeader * gBlockHeader;
 
 const char * gLabelNames [] = {
@@ -33,6 +35,7 @@ const char * gLabelNames [] = {
 
 HashNode ** gHashTable; // Hash table of glulx address -> code.
 git_uint32 gHashSize;   // Number of slots in the hash table.
+uint64_t gCacheHits;    // Number of successful lookups.
 
 // -------------------------------------------------------------
 // Types.
@@ -70,27 +73,16 @@ static PatchNode * sPatch;
 static int sNextInstructionIsReferenced;
 static git_uint32 sLastAddr;
 
+static CodeCacheStats sStats; // Everything except 'hits', which is in gCacheHits.
+
 // -------------------------------------------------------------
 // Functions
 
-void initCompiler (size_t size)
-{
-    static BlockHeader dummyHeader;
-    gBlockHeader = &dummyHeader;
-
-    // Make sure various assumptions we're making are correct.
-
-    assert (sizeof(HashNode) <= sizeof(PatchNode));
-
-    // Allocate the buffer. As far as possible, we're going to 
-    // use this buffer for everything compiler-related, and
-    // avoid further dynamic allocation.
+// Set up an empty cache in the given buffer, which must be zeroed.
 
-    sBuffer = malloc (size);
-    if (sBuffer == NULL)
-        fatalError ("Couldn't allocate code cache");
-    
-    memset (sBuffer, 0, size);
+static void useBuffer (git_uint32 * buffer, size_t size)
+{
+    sBuffer = buffer;
     sBufferSize = size / 4;
 
     // Pick a reasonable size for the hash table. This should be
@@ -109,10 +101,50 @@ void initCompiler (size_t size)
 
     sCodeStart = sCodeTop = (Block) (gHashTable + gHashSize);
     sTempStart = sTempEnd = (PatchNode*) (sBuffer + sBufferSize);
+
+    sStats.size = sBufferSize * 4;
+}
+
+void initCompiler (size_t size)
+{
+    static BlockHeader dummyHeader;
+    git_uint32 * buffer;
+    gBlockHeader = &dummyHeader;
+
+    // Make sure various assumptions we're making are correct.
+
+    assert (sizeof(HashNode) <= sizeof(PatchNode));
+
+    // Allocate the buffer. As far as possible, we're going to 
+    // use this buffer for everything compiler-related, and
+    // avoid further dynamic allocation.
+
+    buffer = malloc (size);
+    if (buffer == NULL)
+        fatalError ("Couldn't allocate code cache");
+    
+    memset (buffer, 0, size);
+
+    gCacheHits = 0;
+    memset (&sStats, 0, sizeof(sStats));
+    useBuffer (buffer, size);
+
+    // The cache can grow later on, but never shrinks below
+    // its initial size.
+
+    if (gMaxCacheSize < size)
+        gMaxCacheSize = size;
 }
 
 void shutdownCompiler ()
 {
+    // Keep the final sizes around for getCodeCacheStats().
+    sStats.used = (sCodeTop - sCodeStart) * 4;
+
+#ifdef USE_NATIVE_CODE
+    nativeShutdown ();
+#endif
+
     free (sBuffer);
 
     sBuffer = NULL;
@@ -123,6 +155,14 @@ void shutdownCompiler ()
     gBlockHeader = NULL;
 }
 
+void getCodeCacheStats (CodeCacheStats * stats)
+{
+    *stats = sStats;
+    stats->hits = gCacheHits;
+    if (sBuffer != NULL)
+        stats->used = (sCodeTop - sCodeStart) * 4;
+}
+
 static void abortIfBufferFull ()
 {
     // Make sure we have at least two words free,
@@ -353,9 +393,14 @@ Block compile (git_uint32 pc)
     gBlockHeader->compiledSize = sCodeTop - (git_uint32*) gBlockHeader;
     gBlockHeader->glulxSize = endOfBlock - pc;
     gBlockHeader->runCounter = 0;
+    gBlockHeader->lastRun = ~0; // Count it as having run since the last cleanup.
     
     assert(gBlockHeader->compiledSize > 0);
 
+    ++sStats.compiles;
+    if (sStats.peakUsed < (size_t) (sCodeTop - sCodeStart) * 4)
+        sStats.peakUsed = (sCodeTop - sCodeStart) * 4;
+
     // And we're done.
     return (git_uint32*) (gBlockHeader + 1);
 }
@@ -390,7 +435,10 @@ static git_uint32 findCutoffPoint ()
     return runCount / 2;
 }
 
-static void compressWithCutoff (git_uint32 cutoff)
+// Has this block been retrieved from the cache since the last cleanup?
+#define RAN_RECENTLY(header) ((header)->runCounter != (header)->lastRun)
+
+static void compressWithCutoff (git_uint32 cutoff, int dropStale)
 {
     BlockHeader * start = (BlockHeader*) sCodeStart;
     BlockHeader * top = (BlockHeader*) sCodeTop;
@@ -404,14 +452,10 @@ static void compressWithCutoff (git_uint32 cutoff)
     while (h < top)
     {
         BlockHeader * next = END_OF_BLOCK(h);
-        if (h->runCounter >= cutoff && h->glulxSize > 0)
+        if (h->runCounter >= cutoff && h->glulxSize > 0
+            && (RAN_RECENTLY(h) || !dropStale))
         {
         	git_uint32 size = h->compiledSize;
-        	
-            // Lower the run count of the saved blocks so that they'll
-            // stick around in the short term, but eventually fall out
-            // of the cache if they're not used much in the future.
-            h->runCounter /= 2;
  
             memmove (sCodeTop, h, size * sizeof(git_uint32));
             sCodeTop += size;
@@ -419,10 +463,34 @@ static void compressWithCutoff (git_uint32 cutoff)
         }
         else
         {
-            ++deleteCount;
+            // Blocks that were pruned are already gone as far
+            // as the statistics are concerned.
+            if (h->glulxSize > 0)
+                ++deleteCount;
         }
         h = next;
     }
+
+    sStats.evictions += deleteCount;
+}
+
+// Start a new generation: every block that survived the cleanup
+// counts as not having run recently. Also lower the run count of the
+// saved blocks so that they'll stick around in the short term, but
+// eventually fall out of the cache if they're not used much in the
+// future.
+
+static void startGeneration ()
+{
+    BlockHeader * start = (BlockHeader*) sCodeStart;
+    BlockHeader * top = (BlockHeader*) sCodeTop;
+    BlockHeader * h;
+
+    for (h = start ; h < top ; h = END_OF_BLOCK(h))
+    {
+        h->runCounter /= 2;
+        h->lastRun = h->runCounter;
+    }
 }
 
 static void rebuildHashTable ()
@@ -483,6 +551,10 @@ void pruneCodeCache (git_uint32 address, git_uint32 size)
     BlockHeader * top = (BlockHeader*) sCodeTop;
     BlockHeader * h;
 
+#ifdef USE_NATIVE_CODE
+    nativeFlush ();
+#endif
+
     // Step through the cache, looking for blocks that overlap the
     // specified range. If we find any, remove their nodes from the
     // hash table, and set glulxSize to 0 so that they're dropped
@@ -511,14 +583,93 @@ void pruneCodeCache (git_uint32 address, git_uint32 size)
     }
 }
 
+// Move the cache into a bigger buffer, keeping all the live blocks.
+// Returns 0 if the cache is already as big as it's allowed to get,
+// or if we can't get the memory.
+
+static int growCodeCache ()
+{
+    BlockHeader * h;
+    BlockHeader * top = (BlockHeader*) sCodeTop;
+    git_uint32 * oldBuffer = sBuffer;
+    git_uint32 * buffer;
+    size_t size = sBufferSize * 4;
+
+    if (size >= gMaxCacheSize)
+        return 0;
+
+    size = (size * 2 > gMaxCacheSize) ? gMaxCacheSize : size * 2;
+    buffer = malloc (size);
+    if (buffer == NULL)
+        return 0;
+
+    memset (buffer, 0, size);
+
+    h = (BlockHeader*) sCodeStart;
+    useBuffer (buffer, size);
+
+    for ( ; h < top ; h = END_OF_BLOCK(h))
+    {
+        if (h->glulxSize > 0)
+        {
+            memcpy (sCodeTop, h, h->compiledSize * sizeof(git_uint32));
+            sCodeTop += h->compiledSize;
+        }
+    }
+
+    free (oldBuffer);
+    rebuildHashTable ();
+
+    ++sStats.grows;
+    return 1;
+}
+
 void compressCodeCache ()
 {
-    git_uint32 n;
-    git_uint32 spaceUsed, spaceFree;
-    
-    n = findCutoffPoint();
-    compressWithCutoff (n);
+    BlockHeader * start = (BlockHeader*) sCodeStart;
+    BlockHeader * top = (BlockHeader*) sCodeTop;
+    BlockHeader * h;
+    git_uint32 spaceUsed, spaceFree, recentSize;
+
+    ++sStats.cleanups;
+
+#ifdef USE_NATIVE_CODE
+    // Blocks are about to move, so the native code has to go.
+    nativeFlush ();
+#endif
+
+    // Measure the working set: the code that has run since the
+    // last cleanup. If that's more than half the cache, evicting
+    // anything will just mean compiling it again soon, so we'd
+    // rather make the cache bigger if we're allowed to.
+
+    recentSize = 0;
+    for (h = start ; h < top ; h = END_OF_BLOCK(h))
+    {
+        if (h->glulxSize > 0 && RAN_RECENTLY(h))
+            recentSize += h->compiledSize;
+    }
+
+    if (recentSize * 2 > sBufferSize - gHashSize && growCodeCache())
+    {
+        startGeneration ();
+        return;
+    }
+
+    // Otherwise, throw away everything that hasn't run since the last
+    // cleanup. If that doesn't free up a quarter of the cache, fall
+    // back to evicting the recent blocks that ran least often.
+
+    compressWithCutoff (0, 1);
+
+    spaceUsed = sCodeTop - sCodeStart;
+    spaceFree = sBufferSize - spaceUsed - gHashSize;
+
+    if (spaceFree * 3 < spaceUsed)
+        compressWithCutoff (findCutoffPoint(), 0);
+
     rebuildHashTable ();
+    startGeneration ();
 
     spaceUsed = sCodeTop - sCodeStart;
     spaceFree = sBufferSize - spaceUsed - gHashSize;
@@ -539,8 +690,23 @@ void compressCodeCache ()
 
 void resetCodeCache ()
 {
+    BlockHeader * start = (BlockHeader*) sCodeStart;
+    BlockHeader * top = (BlockHeader*) sCodeTop;
+    BlockHeader * h;
+
 //    glk_put_string ("[resetting cache]\n");
 
+#ifdef USE_NATIVE_CODE
+    nativeFlush ();
+#endif
+
+    for (h = start ; h < top ; h = END_OF_BLOCK(h))
+    {
+        if (h->glulxSize > 0)
+            ++sStats.evictions;
+    }
+    ++sStats.resets;
+
     memset (sBuffer, 0, sBufferSize * 4);
     sCodeStart = sCodeTop = (Block) (gHashTable + gHashSize);
     sTempStart = sTempEnd = (PatchNode*) (sBuffer + sBufferSize);
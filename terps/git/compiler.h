@@ -30,6 +30,8 @@ extern int gPeephole; // Peephole optimisation of generated code?
 extern int gDebug;    // Insert debug statements into generated code?
 extern int gCacheRAM; // Keep RAM-based code in the JIT cache?
 
+extern size_t gMaxCacheSize; // Largest size the JIT cache may grow to, in bytes.
+
 // -------------------------------------------------------------
 // Compiling code
 
@@ -58,6 +60,22 @@ extern void compressCodeCache ();
 
 extern Block compile (git_uint32 pc);
 
+typedef struct CodeCacheStats
+{
+    uint64_t   hits;      // Number of lookups satisfied from the cache.
+    uint64_t   compiles;  // Number of blocks compiled.
+    uint64_t   evictions; // Number of blocks thrown away to make room.
+    git_uint32 cleanups;  // Number of times the cache filled up.
+    git_uint32 grows;     // Number of times the cache was enlarged.
+    git_uint32 resets;    // Number of times the cache was emptied completely.
+    size_t     size;      // Current size of the cache, in bytes.
+    size_t     used;      // Bytes of compiled code currently in the cache.
+    size_t     peakUsed;  // Largest value 'used' has reached.
+}
+CodeCacheStats;
+
+extern void getCodeCacheStats (CodeCacheStats * stats);
+
 typedef struct HashNode HashNode;
 
 struct HashNode
@@ -77,7 +95,9 @@ typedef struct BlockHeader
     git_uint16 compiledSize; // Total size of this block, in 4-byte words.
     git_uint32 glulxSize;    // Size of the glulx code this block represents, in bytes.
     git_uint32 runCounter;   // Total number of times this block was retrieved from the cache
-}                            // (used to determine which blocks stay in the cache)
+                             // (used to determine which blocks stay in the cache)
+    git_uint32 lastRun;      // Value of runCounter at the last cache cleanup, so we can
+}                            // tell whether the block has run since then.
 BlockHeader;
 
 // This is the header for the block currently being executed --
@@ -85,10 +105,57 @@ BlockHeader;
 // to getCode().
 extern BlockHeader * gBlockHeader;
 
+// -------------------------------------------------------------
+// Native code for hot blocks (see native.c)
+
+#ifdef USE_NATIVE_CODE
+
+// Blocks are translated after they've been fetched from
+// the cache this many times. Zero turns translation off.
+extern git_uint32 gNativeThreshold;
+
+// The interpreter state that native code can see and change.
+typedef struct NativeState
+{
+    git_sint32   L1, L2, L3;
+    git_uint32   ramStart;
+    git_sint32 * sp;
+    git_sint32 * locals;
+    git_sint32 * values;
+    git_sint32 * top;
+    git_uint8  * mem;
+    git_uint8  * dirty;                    // gDirtyPages.
+    git_uint32   limit32, limit16, limit8; // Highest valid addresses for each access size.
+}
+NativeState;
+
+typedef struct NativeStats
+{
+    git_uint32 traces;  // Number of traces translated.
+    git_uint32 flushes; // Number of times all the native code was thrown away.
+}
+NativeStats;
+
+extern void nativeCompileBlock (BlockHeader * header);
+extern void nativeFlush ();
+extern void nativeShutdown ();
+
+// Run the native code for the given entry point, returning the
+// place in the block where the interpreter should carry on.
+extern Block nativeRun (Block entry, NativeState * state);
+
+// The label that the entry point held before it was translated.
+extern Label nativeOriginalLabel (Block entry);
+
+extern void getNativeStats (NativeStats * stats);
+
+#endif // USE_NATIVE_CODE
+
 // Hash table for code lookup -- inlined for speed
 
 extern HashNode ** gHashTable; // Hash table of glulx address -> code.
 extern git_uint32 gHashSize;   // Number of slots in the hash table.
+extern uint64_t gCacheHits;    // Number of successful lookups.
 
 GIT_INLINE Block getCode (git_uint32 pc)
 {
@@ -99,6 +166,11 @@ GIT_INLINE Block getCode (git_uint32 pc)
         {
             gBlockHeader = (BlockHeader*) ((git_uint32*)n + n->headerOffset);
             gBlockHeader->runCounter++;
+            ++gCacheHits;
+#ifdef USE_NATIVE_CODE
+            if (gBlockHeader->runCounter == gNativeThreshold)
+                nativeCompileBlock (gBlockHeader);
+#endif
             return (git_uint32*)n + n->codeOffset;
         }
         n = n->u.next;
@@ -16,6 +16,11 @@
 // Define this to use GCC's labels-as-values extension for a big speedup.
 // #define USE_DIRECT_THREADING
 
+// Define this to build both a switch-based and a direct-threaded copy of
+// the interpreter, and let the user choose between them when the game
+// starts. Needs labels-as-values too.
+// #define USE_DISPATCH_SELECT
+
 // Define this if we can use the "inline" keyword.
 // #define USE_INLINE
 
@@ -25,6 +30,14 @@
 // Define this to memory-map the game file to speed up loading. (Unix-specific)
 // #define USE_MMAP
 
+// Define this to translate frequently-run blocks into native machine code.
+// (x86-64 Unix only; the build system sets it when it's available.)
+// #define USE_NATIVE_CODE
+
+// Define this to count how often each opcode, and each short sequence
+// of opcodes, is executed. See superops.py for what to do with the counts.
+// #define USE_OPCODE_PROFILE
+
 // -------------------------------------------------------------------
 
 // Make sure we're compiling for a sane platform. For now, this means
@@ -99,4 +112,25 @@ typedef double git_double;
 #  define git_noreturn
 #endif
 
+// Native code can run a loop without returning to the interpreter,
+// so it can't be used when the interpreter has to call glk_tick().
+#if defined(USE_NATIVE_CODE) && defined(GIT_NEED_TICK)
+#undef USE_NATIVE_CODE
+#endif
+
+// The profiler sees each opcode as it's dispatched, which only
+// happens in one place if we're using the switch statement.
+#ifdef USE_OPCODE_PROFILE
+#undef USE_DIRECT_THREADING
+#undef USE_DISPATCH_SELECT
+#undef USE_NATIVE_CODE
+#endif
+
+// With USE_DISPATCH_SELECT, terp.c is compiled as it is for the
+// switch-based interpreter, and terp_threaded.c compiles it again
+// with USE_DIRECT_THREADING for the other one.
+#ifdef USE_DISPATCH_SELECT
+#undef USE_DIRECT_THREADING
+#endif
+
 #endif // GIT_CONFIG_H
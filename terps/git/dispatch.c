@@ -0,0 +1,26 @@
+// Choosing an interpreter engine at run time, for USE_DISPATCH_SELECT.
+//
+// Git can be built with two copies of the interpreter: startProgram(),
+// which dispatches each opcode through a switch statement, and
+// startThreadedProgram(), which jumps straight from one opcode to the
+// next using GCC's labels-as-values. Direct threading is usually faster,
+// so that's what we use unless the user asks for the switch statement.
+// Which one wins depends on the compiler and on how well the CPU
+// predicts indirect branches, and only running real games can tell.
+
+#include "git.h"
+
+#ifdef USE_DISPATCH_SELECT
+
+Dispatch gDispatch = DISPATCH_THREADED;
+
+const char * dispatchName (Dispatch dispatch)
+{
+    switch (dispatch)
+    {
+        case DISPATCH_SWITCH:   return "switch";
+        default:                return "threaded";
+    }
+}
+
+#endif // USE_DISPATCH_SELECT
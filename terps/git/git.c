@@ -58,6 +58,11 @@ static void gitMain (const git_uint8 * game, git_uint32 gameSize, git_uint32 cac
     }
     
     // Call the top-level function.
+#ifdef USE_DISPATCH_SELECT
+    if (gDispatch == DISPATCH_THREADED)
+        startThreadedProgram (cacheSize);
+    else
+#endif
     startProgram (cacheSize);
     
     // Shut everything down cleanly.
@@ -104,9 +104,17 @@ extern void parseCatchStub (git_uint32 * pc, int * modes);
 extern void resetPeepholeOptimiser();
 extern void emitCode (Label);
 
+#ifdef USE_OPCODE_PROFILE
+extern void profileOpcode (Label);
+extern void writeOpcodeProfile (FILE *);
+#endif
+
 // terp.c
 
-#if defined(USE_DIRECT_THREADING) && (UINTPTR_MAX > 0xffffffffULL)
+#if defined(USE_DISPATCH_SELECT)
+    extern git_uint32 gOpcodeWords [];
+#   define labelToOpcode(label) (gOpcodeWords[label])
+#elif defined(USE_DIRECT_THREADING) && (UINTPTR_MAX > 0xffffffffULL)
     extern Opcode* gOpcodeTable;
 #   define labelToOpcode(label) ((uintptr_t)gOpcodeTable[label] & 0xffffffffULL)
 #elif defined(USE_DIRECT_THREADING)
@@ -121,9 +129,26 @@ extern git_sint32* gStackPointer;
 extern enum IOMode gIoMode;
 
 extern glui32 native_random ();
+extern void git_seed_random (glui32 seed);
+extern glui32 git_random ();
 
 extern void startProgram (size_t cacheSize);
 
+// dispatch.c (and terp_threaded.c)
+
+#ifdef USE_DISPATCH_SELECT
+typedef enum
+{
+    DISPATCH_SWITCH,   // startProgram(), using a switch statement.
+    DISPATCH_THREADED  // startThreadedProgram(), using direct threading.
+}
+Dispatch;
+
+extern Dispatch gDispatch;
+extern const char * dispatchName (Dispatch);
+extern void startThreadedProgram (size_t cacheSize);
+#endif
+
 // glkop.c
 
 extern int git_init_dispatch();
@@ -7,6 +7,7 @@
 #include "git.h"
 #include <glk.h>
 #include <glkstart.h> // This comes with the Glk library.
+#include <string.h>
 
 #ifdef USE_MMAP
 #include <fcntl.h>
@@ -15,16 +16,175 @@
 #include <errno.h>
 #endif
 
-// The only command-line argument is the filename.
 glkunix_argumentlist_t glkunix_arguments[] =
 {
+    { "--cachesize", glkunix_arg_ValueFollows, "Initial size of the code cache, in KB (default 256)." },
+    { "--cachelimit", glkunix_arg_ValueFollows, "Size the code cache may grow to, in KB (default 8192)." },
+    { "--cachestats", glkunix_arg_ValueFollows, "Write code cache statistics to a file on exit." },
+#ifdef USE_DISPATCH_SELECT
+    { "--dispatch", glkunix_arg_ValueFollows, "Interpreter engine: switch or threaded (default threaded)." },
+#endif
+#ifdef USE_NATIVE_CODE
+    { "--native", glkunix_arg_ValueFollows, "Translate code to machine code after it has run this many times (default 1000, 0 for never)." },
+#endif
+#ifdef USE_OPCODE_PROFILE
+    { "--opprofile", glkunix_arg_ValueFollows, "Write opcode counts to a file on exit (see superops.py)." },
+#endif
     { "", glkunix_arg_ValueFollows, "filename: The game file to load." },
     { NULL, glkunix_arg_End, NULL }
 };
 
 #define CACHE_SIZE (256 * 1024L)
+#define CACHE_LIMIT (8 * 1024 * 1024L)
 #define UNDO_SIZE (2 * 1024 * 1024L)
 
+static size_t gCacheSize = CACHE_SIZE;
+static const char * gCacheStatsFilename = 0;
+#ifdef USE_OPCODE_PROFILE
+static const char * gProfileFilename = 0;
+#endif
+
+// Parse the command-line options. Returns the game filename,
+// or NULL if there isn't one or an option is bad.
+
+static const char * parseOptions (glkunix_startup_t *data)
+{
+    const char * filename = NULL;
+    int ix;
+
+    gMaxCacheSize = CACHE_LIMIT;
+
+    for (ix = 1 ; ix < data->argc ; ++ix)
+    {
+        const char * arg = data->argv[ix];
+        int isSize = !strcmp (arg, "--cachesize");
+        int isLimit = !strcmp (arg, "--cachelimit");
+
+        if ((isSize || isLimit) && ix + 1 < data->argc)
+        {
+            char * end;
+            long kb = strtol (data->argv[++ix], &end, 10);
+            if (*end || kb <= 0)
+            {
+                fprintf (stderr, "git: %s must be a positive number of KB\n", arg);
+                return NULL;
+            }
+            if (isSize)
+                gCacheSize = kb * 1024L;
+            else
+                gMaxCacheSize = kb * 1024L;
+        }
+        else if (!strcmp (arg, "--cachestats") && ix + 1 < data->argc)
+        {
+            gCacheStatsFilename = data->argv[++ix];
+        }
+#ifdef USE_OPCODE_PROFILE
+        else if (!strcmp (arg, "--opprofile") && ix + 1 < data->argc)
+        {
+            gProfileFilename = data->argv[++ix];
+        }
+#endif
+#ifdef USE_DISPATCH_SELECT
+        else if (!strcmp (arg, "--dispatch") && ix + 1 < data->argc)
+        {
+            const char * name = data->argv[++ix];
+            if (!strcmp (name, "switch"))
+                gDispatch = DISPATCH_SWITCH;
+            else if (!strcmp (name, "threaded"))
+                gDispatch = DISPATCH_THREADED;
+            else
+            {
+                fprintf (stderr, "git: %s must be switch or threaded\n", arg);
+                return NULL;
+            }
+        }
+#endif
+#ifdef USE_NATIVE_CODE
+        else if (!strcmp (arg, "--native") && ix + 1 < data->argc)
+        {
+            char * end;
+            long count = strtol (data->argv[++ix], &end, 10);
+            if (*end || count < 0)
+            {
+                fprintf (stderr, "git: %s must be zero or a positive number\n", arg);
+                return NULL;
+            }
+            gNativeThreshold = count;
+        }
+#endif
+        else
+        {
+            filename = arg;
+        }
+    }
+
+    return filename;
+}
+
+// Write out the code cache statistics, if they were asked for.
+
+static void writeCacheStats ()
+{
+    CodeCacheStats stats;
+    FILE * f;
+    uint64_t lookups;
+
+    if (gCacheStatsFilename == NULL)
+        return;
+
+    f = fopen (gCacheStatsFilename, "w");
+    if (f == NULL)
+        return;
+
+    getCodeCacheStats (&stats);
+    lookups = stats.hits + stats.compiles;
+
+    fprintf (f, "lookups: %llu\n", (unsigned long long) lookups);
+    fprintf (f, "hits: %llu (%.2f%%)\n", (unsigned long long) stats.hits,
+        lookups ? 100.0 * stats.hits / lookups : 0.0);
+    fprintf (f, "compiles: %llu\n", (unsigned long long) stats.compiles);
+    fprintf (f, "evictions: %llu\n", (unsigned long long) stats.evictions);
+    fprintf (f, "cleanups: %lu\n", (unsigned long) stats.cleanups);
+    fprintf (f, "grows: %lu\n", (unsigned long) stats.grows);
+    fprintf (f, "resets: %lu\n", (unsigned long) stats.resets);
+    fprintf (f, "cache size: %lu bytes\n", (unsigned long) stats.size);
+    fprintf (f, "code in cache: %lu bytes\n", (unsigned long) stats.used);
+    fprintf (f, "peak code in cache: %lu bytes\n", (unsigned long) stats.peakUsed);
+
+#ifdef USE_DISPATCH_SELECT
+    fprintf (f, "dispatch: %s\n", dispatchName (gDispatch));
+#endif
+
+#ifdef USE_NATIVE_CODE
+    {
+        NativeStats native;
+        getNativeStats (&native);
+        fprintf (f, "native traces: %lu\n", (unsigned long) native.traces);
+        fprintf (f, "native flushes: %lu\n", (unsigned long) native.flushes);
+    }
+#endif
+    fclose (f);
+}
+
+// Write out the opcode profile, if it was asked for.
+
+static void writeProfile ()
+{
+#ifdef USE_OPCODE_PROFILE
+    FILE * f;
+
+    if (gProfileFilename == NULL)
+        return;
+
+    f = fopen (gProfileFilename, "w");
+    if (f == NULL)
+        return;
+
+    writeOpcodeProfile (f);
+    fclose (f);
+#endif
+}
+
 #ifdef GARGLK
 
 #include <string.h>
@@ -64,6 +224,8 @@ const char * gFilename = 0;
 
 int glkunix_startup_code(glkunix_startup_t *data)
 {
+    const char * filename;
+
 #ifdef GARGLK
 	{
 		char buf[255];
@@ -75,13 +237,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 	}
 #endif /* GARGLK */
 
-    if (data->argc <= 1)
+    filename = parseOptions (data);
+    if (filename == NULL)
     {
 #ifdef GARGLK
         gStartupError = "No file given";
         return 1;
 #else
-        printf ("usage: git gamefile.ulx\n");
+        printf ("usage: git [options] gamefile.ulx\n");
         return 0;
 #endif
     }
@@ -89,14 +252,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 #ifdef GARGLK
 	{
 		char *s;
-		s = strrchr(data->argv[1], '\\');
+		s = strrchr(filename, '\\');
 		if (s) garglk_set_story_name(s+1);
-		s = strrchr(data->argv[1], '/');
+		s = strrchr(filename, '/');
 		if (s) garglk_set_story_name(s+1);
 	}
 #endif /* GARGLK */
 
-    gFilename = data->argv[1];
+    gFilename = filename;
     return 1;
 }
 
@@ -136,8 +299,10 @@ void glk_main ()
 	gHasInited = 1;
 #endif
         
-    git (ptr, info.st_size, CACHE_SIZE, UNDO_SIZE);
+    git (ptr, info.st_size, gCacheSize, UNDO_SIZE);
     munmap ((void*) ptr, info.st_size);
+    writeCacheStats ();
+    writeProfile ();
     return;
     
 error:
@@ -157,6 +322,8 @@ strid_t gStream = 0;
 
 int glkunix_startup_code(glkunix_startup_t *data)
 {
+    const char * filename;
+
 #ifdef GARGLK
 	{
 		char buf[255];
@@ -168,13 +335,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 	}
 #endif /* GARGLK */
 
-    if (data->argc <= 1)
+    filename = parseOptions (data);
+    if (filename == NULL)
     {
 #ifdef GARGLK
         gStartupError = "No file given";
         return 1;
 #else
-        printf ("usage: git gamefile.ulx\n");
+        printf ("usage: git [options] gamefile.ulx\n");
         return 0;
 #endif
     }
@@ -182,14 +350,14 @@ int glkunix_startup_code(glkunix_startup_t *data)
 #ifdef GARGLK
 	{
 		char *s;
-		s = strrchr(data->argv[1], '\\');
+		s = strrchr(filename, '\\');
 		if (s) garglk_set_story_name(s+1);
-		s = strrchr(data->argv[1], '/');
+		s = strrchr(filename, '/');
 		if (s) garglk_set_story_name(s+1);
 	}
 #endif /* GARGLK */
 
-    gStream = glkunix_stream_open_pathname ((char*) data->argv[1], 0, 0);
+    gStream = glkunix_stream_open_pathname ((char*) filename, 0, 0);
     return 1;
 }
 
@@ -207,7 +375,9 @@ void glk_main ()
     gHasInited = 1;
 #endif
 
-    gitWithStream (gStream, CACHE_SIZE, UNDO_SIZE);
+    gitWithStream (gStream, gCacheSize, UNDO_SIZE);
+    writeCacheStats ();
+    writeProfile ();
 }
 
 #endif // USE_MMAP
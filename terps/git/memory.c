@@ -6,6 +6,7 @@
 
 const git_uint8 * gInitMem;
 git_uint8 * gMem;
+git_uint8 * gDirtyPages;
 
 git_uint32 gRamStart;
 git_uint32 gExtStart;
@@ -72,6 +73,11 @@ void initMemory (const git_uint8 * gamefile, git_uint32 size)
 
 	// Zero out the extended RAM.
 	memset (gMem + gExtStart, 0, gEndMem - gExtStart);
+
+	// Nothing has been written yet.
+	gDirtyPages = calloc (gEndMem >> 8, 1);
+	if (gDirtyPages == NULL)
+	    fatalError ("Failed to allocate game RAM");
 }
 
 int verifyMemory ()
@@ -89,6 +95,7 @@ int verifyMemory ()
 int resizeMemory (git_uint32 newSize, int isInternal)
 {
     git_uint8* newMem;
+    git_uint8* newDirty;
     
     if (newSize == gEndMem)
         return 0; // Size is not changed.
@@ -104,10 +111,19 @@ int resizeMemory (git_uint32 newSize, int isInternal)
     {	
         return 1; // Failed to extend memory.
     }
+    gMem = newMem;
+
+    newDirty = realloc(gDirtyPages, newSize >> 8);
+    if (!newDirty)
+        fatalError ("Failed to allocate game RAM");
+    gDirtyPages = newDirty;
+
     if (newSize > gEndMem)
+    {
         memset (newMem + gEndMem, 0, newSize - gEndMem);
+        memset (newDirty + (gEndMem >> 8), 1, (newSize - gEndMem) >> 8);
+    }
 
-    gMem = newMem;
     gEndMem = newSize;
     return 0;
 }
@@ -135,6 +151,14 @@ void resetMemory (git_uint32 protectPos, git_uint32 protectSize)
         if (i >= protectEnd || i < protectPos)
             gMem [i] = 0;
     }
+
+    markMemoryDirty (gRamStart, gEndMem - gRamStart);
+}
+
+void markMemoryDirty (git_uint32 address, git_uint32 size)
+{
+    if (size > 0)
+        memset (gDirtyPages + (address >> 8), 1, ((address + size - 1) >> 8) - (address >> 8) + 1);
 }
 
 void shutdownMemory ()
@@ -143,11 +167,12 @@ void shutdownMemory ()
     // only need to dispose of the RAM.
     
     free (gMem);
+    free (gDirtyPages);
     
     // Zero out all our globals.
     
     gRamStart = gExtStart = gEndMem = gOriginalEndMem = 0;
-    gInitMem = gMem = NULL;
+    gInitMem = gMem = gDirtyPages = NULL;
 }
 
 void memReadError (git_uint32 address)
@@ -73,6 +73,11 @@ extern const git_uint8 * gInitMem;
 // both the ROM and the current contents of RAM.
 extern git_uint8 * gMem;
 
+// One byte for each 256-byte page of memory, set whenever the page
+// is written to. The undo code uses this to find out what's changed
+// since the last undo record without looking at every page.
+extern git_uint8 * gDirtyPages;
+
 
 // --------------------------------------------------------------
 // Functions
@@ -95,6 +100,10 @@ extern int resizeMemory (git_uint32 newSize, int isInternal);
 
 extern void resetMemory (git_uint32 protectPos, git_uint32 protectSize);
 
+// Marks a range of memory as having been written to.
+
+extern void markMemoryDirty (git_uint32 address, git_uint32 size);
+
 // Disposes of all the data structures allocated in initMemory().
 
 extern void shutdownMemory ();
@@ -134,7 +143,10 @@ GIT_INLINE git_uint32 memRead8 (git_uint32 address)
 GIT_INLINE void memWrite32 (git_uint32 address, git_uint32 val)
 {
     if (address >= gRamStart && address <= (gEndMem - 4))
+    {
         write32 (gMem + address, val);
+        gDirtyPages [address >> 8] = gDirtyPages [(address + 3) >> 8] = 1;
+    }
     else
         memWriteError (address);
 }
@@ -142,7 +154,10 @@ GIT_INLINE void memWrite32 (git_uint32 address, git_uint32 val)
 GIT_INLINE void memWrite16 (git_uint32 address, git_uint32 val)
 {
     if (address >= gRamStart && address <= (gEndMem - 2))
+    {
         write16 (gMem + address, val);
+        gDirtyPages [address >> 8] = gDirtyPages [(address + 1) >> 8] = 1;
+    }
     else
         memWriteError (address);
 }
@@ -150,7 +165,10 @@ GIT_INLINE void memWrite16 (git_uint32 address, git_uint32 val)
 GIT_INLINE void memWrite8 (git_uint32 address, git_uint32 val)
 {
     if (address >= gRamStart && address < gEndMem)
+    {
         write8 (gMem + address, val);
+        gDirtyPages [address >> 8] = 1;
+    }
     else
         memWriteError (address);
 }
@@ -0,0 +1,1163 @@
+// Native code tier for git (x86-64 only).
+//
+// Once a block has been fetched from the code cache gNativeThreshold
+// times, we translate the straight-line integer code at each of its
+// entry points into x86-64 machine code, and replace the first label
+// of each entry with label_native. The interpreter hands control to
+// the trace when it reaches that label, and the trace hands back a
+// pointer into the block at which the interpreter should carry on.
+//
+// Only a small set of opcodes is translated: register loads and stores,
+// integer arithmetic, array loads and stores, and integer branches.
+// Everything else ends the trace. Anything that could fail at run time
+// (stack bounds, memory bounds) is checked before the opcode has any
+// effect, and a failed check leaves the trace at that opcode, so the
+// interpreter repeats it and raises the error exactly as it would have
+// done without native code. Conditional branches that leave the block
+// are handled the same way: the trace stops at the branch and lets the
+// interpreter take it.
+//
+// The translated code stays valid for as long as the block it came from,
+// so compressCodeCache(), resetCodeCache() and pruneCodeCache() call
+// nativeFlush() to put the original labels back and throw away all the
+// machine code before they move or drop any blocks.
+
+#include "git.h"
+
+#ifdef USE_NATIVE_CODE
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// -------------------------------------------------------------
+// Constants
+
+#define ARENA_SIZE    (4 * 1024 * 1024) // Bytes of machine code we can hold.
+#define MAX_ENTRIES   16384             // Number of traces we can hold.
+#define ENTRY_HASH    4096              // Slots in the entry hash table (power of two).
+#define MIN_TRACE_OPS 3                 // Shorter traces aren't worth entering.
+#define OP_SPACE      128               // Bytes that must be free before translating an opcode.
+#define STUB_SPACE    16                // Bytes needed for one exit stub.
+
+// x86-64 registers.
+
+enum
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// How the interpreter's state is kept in registers while a trace runs.
+
+#define REG_L1       R8   // L1..L3, as 32-bit registers.
+#define REG_L2       R9
+#define REG_L3       R10
+#define REG_SP       RSI  // Stack pointer.
+#define REG_LOCALS   RDX  // Start of the locals.
+#define REG_VALUES   R11  // Start of the values.
+#define REG_TOP      RBP  // Top of the stack.
+#define REG_MEM      RBX  // gMem.
+#define REG_LIMIT32  R12  // Highest address for a 32-bit read or write.
+#define REG_RAMSTART R13  // Lowest address for a write.
+#define REG_LIMIT16  R14  // Highest address for a 16-bit read or write.
+#define REG_LIMIT8   R15  // Highest address for an 8-bit read or write.
+#define REG_STATE    RDI  // The NativeState we were called with.
+
+// Condition codes, for jcc.
+
+enum
+{
+    CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_BE = 6, CC_A = 7,
+    CC_L = 12, CC_GE = 13, CC_LE = 14, CC_G = 15
+};
+
+// Operand modes, in the order used by LOAD_LABELS in labels.inc.
+
+enum
+{
+    MODE_CONST, MODE_STACK, MODE_LOCAL, MODE_ADDR
+};
+
+// Flags for the instruction encoders.
+
+#define W   1 // 64-bit operand size.
+#define O16 2 // 16-bit operand size.
+
+// -------------------------------------------------------------
+// Types
+
+typedef Block (*NativeFn) (NativeState *);
+
+typedef struct NativeEntry NativeEntry;
+
+struct NativeEntry
+{
+    Block         entry; // Word in the block that now holds label_native.
+    git_uint32    word;  // What used to be there.
+    Label         label; // ...and which label that was.
+    NativeFn      fn;    // Machine code for the trace starting there.
+    NativeEntry * next;  // Next entry in the same hash slot.
+};
+
+typedef struct Fixup
+{
+    git_uint8 * rel;     // rel32 field of a jump that needs a destination.
+    long        target;  // Word index (relative to the start of the block's code).
+    int         canJump; // Can we jump straight to translated code there?
+}
+Fixup;
+
+// -------------------------------------------------------------
+// Globals
+
+git_uint32 gNativeThreshold = 1000;
+
+static int sReady;       // 1 if the arena is set up, -1 if we can't have one.
+static git_uint8 * sArena;
+static git_uint8 * sArenaTop;
+static git_uint8 * sArenaEnd;
+
+static NativeEntry   sEntries [MAX_ENTRIES];
+static int           sNumEntries;
+static NativeEntry * sEntryHash [ENTRY_HASH];
+
+static git_uint32 sNativeWord; // labelToOpcode (label_native)
+
+static NativeStats sStats;
+
+#if defined(USE_DIRECT_THREADING) || defined(USE_DISPATCH_SELECT)
+// In direct-threaded code a label is stored as (part of) an address,
+// so we need a reverse mapping to find out what we're looking at.
+#define LABEL_HASH 1024
+static git_uint32 sLabelWords [LABEL_HASH];
+static Label      sLabelValues [LABEL_HASH];
+#endif
+
+// State for the trace being translated.
+
+static git_uint8 *  sOut;      // Next byte of machine code.
+static Block        sCode;     // First word of the block's code.
+static git_uint32   sCodeWords;// Number of words of code in the block.
+static git_uint8 ** sOpAddr;   // Machine code for each word of this trace, or NULL.
+static git_uint8 ** sStubAddr; // Exit stub for each word of this trace, or NULL.
+static git_uint8 *  sEpilogue; // Where every exit ends up.
+static Fixup *      sFixups;
+static int          sNumFixups;
+static int          sMaxFixups;
+static long         sOpIndex;  // Word index of the opcode being translated.
+static int          sFailed;   // Ran out of space somewhere.
+
+// -------------------------------------------------------------
+// Instruction encoding
+
+static void byte (int b)
+{
+    *sOut++ = (git_uint8) b;
+}
+
+static void dword (git_uint32 d)
+{
+    memcpy (sOut, &d, 4);
+    sOut += 4;
+}
+
+static void rex (int flags, int reg, int rm)
+{
+    int r = 0x40 | ((flags & W) << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+    if (r != 0x40)
+        byte (r);
+}
+
+static void opcode (int flags, int op, int reg, int rm)
+{
+    if (flags & O16)
+        byte (0x66);
+    rex (flags, reg, rm);
+    if (op > 0xFF)
+        byte (op >> 8);
+    byte (op & 0xFF);
+}
+
+// op reg, rm -- both registers. 'reg' may be an opcode extension.
+static void insnRR (int flags, int op, int reg, int rm)
+{
+    opcode (flags, op, reg, rm);
+    byte (0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op reg, [base + disp32]
+static void insnRM (int flags, int op, int reg, int base, git_sint32 disp)
+{
+    opcode (flags, op, reg, base);
+    byte (0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP)
+        byte (0x24);
+    dword ((git_uint32) disp);
+}
+
+// op reg, [REG_MEM + rax]
+static void insnRX (int flags, int op, int reg)
+{
+    opcode (flags, op, reg, 0);
+    byte (0x04 | ((reg & 7) << 3));
+    byte ((RAX << 3) | REG_MEM);
+}
+
+static void movRR (int dst, int src)         { insnRR (0, 0x89, src, dst); }
+static void movRI (int dst, git_uint32 imm)  { rex (0, 0, dst); byte (0xB8 + (dst & 7)); dword (imm); }
+static void cmpRR (int a, int b)             { insnRR (0, 0x39, b, a); }
+static void cmpRI (int r, git_uint32 imm)    { insnRR (0, 0x81, 7, r); dword (imm); }
+static void bswap (int r)                    { rex (0, 0, r); byte (0x0F); byte (0xC8 + (r & 7)); }
+static void rol16 (int r)                    { insnRR (O16, 0xC1, 0, r); byte (8); }
+static void push (int r)                     { rex (0, 0, r); byte (0x50 + (r & 7)); }
+static void pop (int r)                      { rex (0, 0, r); byte (0x58 + (r & 7)); }
+
+static git_uint8 * jcc32 (int cc)
+{
+    byte (0x0F); byte (0x80 + cc); dword (0);
+    return sOut - 4;
+}
+
+static git_uint8 * jmp32 ()
+{
+    byte (0xE9); dword (0);
+    return sOut - 4;
+}
+
+static git_uint8 * jcc8 (int cc)
+{
+    byte (0x70 + cc); byte (0);
+    return sOut - 1;
+}
+
+static void patch32 (git_uint8 * rel, git_uint8 * dest)
+{
+    git_sint32 offset = (git_sint32) (dest - (rel + 4));
+    memcpy (rel, &offset, 4);
+}
+
+static void patch8 (git_uint8 * rel)
+{
+    *rel = (git_uint8) (sOut - (rel + 1));
+}
+
+// -------------------------------------------------------------
+// Exits
+
+static void addFixup (git_uint8 * rel, long target, int canJump)
+{
+    if (sNumFixups == sMaxFixups)
+    {
+        int max = sMaxFixups ? sMaxFixups * 2 : 64;
+        Fixup * f = realloc (sFixups, max * sizeof(Fixup));
+        if (f == NULL)
+        {
+            sFailed = 1;
+            return;
+        }
+        sFixups = f;
+        sMaxFixups = max;
+    }
+    sFixups[sNumFixups].rel = rel;
+    sFixups[sNumFixups].target = target;
+    sFixups[sNumFixups].canJump = canJump;
+    ++sNumFixups;
+}
+
+// Leave the trace if the condition holds, resuming the
+// interpreter at the start of the current opcode.
+static void guard (int cc)
+{
+    addFixup (jcc32 (cc), sOpIndex, 0);
+}
+
+// Emit code that leaves the trace, resuming the interpreter at the
+// given word of the block.
+static void emitExit (long target)
+{
+    rex (W, 0, RAX);
+    byte (0xB8);
+    {
+        Block resume = sCode + target;
+        memcpy (sOut, &resume, 8);
+        sOut += 8;
+    }
+    patch32 (jmp32 (), sEpilogue);
+}
+
+// -------------------------------------------------------------
+// Operands
+
+static int limitReg (int size)
+{
+    return size == 4 ? REG_LIMIT32 : size == 2 ? REG_LIMIT16 : REG_LIMIT8;
+}
+
+// Can we translate this operand at all? Locals and addresses end up
+// as 32-bit signed displacements, so they have to be small enough.
+static int canLoad (int mode, git_uint32 value)
+{
+    if (mode == MODE_LOCAL)
+        return value < 0x1FFFFFFF;
+    if (mode == MODE_ADDR)
+        return value < 0x7FFFFFF0;
+    return 1;
+}
+
+// Check that 'count' values can be popped off the stack.
+static void guardPops (int count)
+{
+    if (count == 1)
+    {
+        insnRR (W, 0x39, REG_VALUES, REG_SP); // cmp sp, values
+        guard (CC_BE);
+    }
+    else if (count > 1)
+    {
+        insnRM (W, 0x8D, RAX, REG_VALUES, count * 4); // lea rax, [values + count*4]
+        insnRR (W, 0x39, RAX, REG_SP);                // cmp sp, rax
+        guard (CC_B);
+    }
+}
+
+static void guardRead (int mode, git_uint32 value, int size)
+{
+    if (mode == MODE_ADDR)
+    {
+        cmpRI (limitReg (size), value);
+        guard (CC_B);
+    }
+}
+
+static void guardWrite (int mode, git_uint32 value, int size)
+{
+    if (mode == MODE_STACK)
+    {
+        insnRR (W, 0x39, REG_TOP, REG_SP); // cmp sp, top
+        guard (CC_AE);
+    }
+    else if (mode == MODE_ADDR)
+    {
+        cmpRI (REG_RAMSTART, value);
+        guard (CC_A);
+        cmpRI (limitReg (size), value);
+        guard (CC_B);
+    }
+}
+
+static void load (int reg, int mode, git_uint32 value, int size)
+{
+    switch (mode)
+    {
+        case MODE_CONST:
+            movRI (reg, value);
+            break;
+
+        case MODE_STACK:
+            insnRR (W, 0x83, 5, REG_SP); byte (4); // sub sp, 4
+            insnRM (0, 0x8B, reg, REG_SP, 0);
+            break;
+
+        case MODE_LOCAL:
+            insnRM (0, 0x8B, reg, REG_LOCALS, value * 4);
+            break;
+
+        case MODE_ADDR:
+            if (size == 4)
+            {
+                insnRM (0, 0x8B, reg, REG_MEM, value);
+                bswap (reg);
+            }
+            else if (size == 2)
+            {
+                insnRM (0, 0x0FB7, reg, REG_MEM, value);
+                rol16 (reg);
+            }
+            else
+            {
+                insnRM (0, 0x0FB6, reg, REG_MEM, value);
+            }
+            break;
+    }
+}
+
+// Mark the pages written by a store as dirty (see memory.h). The
+// map can move when memory is resized, so we fetch it each time.
+static void markDirty (git_uint32 value, int size)
+{
+    insnRM (W, 0x8B, RCX, REG_STATE, offsetof(NativeState, dirty));
+    insnRM (0, 0xC6, 0, RCX, value >> 8); byte (1);
+    if (((value + size - 1) >> 8) != (value >> 8))
+    {
+        insnRM (0, 0xC6, 0, RCX, (value + size - 1) >> 8); byte (1);
+    }
+}
+
+static void store (int reg, int mode, git_uint32 value, int size)
+{
+    switch (mode)
+    {
+        case MODE_STACK:
+            insnRM (0, 0x89, reg, REG_SP, 0);
+            insnRR (W, 0x83, 0, REG_SP); byte (4); // add sp, 4
+            break;
+
+        case MODE_LOCAL:
+            insnRM (0, 0x89, reg, REG_LOCALS, value * 4);
+            break;
+
+        case MODE_ADDR:
+            if (size == 4)
+            {
+                movRR (RCX, reg);
+                bswap (RCX);
+                insnRM (0, 0x89, RCX, REG_MEM, value);
+            }
+            else if (size == 2)
+            {
+                movRR (RCX, reg);
+                rol16 (RCX);
+                insnRM (O16, 0x89, RCX, REG_MEM, value);
+            }
+            else
+            {
+                insnRM (0, 0x88, reg, REG_MEM, value);
+            }
+            markDirty (value, size);
+            break;
+    }
+}
+
+// -------------------------------------------------------------
+// Opcodes
+
+#define PEEP(op)   (label_ ## op ## _discard - label_add_discard)
+#define BRANCH(op) (label_ ## op ## _var - label_jump_var)
+
+// Compute the result of one of the PEEPHOLE_STORE operations into eax,
+// without changing any of the interpreter's state. For sshiftr, the
+// clamped shift count (which the interpreter writes back to L2) is left
+// in ecx. Returns 0 if we don't handle the operation.
+static int compute (int kind)
+{
+    git_uint8 * skip;
+
+    switch (kind)
+    {
+        case PEEP(add):    movRR (RAX, REG_L1); insnRR (0, 0x01, REG_L2, RAX); break;
+        case PEEP(sub):    movRR (RAX, REG_L1); insnRR (0, 0x29, REG_L2, RAX); break;
+        case PEEP(mul):    movRR (RAX, REG_L1); insnRR (0, 0x0FAF, RAX, REG_L2); break;
+        case PEEP(neg):    movRR (RAX, REG_L1); insnRR (0, 0xF7, 3, RAX); break;
+        case PEEP(bitnot): movRR (RAX, REG_L1); insnRR (0, 0xF7, 2, RAX); break;
+        case PEEP(bitand): movRR (RAX, REG_L1); insnRR (0, 0x21, REG_L2, RAX); break;
+        case PEEP(bitor):  movRR (RAX, REG_L1); insnRR (0, 0x09, REG_L2, RAX); break;
+        case PEEP(bitxor): movRR (RAX, REG_L1); insnRR (0, 0x31, REG_L2, RAX); break;
+        case PEEP(copys):  insnRR (0, 0x0FB7, RAX, REG_L1); break;
+        case PEEP(copyb):  insnRR (0, 0x0FB6, RAX, REG_L1); break;
+        case PEEP(sexs):   insnRR (0, 0x0FBF, RAX, REG_L1); break;
+        case PEEP(sexb):   insnRR (0, 0x0FBE, RAX, REG_L1); break;
+
+        case PEEP(shiftl):
+        case PEEP(ushiftr):
+            // Shifting by anything outside 0..31 gives zero.
+            movRR (RCX, REG_L2);
+            insnRR (0, 0x31, RAX, RAX);
+            cmpRI (RCX, 31);
+            skip = jcc8 (CC_A);
+            movRR (RAX, REG_L1);
+            insnRR (0, 0xD3, kind == PEEP(shiftl) ? 4 : 5, RAX);
+            patch8 (skip);
+            break;
+
+        case PEEP(sshiftr):
+            // Shifting by anything outside 0..31 is the same as shifting by 31.
+            movRR (RCX, REG_L2);
+            cmpRI (RCX, 31);
+            skip = jcc8 (CC_BE);
+            movRI (RCX, 31);
+            patch8 (skip);
+            movRR (RAX, REG_L1);
+            insnRR (0, 0xD3, 7, RAX);
+            break;
+
+        case PEEP(aload):
+            movRR (RAX, REG_L2);
+            insnRR (0, 0xC1, 4, RAX); byte (2);
+            insnRR (0, 0x01, REG_L1, RAX);
+            cmpRR (RAX, REG_LIMIT32);
+            guard (CC_A);
+            insnRX (0, 0x8B, RAX);
+            bswap (RAX);
+            break;
+
+        case PEEP(aloads):
+            movRR (RAX, REG_L2);
+            insnRR (0, 0xC1, 4, RAX); byte (1);
+            insnRR (0, 0x01, REG_L1, RAX);
+            cmpRR (RAX, REG_LIMIT16);
+            guard (CC_A);
+            insnRX (0, 0x0FB7, RAX);
+            rol16 (RAX);
+            break;
+
+        case PEEP(aloadb):
+            movRR (RAX, REG_L2);
+            insnRR (0, 0x01, REG_L1, RAX);
+            cmpRR (RAX, REG_LIMIT8);
+            guard (CC_A);
+            insnRX (0, 0x0FB6, RAX);
+            break;
+
+        case PEEP(aloadbit):
+            movRR (RAX, REG_L2);
+            insnRR (0, 0xC1, 7, RAX); byte (3);
+            insnRR (0, 0x01, REG_L1, RAX);
+            cmpRR (RAX, REG_LIMIT8);
+            guard (CC_A);
+            insnRX (0, 0x0FB6, RAX);
+            movRR (RCX, REG_L2);
+            insnRR (0, 0x83, 4, RCX); byte (7);
+            insnRR (0, 0xD3, 5, RAX);
+            insnRR (0, 0x83, 4, RAX); byte (1);
+            break;
+
+        default:
+            return 0;
+    }
+    return 1;
+}
+
+// Compute the address for astore, astores or astoreb into eax and check
+// that it can be written to.
+static void arrayAddress (int size)
+{
+    movRR (RAX, REG_L2);
+    if (size == 4)
+    {
+        insnRR (0, 0xC1, 4, RAX); byte (2);
+    }
+    else if (size == 2)
+    {
+        insnRR (0, 0xC1, 4, RAX); byte (1);
+    }
+    insnRR (0, 0x01, REG_L1, RAX);
+    cmpRR (RAX, REG_RAMSTART);
+    guard (CC_B);
+    cmpRR (RAX, limitReg (size));
+    guard (CC_A);
+}
+
+static void arrayStore (int size)
+{
+    if (size == 4)
+    {
+        movRR (RCX, REG_L3);
+        bswap (RCX);
+        insnRX (0, 0x89, RCX);
+    }
+    else if (size == 2)
+    {
+        movRR (RCX, REG_L3);
+        rol16 (RCX);
+        insnRX (O16, 0x89, RCX);
+    }
+    else
+    {
+        insnRX (0, 0x88, REG_L3);
+    }
+
+    // Mark the pages at both ends of the store as dirty.
+    if (size > 1)
+    {
+        movRR (RCX, RAX);
+        insnRR (0, 0x83, 0, RCX); byte (size - 1); // add ecx, size-1
+        insnRR (0, 0xC1, 5, RCX); byte (8);        // shr ecx, 8
+        insnRM (W, 0x03, RCX, REG_STATE, offsetof(NativeState, dirty));
+        insnRM (0, 0xC6, 0, RCX, 0); byte (1);
+    }
+    insnRR (0, 0xC1, 5, RAX); byte (8);            // shr eax, 8
+    insnRM (W, 0x03, RAX, REG_STATE, offsetof(NativeState, dirty));
+    insnRM (0, 0xC6, 0, RAX, 0); byte (1);
+}
+
+// astore, astores or astoreb with L3 loaded first. The address is
+// checked before L3 is loaded, so that a bad address doesn't pop
+// anything off the stack.
+static int arrayStoreL3 (Block p, int size, int mode)
+{
+    git_uint32 v = (mode == MODE_STACK) ? 0 : p[1];
+    if (!canLoad (mode, v))
+        return 0;
+    arrayAddress (size);
+    guardPops (mode == MODE_STACK);
+    guardRead (mode, v, 4);
+    load (REG_L3, mode, v, 4);
+    arrayStore (size);
+    return (mode == MODE_STACK) ? 1 : 2;
+}
+
+// Translate the opcode at sCode[sOpIndex]. Returns the number of words
+// it takes up, or 0 if we can't translate it.
+static int translateOp (Label op, int isFirst)
+{
+    Block p = sCode + sOpIndex;
+    int i;
+
+    // Register loads: L1..L3 from const, stack, local or addr,
+    // and the double loads of L1 and L2.
+
+    i = op - label_L1_const;
+    if (i >= 0 && op <= label_L1_addr_L2_addr)
+    {
+        int stride = label_L1_const_L2_stack - label_L1_const_L2_const;
+        int mode2 = i / stride;
+        int which = i % stride;
+
+        if (which < 3)
+        {
+            int reg = REG_L1 + which;
+            git_uint32 v = (mode2 == MODE_STACK) ? 0 : p[1];
+            if (!canLoad (mode2, v))
+                return 0;
+            guardPops (mode2 == MODE_STACK);
+            guardRead (mode2, v, 4);
+            load (reg, mode2, v, 4);
+            return (mode2 == MODE_STACK) ? 1 : 2;
+        }
+        else if (which >= label_L1_const_L2_const - label_L1_const)
+        {
+            int mode1 = which - (label_L1_const_L2_const - label_L1_const);
+            int len = 1;
+            git_uint32 v1 = 0, v2 = 0;
+
+            if (mode1 != MODE_STACK)
+                v1 = p[len++];
+            if (mode2 != MODE_STACK)
+                v2 = p[len++];
+            if (!canLoad (mode1, v1) || !canLoad (mode2, v2))
+                return 0;
+
+            guardPops ((mode1 == MODE_STACK) + (mode2 == MODE_STACK));
+            guardRead (mode1, v1, 4);
+            guardRead (mode2, v2, 4);
+            load (REG_L1, mode1, v1, 4);
+            load (REG_L2, mode2, v2, 4);
+            return len;
+        }
+        return 0; // L4..L7
+    }
+
+    // Register stores: S1 and S2 to stack, local or addr.
+
+    i = op - label_S1_stack;
+    if (i >= 0 && op <= label_S2_addr)
+    {
+        int mode = MODE_STACK + i / 2;
+        int reg = REG_L1 + i % 2;
+        git_uint32 v = (mode == MODE_STACK) ? 0 : p[1];
+        if (!canLoad (mode, v))
+            return 0;
+        guardWrite (mode, v, 4);
+        store (reg, mode, v, 4);
+        return (mode == MODE_STACK) ? 1 : 2;
+    }
+
+    switch (op)
+    {
+        case label_nop:
+            return 1;
+
+        case label_L1_addr16:
+        case label_L1_addr8:
+        {
+            int size = (op == label_L1_addr16) ? 2 : 1;
+            if (!canLoad (MODE_ADDR, p[1]))
+                return 0;
+            guardRead (MODE_ADDR, p[1], size);
+            load (REG_L1, MODE_ADDR, p[1], size);
+            return 2;
+        }
+
+        case label_S1_addr16:
+        case label_S1_addr8:
+        {
+            int size = (op == label_S1_addr16) ? 2 : 1;
+            if (!canLoad (MODE_ADDR, p[1]))
+                return 0;
+            guardWrite (MODE_ADDR, p[1], size);
+            store (REG_L1, MODE_ADDR, p[1], size);
+            return 2;
+        }
+
+        case label_astore:  arrayAddress (4); arrayStore (4); return 1;
+        case label_astores: arrayAddress (2); arrayStore (2); return 1;
+        case label_astoreb: arrayAddress (1); arrayStore (1); return 1;
+
+        case label_astore_L3_const:  return arrayStoreL3 (p, 4, MODE_CONST);
+        case label_astore_L3_stack:  return arrayStoreL3 (p, 4, MODE_STACK);
+        case label_astore_L3_local:  return arrayStoreL3 (p, 4, MODE_LOCAL);
+        case label_astore_L3_addr:   return arrayStoreL3 (p, 4, MODE_ADDR);
+        case label_astores_L3_const: return arrayStoreL3 (p, 2, MODE_CONST);
+        case label_astores_L3_stack: return arrayStoreL3 (p, 2, MODE_STACK);
+        case label_astores_L3_local: return arrayStoreL3 (p, 2, MODE_LOCAL);
+        case label_astores_L3_addr:  return arrayStoreL3 (p, 2, MODE_ADDR);
+        case label_astoreb_L3_const: return arrayStoreL3 (p, 1, MODE_CONST);
+        case label_astoreb_L3_stack: return arrayStoreL3 (p, 1, MODE_STACK);
+        case label_astoreb_L3_local: return arrayStoreL3 (p, 1, MODE_LOCAL);
+        case label_astoreb_L3_addr:  return arrayStoreL3 (p, 1, MODE_ADDR);
+
+        default:
+            break;
+    }
+
+    // Arithmetic, with the result going to S1 and then somewhere else.
+
+    i = op - label_add_discard;
+    if (i >= 0 && op <= label_fdiv_S1_addr)
+    {
+        int stride = label_add_S1_stack - label_add_discard;
+        int kind = i % stride;
+        int mode = i / stride; // 0 = discard, then stack, local, addr.
+        git_uint32 v = (mode >= 2) ? p[1] : 0;
+
+        if (mode != 0 && !canLoad (mode, v))
+            return 0;
+        if (!compute (kind))
+            return 0;
+        if (mode != 0)
+            guardWrite (mode, v, 4);
+
+        // Nothing can go wrong from here on.
+        movRR (REG_L1, RAX);
+        if (kind == PEEP(sshiftr))
+            movRR (REG_L2, RCX);
+        if (mode != 0)
+            store (REG_L1, mode, v, 4);
+        return (mode >= 2) ? 2 : 1;
+    }
+
+    // Integer branches.
+
+    i = op - label_jump_var;
+    if (i >= 0 && op <= label_jdne_return1)
+    {
+        int stride = label_jump_const - label_jump_var;
+        int kind = i % stride;
+        int form = op - kind; // label_jump_var, label_jump_const, ...
+        int cc;
+
+        switch (kind)
+        {
+            case BRANCH(jump): cc = -1; break;
+            case BRANCH(jz):   cc = CC_E;  insnRR (0, 0x85, REG_L1, REG_L1); break;
+            case BRANCH(jnz):  cc = CC_NE; insnRR (0, 0x85, REG_L1, REG_L1); break;
+            case BRANCH(jeq):  cc = CC_E;  cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jne):  cc = CC_NE; cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jlt):  cc = CC_L;  cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jge):  cc = CC_GE; cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jgt):  cc = CC_G;  cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jle):  cc = CC_LE; cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jltu): cc = CC_B;  cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jgeu): cc = CC_AE; cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jgtu): cc = CC_A;  cmpRR (REG_L1, REG_L2); break;
+            case BRANCH(jleu): cc = CC_BE; cmpRR (REG_L1, REG_L2); break;
+            default: return 0;
+        }
+
+        if (form == label_jump_by)
+        {
+            // A jump within the block. L7 = offset; pc += L7.
+            long target = sOpIndex + 2 + (git_sint32) p[1];
+            addFixup (cc < 0 ? jmp32 () : jcc32 (cc), target, 1);
+            return 2;
+        }
+
+        // Anything else leaves the block, so we let the
+        // interpreter take the branch if it's going to happen.
+        if (cc < 0 || isFirst)
+            return 0;
+        guard (cc);
+        return (form == label_jump_var || form == label_jump_const) ? 2 : 1;
+    }
+
+    return 0;
+}
+
+// -------------------------------------------------------------
+// Traces
+
+static Label decode (git_uint32 word)
+{
+#if defined(USE_DIRECT_THREADING) || defined(USE_DISPATCH_SELECT)
+    git_uint32 slot = (word * 2654435761U) >> 22;
+# ifdef USE_DISPATCH_SELECT
+    if (gDispatch == DISPATCH_SWITCH)
+        return (word < MAX_LABEL) ? (Label) word : MAX_LABEL;
+# endif
+    while (sLabelWords[slot] != 0)
+    {
+        if (sLabelWords[slot] == word)
+            return sLabelValues[slot];
+        slot = (slot + 1) & (LABEL_HASH - 1);
+    }
+    return MAX_LABEL;
+#else
+    return (word < MAX_LABEL) ? (Label) word : MAX_LABEL;
+#endif
+}
+
+// Translate the code starting at the given word of the block.
+// Returns NULL if it's not worth it, or we ran out of space.
+static NativeFn translateTrace (long start)
+{
+    git_uint8 * fn;
+    long pos;
+    int numOps = 0;
+    int i;
+
+    memset (sOpAddr, 0, sCodeWords * sizeof(git_uint8*));
+    memset (sStubAddr, 0, sCodeWords * sizeof(git_uint8*));
+    sNumFixups = 0;
+
+    // The shared exit path comes first, so that every
+    // exit can jump straight back to it.
+
+    if (sArenaEnd - sOut < OP_SPACE)
+    {
+        sFailed = 1;
+        return NULL;
+    }
+
+    sEpilogue = sOut;
+    insnRM (0, 0x89, REG_L1, REG_STATE, offsetof(NativeState, L1));
+    insnRM (0, 0x89, REG_L2, REG_STATE, offsetof(NativeState, L2));
+    insnRM (0, 0x89, REG_L3, REG_STATE, offsetof(NativeState, L3));
+    insnRM (W, 0x89, REG_SP, REG_STATE, offsetof(NativeState, sp));
+    pop (R15); pop (R14); pop (R13); pop (R12); pop (RBP); pop (RBX);
+    byte (0xC3); // ret
+
+    fn = sOut;
+    push (RBX); push (RBP); push (R12); push (R13); push (R14); push (R15);
+    insnRM (0, 0x8B, REG_L1, REG_STATE, offsetof(NativeState, L1));
+    insnRM (0, 0x8B, REG_L2, REG_STATE, offsetof(NativeState, L2));
+    insnRM (0, 0x8B, REG_L3, REG_STATE, offsetof(NativeState, L3));
+    insnRM (W, 0x8B, REG_SP, REG_STATE, offsetof(NativeState, sp));
+    insnRM (W, 0x8B, REG_LOCALS, REG_STATE, offsetof(NativeState, locals));
+    insnRM (W, 0x8B, REG_VALUES, REG_STATE, offsetof(NativeState, values));
+    insnRM (W, 0x8B, REG_TOP, REG_STATE, offsetof(NativeState, top));
+    insnRM (W, 0x8B, REG_MEM, REG_STATE, offsetof(NativeState, mem));
+    insnRM (0, 0x8B, REG_LIMIT32, REG_STATE, offsetof(NativeState, limit32));
+    insnRM (0, 0x8B, REG_RAMSTART, REG_STATE, offsetof(NativeState, ramStart));
+    insnRM (0, 0x8B, REG_LIMIT16, REG_STATE, offsetof(NativeState, limit16));
+    insnRM (0, 0x8B, REG_LIMIT8, REG_STATE, offsetof(NativeState, limit8));
+
+    // Translate opcodes until we hit one we can't handle.
+
+    for (pos = start ; pos < (long) sCodeWords ; )
+    {
+        int len;
+        git_uint8 * opStart = sOut;
+
+        if (sArenaEnd - sOut < OP_SPACE)
+        {
+            sFailed = 1;
+            return NULL;
+        }
+
+        sOpIndex = pos;
+        len = translateOp (decode (sCode[pos]), numOps == 0);
+        if (len == 0 || pos + len > (long) sCodeWords)
+        {
+            sOut = opStart;
+            break;
+        }
+
+        sOpAddr[pos] = opStart;
+        pos += len;
+        ++numOps;
+    }
+
+    // Drop any fixups belonging to an opcode we gave up on.
+    for (i = 0 ; i < sNumFixups ; )
+    {
+        if (sFixups[i].rel >= sOut)
+            sFixups[i] = sFixups[--sNumFixups];
+        else
+            ++i;
+    }
+
+    if (numOps < MIN_TRACE_OPS || sFailed)
+        return NULL;
+
+    // Fall off the end: carry on in the interpreter.
+    emitExit (pos);
+
+    // Point all the jumps at their destinations.
+
+    for (i = 0 ; i < sNumFixups ; ++i)
+    {
+        Fixup * f = sFixups + i;
+        int inBlock = (f->target >= 0 && f->target < (long) sCodeWords);
+
+        if (f->canJump && inBlock && sOpAddr[f->target] != NULL)
+        {
+            patch32 (f->rel, sOpAddr[f->target]);
+        }
+        else if (inBlock && sStubAddr[f->target] != NULL)
+        {
+            patch32 (f->rel, sStubAddr[f->target]);
+        }
+        else
+        {
+            if (sArenaEnd - sOut < STUB_SPACE)
+            {
+                sFailed = 1;
+                return NULL;
+            }
+            if (inBlock)
+                sStubAddr[f->target] = sOut;
+            patch32 (f->rel, sOut);
+            emitExit (f->target);
+        }
+    }
+
+    return (NativeFn) fn;
+}
+
+// -------------------------------------------------------------
+// Managing the arena
+
+static void initNative ()
+{
+    void * arena;
+
+#if defined(USE_DIRECT_THREADING) || defined(USE_DISPATCH_SELECT)
+    int l;
+    memset (sLabelWords, 0, sizeof(sLabelWords));
+    for (l = 0 ; l < MAX_LABEL ; ++l)
+    {
+        git_uint32 word = (git_uint32) labelToOpcode (l);
+        git_uint32 slot = (word * 2654435761U) >> 22;
+        while (sLabelWords[slot] != 0 && sLabelWords[slot] != word)
+            slot = (slot + 1) & (LABEL_HASH - 1);
+        if (sLabelWords[slot] == 0)
+        {
+            sLabelWords[slot] = word;
+            sLabelValues[slot] = (Label) l;
+        }
+    }
+#endif
+
+    sNativeWord = (git_uint32) labelToOpcode (label_native);
+
+    arena = mmap (NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+    {
+        sReady = -1;
+        return;
+    }
+
+    sArena = sArenaTop = arena;
+    sArenaEnd = sArena + ARENA_SIZE;
+    sNumEntries = 0;
+    memset (sEntryHash, 0, sizeof(sEntryHash));
+    sReady = 1;
+}
+
+static NativeEntry * findEntry (Block entry)
+{
+    NativeEntry * e = sEntryHash [((uintptr_t) entry >> 2) & (ENTRY_HASH - 1)];
+    while (e != NULL && e->entry != entry)
+        e = e->next;
+    if (e == NULL)
+        fatalError ("Lost track of native code (BUG)");
+    return e;
+}
+
+void nativeFlush ()
+{
+    int i;
+
+    if (sReady <= 0 || (sNumEntries == 0 && sArenaTop == sArena))
+        return;
+
+    for (i = 0 ; i < sNumEntries ; ++i)
+    {
+        if (*sEntries[i].entry == sNativeWord)
+            *sEntries[i].entry = sEntries[i].word;
+    }
+
+    sNumEntries = 0;
+    memset (sEntryHash, 0, sizeof(sEntryHash));
+    sArenaTop = sArena;
+    ++sStats.flushes;
+}
+
+void nativeShutdown ()
+{
+    if (sReady > 0)
+    {
+        nativeFlush ();
+        munmap (sArena, ARENA_SIZE);
+    }
+    free (sFixups);
+    sFixups = NULL;
+    sNumFixups = sMaxFixups = 0;
+    sArena = sArenaTop = sArenaEnd = NULL;
+    sReady = 0;
+}
+
+// Translate every entry point of the block. Returns 0 if we
+// ran out of room in the arena or the entry table.
+static int translateBlock (BlockHeader * header)
+{
+    HashNode * end = (HashNode*) (((git_uint32*) header) + header->compiledSize);
+    HashNode * nodes = end - header->numHashNodes;
+    NativeFn fns [64];
+    Block entries [64];
+    int numTraces = 0;
+    int i;
+
+    sCode = (Block) (header + 1);
+    sCodeWords = (git_uint32*) nodes - sCode;
+    sOut = sArenaTop;
+    sFailed = 0;
+
+    sOpAddr = malloc (sCodeWords * sizeof(git_uint8*));
+    sStubAddr = malloc (sCodeWords * sizeof(git_uint8*));
+    if (sOpAddr == NULL || sStubAddr == NULL)
+    {
+        free (sOpAddr);
+        free (sStubAddr);
+        return 1;
+    }
+
+    // Translate everything before patching anything, so
+    // that every trace sees the block's original labels.
+
+    for (i = 0 ; i < header->numHashNodes && numTraces < 64 ; ++i)
+    {
+        Block entry = ((git_uint32*) (nodes + i)) + nodes[i].codeOffset;
+        git_uint8 * start = sOut;
+        NativeFn fn;
+
+        if (entry < sCode || entry >= sCode + sCodeWords || *entry == sNativeWord)
+            continue;
+        if (sNumEntries + numTraces >= MAX_ENTRIES)
+            break;
+
+        fn = translateTrace (entry - sCode);
+        if (fn == NULL)
+        {
+            sOut = start;
+            if (sFailed)
+                break;
+            continue;
+        }
+
+        fns [numTraces] = fn;
+        entries [numTraces] = entry;
+        ++numTraces;
+    }
+
+    free (sOpAddr);
+    free (sStubAddr);
+    sOpAddr = sStubAddr = NULL;
+
+    if (sFailed || sNumEntries + numTraces >= MAX_ENTRIES)
+    {
+        // We're out of room. Throw this block's traces away and tell
+        // the caller, who'll flush everything and try again.
+        sOut = sArenaTop;
+        return 0;
+    }
+
+    sArenaTop = sOut;
+
+    for (i = 0 ; i < numTraces ; ++i)
+    {
+        NativeEntry * e;
+        git_uint32 slot;
+
+        if (*entries[i] == sNativeWord)
+            continue;
+
+        e = sEntries + sNumEntries++;
+        slot = ((uintptr_t) entries[i] >> 2) & (ENTRY_HASH - 1);
+        e->entry = entries[i];
+        e->word = *entries[i];
+        e->label = decode (e->word);
+        e->fn = fns[i];
+        e->next = sEntryHash[slot];
+        sEntryHash[slot] = e;
+
+        *entries[i] = sNativeWord;
+        ++sStats.traces;
+    }
+
+    return 1;
+}
+
+void nativeCompileBlock (BlockHeader * header)
+{
+    if (sReady == 0)
+        initNative ();
+    if (sReady < 0)
+        return;
+
+    // Don't bother with blocks that are about to be thrown away, or
+    // with the dummy header that's current before anything's compiled.
+    if (header->glulxSize == 0 || header->compiledSize * sizeof(git_uint32)
+            <= sizeof(BlockHeader) + header->numHashNodes * sizeof(HashNode))
+        return;
+
+    // Keep the arena writable only while we're writing to it.
+
+    if (mprotect (sArena, ARENA_SIZE, PROT_READ | PROT_WRITE) != 0)
+        goto give_up;
+
+    if (!translateBlock (header))
+    {
+        nativeFlush ();
+        translateBlock (header);
+    }
+
+    if (mprotect (sArena, ARENA_SIZE, PROT_READ | PROT_EXEC) != 0)
+        goto give_up;
+
+    return;
+
+give_up:
+    // The system won't let us run generated code, so we'll
+    // stick with the interpreter from now on.
+    nativeShutdown ();
+    sReady = -1;
+}
+
+Block nativeRun (Block entry, NativeState * state)
+{
+    NativeEntry * e = findEntry (entry);
+
+    state->mem = gMem;
+    state->dirty = gDirtyPages;
+    state->ramStart = gRamStart;
+    state->limit32 = gEndMem - 4;
+    state->limit16 = gEndMem - 2;
+    state->limit8 = gEndMem - 1;
+
+    return e->fn (state);
+}
+
+Label nativeOriginalLabel (Block entry)
+{
+    return findEntry (entry)->label;
+}
+
+void getNativeStats (NativeStats * stats)
+{
+    *stats = sStats;
+}
+
+#endif // USE_NATIVE_CODE
@@ -133,3 +133,114 @@ noPeephole:
 done:
     sLastOp = op;
 }
+
+// -------------------------------------------------------------
+// Profiling
+
+#ifdef USE_OPCODE_PROFILE
+
+// We count every opcode, plus every pair or triple of opcodes
+// where all but the last are loads. Those are the sequences
+// that superops.py picks superinstructions from.
+
+#define NGRAM_HASH 65536 // Slots in the n-gram table (power of two).
+
+typedef struct NGram
+{
+    Label a, b, c; // 'c' is MAX_LABEL for a pair.
+    uint64_t count;
+}
+NGram;
+
+static uint64_t sOpCounts [MAX_LABEL];
+static uint64_t sTotalOps;
+static NGram *  sNGrams;
+static git_uint32 sNumNGrams;
+static Label    sPrev1 = MAX_LABEL;
+static Label    sPrev2 = MAX_LABEL;
+
+// Loads always carry straight on to the next opcode in the
+// same instruction, which is what makes them worth fusing.
+static int isLoad (Label op)
+{
+    return (op >= label_L1_const && op <= label_L1_addr_L2_addr)
+        || op == label_L1_addr16 || op == label_L1_addr8;
+}
+
+static void countNGram (Label a, Label b, Label c)
+{
+    git_uint32 slot = ((a * 31 + b) * 31 + c) & (NGRAM_HASH - 1);
+
+    if (sNGrams == NULL)
+    {
+        sNGrams = calloc (NGRAM_HASH, sizeof(NGram));
+        if (sNGrams == NULL)
+            fatalError ("Couldn't allocate opcode profile");
+    }
+
+    while (sNGrams [slot].count != 0)
+    {
+        NGram * n = sNGrams + slot;
+        if (n->a == a && n->b == b && n->c == c)
+        {
+            ++n->count;
+            return;
+        }
+        slot = (slot + 1) & (NGRAM_HASH - 1);
+    }
+
+    // Leave some slack, so that lookups stay fast.
+    // Anything we miss now is going to be rare anyway.
+    if (sNumNGrams >= NGRAM_HASH / 4 * 3)
+        return;
+
+    sNGrams [slot].a = a;
+    sNGrams [slot].b = b;
+    sNGrams [slot].c = c;
+    sNGrams [slot].count = 1;
+    ++sNumNGrams;
+}
+
+extern void profileOpcode (Label op)
+{
+    ++sOpCounts [op];
+    ++sTotalOps;
+
+    if (isLoad (sPrev1))
+    {
+        countNGram (sPrev1, op, MAX_LABEL);
+        if (isLoad (sPrev2))
+            countNGram (sPrev2, sPrev1, op);
+    }
+
+    sPrev2 = sPrev1;
+    sPrev1 = op;
+}
+
+extern void writeOpcodeProfile (FILE * f)
+{
+    git_uint32 i;
+
+    fprintf (f, "total %llu\n", (unsigned long long) sTotalOps);
+
+    for (i = 0 ; i < MAX_LABEL ; ++i)
+    {
+        if (sOpCounts [i] != 0)
+            fprintf (f, "op %llu %s\n", (unsigned long long) sOpCounts [i], gLabelNames [i]);
+    }
+
+    for (i = 0 ; sNGrams != NULL && i < NGRAM_HASH ; ++i)
+    {
+        NGram * n = sNGrams + i;
+        if (n->count == 0)
+            continue;
+        if (n->c == MAX_LABEL)
+            fprintf (f, "pair %llu %s %s\n", (unsigned long long) n->count,
+                gLabelNames [n->a], gLabelNames [n->b]);
+        else
+            fprintf (f, "triple %llu %s %s %s\n", (unsigned long long) n->count,
+                gLabelNames [n->a], gLabelNames [n->b], gLabelNames [n->c]);
+    }
+}
+
+#endif // USE_OPCODE_PROFILE
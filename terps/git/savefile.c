@@ -1,21 +1,223 @@
 // $Id: savefile.c,v 1.6 2003/10/20 16:05:06 iain Exp $
 
 #include "git.h"
+#include <string.h>
 
-static void writeWord (git_sint32 word)
+// Save files are built up in memory and written out with a single
+// call, and each chunk is read back in one go when restoring. Going
+// through Glk a byte or a word at a time is far slower than the work
+// of actually compressing the memory.
+
+typedef struct SaveBuffer
 {
-    git_uint8 buffer [4];
-    write32 (buffer, word);
-    glk_put_buffer ((char *) buffer, 4);
+    git_uint8 * data;
+    git_uint32  used;
+    git_uint32  size;
+}
+SaveBuffer;
+
+static void reserveBytes (SaveBuffer * buf, git_uint32 n)
+{
+    if (buf->used + n > buf->size)
+    {
+        git_uint32 size = buf->size ? buf->size : 1024;
+        while (size < buf->used + n)
+            size *= 2;
+
+        buf->data = realloc (buf->data, size);
+        if (buf->data == NULL)
+            fatalError ("Couldn't allocate memory for save file");
+        buf->size = size;
+    }
+}
+
+static void putBytes (SaveBuffer * buf, const void * data, git_uint32 n)
+{
+    reserveBytes (buf, n);
+    memcpy (buf->data + buf->used, data, n);
+    buf->used += n;
+}
+
+static void putWord (SaveBuffer * buf, git_uint32 word)
+{
+    reserveBytes (buf, 4);
+    write32 (buf->data + buf->used, word);
+    buf->used += 4;
+}
+
+static void putWords (SaveBuffer * buf, const git_uint32 * words, git_uint32 n)
+{
+    git_uint8 * out;
+
+    reserveBytes (buf, n * 4);
+    out = buf->data + buf->used;
+    buf->used += n * 4;
+
+    for ( ; n > 0 ; --n, ++words, out += 4)
+        write32 (out, *words);
+}
+
+static void putTag (SaveBuffer * buf, const char * tag)
+{
+    putBytes (buf, tag, 4);
 }
 
 static git_uint32 readWord (strid_t file)
 {
     git_uint8 buffer [4];
-    glk_get_buffer_stream (file, (char *) buffer, 4);
+    if (glk_get_buffer_stream (file, (char *) buffer, 4) != 4)
+        return 0;
     return (git_uint32) read32 (buffer);
 }
 
+// Reads a whole chunk into a new buffer, or returns NULL if the
+// file is too short (or the size is nonsense). The caller must free it.
+static git_uint8 * readChunk (strid_t file, git_uint32 size)
+{
+    git_uint8 * data = malloc (size ? size : 1);
+    if (data == NULL)
+        return NULL;
+
+    if (glk_get_buffer_stream (file, (char *) data, size) != size)
+    {
+        free (data);
+        return NULL;
+    }
+    return data;
+}
+
+// -------------------------------------------------------------
+// Compressed memory
+//
+// The CMem chunk holds RAM XORed with its original contents (from
+// the game file up to gExtStart, zero after that). Each non-zero byte
+// is written as it is; a run of n zero bytes (1 <= n <= 256) is
+// written as a zero followed by n-1. Most of RAM is usually unchanged,
+// so we look for the runs a word at a time.
+
+typedef uint64_t ScanWord;
+
+// Counts how many bytes from 'addr' onward, stopping at 'end', are the
+// same as they were in the game file (or zero, past gExtStart).
+static git_uint32 unchangedBytes (git_uint32 addr, git_uint32 end)
+{
+    git_uint32 start = addr;
+    ScanWord a, b;
+
+    if (addr < gExtStart)
+    {
+        git_uint32 romEnd = (end < gExtStart) ? end : gExtStart;
+        for ( ; addr + sizeof(ScanWord) <= romEnd ; addr += sizeof(ScanWord))
+        {
+            memcpy (&a, gMem + addr, sizeof(ScanWord));
+            memcpy (&b, gInitMem + addr, sizeof(ScanWord));
+            if (a != b)
+                break;
+        }
+        while (addr < romEnd && gMem [addr] == gInitMem [addr])
+            ++addr;
+        if (addr < romEnd)
+            return addr - start;
+    }
+
+    for ( ; addr + sizeof(ScanWord) <= end ; addr += sizeof(ScanWord))
+    {
+        memcpy (&a, gMem + addr, sizeof(ScanWord));
+        if (a != 0)
+            break;
+    }
+    while (addr < end && gMem [addr] == 0)
+        ++addr;
+
+    return addr - start;
+}
+
+static void compressMemory (SaveBuffer * buf)
+{
+    git_uint32 n = gRamStart;
+
+    while (n < gEndMem)
+    {
+        git_uint32 zeroCount = unchangedBytes (n, gEndMem);
+
+        n += zeroCount;
+        if (n == gEndMem)
+        {
+            // We don't bother writing out any remaining zeroes,
+            // because the memory is padded out with zeroes on restore.
+            break;
+        }
+
+        reserveBytes (buf, (zeroCount / 256 + 1) * 2);
+        for ( ; zeroCount > 256 ; zeroCount -= 256)
+        {
+            buf->data [buf->used++] = 0;
+            buf->data [buf->used++] = 0xff;
+        }
+        if (zeroCount > 0)
+        {
+            buf->data [buf->used++] = 0;
+            buf->data [buf->used++] = (git_uint8) (zeroCount - 1);
+        }
+
+        // Copy out changed bytes until we reach an unchanged one.
+        for ( ; n < gEndMem ; ++n)
+        {
+            git_uint8 c = gMem [n] ^ ((n < gExtStart) ? gInitMem [n] : 0);
+            if (c == 0)
+                break;
+            reserveBytes (buf, 1);
+            buf->data [buf->used++] = c;
+        }
+    }
+}
+
+// Puts back the original contents of 'count' bytes of RAM.
+static void resetBytes (git_uint32 addr, git_uint32 count)
+{
+    if (addr < gExtStart)
+    {
+        git_uint32 n = (count < gExtStart - addr) ? count : gExtStart - addr;
+        memcpy (gMem + addr, gInitMem + addr, n);
+        addr += n;
+        count -= n;
+    }
+    memset (gMem + addr, 0, count);
+}
+
+// Undoes compressMemory(). Returns nonzero if the data doesn't fit.
+static int decompressMemory (const git_uint8 * data, git_uint32 size)
+{
+    const git_uint8 * end = data + size;
+    git_uint32 i = gRamStart;
+
+    while (data < end)
+    {
+        git_uint8 c = *data++;
+
+        if (c != 0)
+        {
+            if (i >= gEndMem)
+                return 1;
+            gMem [i] = c ^ ((i < gExtStart) ? gInitMem [i] : 0);
+            ++i;
+        }
+        else
+        {
+            git_uint32 count = 1;
+            if (data < end)
+                count += *data++;
+            if (count > gEndMem - i)
+                return 1;
+            resetBytes (i, count);
+            i += count;
+        }
+    }
+
+    resetBytes (i, gEndMem - i);
+    return 0;
+}
+
 static int sort_heap_summary(const void *p1, const void *p2)
 {
     glui32 v1 = *((const glui32 *)p1);
@@ -64,6 +266,8 @@ git_sint32 restoreFromFile (git_sint32 * base, git_sint32 id,
     while (glk_stream_get_position(file) < fileStart + fileSize)
     {
         git_uint32 chunkType, chunkSize;
+        git_uint8 * chunk;
+
         chunkType = readWord (file);
         chunkSize = readWord (file);
 
@@ -77,12 +281,14 @@ git_sint32 restoreFromFile (git_sint32 * base, git_sint32 id,
             if (chunkSize != 128)
                 return 1;
 
-            for (i = 0 ; i < 128 ; ++i)
-            {
-                glui32 c = glk_get_char_stream (file);
-                if (gInitMem [i] != c)
-                    return 1;
-            }
+            chunk = readChunk (file, 128);
+            if (chunk == NULL)
+                return 1;
+
+            i = memcmp (chunk, gInitMem, 128);
+            free (chunk);
+            if (i != 0)
+                return 1;
         }
         else if (chunkType == readtag("Stks"))
         {
@@ -94,66 +300,61 @@ git_sint32 restoreFromFile (git_sint32 * base, git_sint32 id,
             if (chunkSize & 3)
                 return 1;
 
+            chunk = readChunk (file, chunkSize);
+            if (chunk == NULL)
+                return 1;
+
             gStackPointer = base;
-            for ( ; chunkSize > 0 ; chunkSize -= 4)
-                *gStackPointer++ = readWord(file);
+            for (i = 0 ; i < chunkSize ; i += 4)
+                *gStackPointer++ = read32 (chunk + i);
+            free (chunk);
         }
         else if (chunkType == readtag("CMem"))
         {
-            git_uint32 bytesRead = 0;
+            git_uint8 * saved = NULL;
+            git_uint32 savedStart, savedEnd;
+            int bad;
+
             if (gotMemory)
                 return 1;
 
             gotMemory = 1;
 
-            if (resizeMemory (readWord(file), 1))
+            if (chunkSize < 4)
+                return 1;
+
+            chunk = readChunk (file, chunkSize);
+            if (chunk == NULL)
+                return 1;
+
+            if (resizeMemory (read32 (chunk), 1))
                 fatalError ("Can't resize memory map");
 
-            bytesRead = 4;
-            i = gRamStart;
-            while (i < gExtStart && bytesRead < chunkSize)
+            // Keep a copy of the protected range, so we can put it
+            // back after everything else has been overwritten.
+
+            savedStart = (protectPos > gRamStart) ? protectPos : gRamStart;
+            savedEnd = (protectEnd < gEndMem) ? protectEnd : gEndMem;
+            if (protectSize > 0 && savedStart < savedEnd)
             {
-                int mult = 0;
-                char c = (char) glk_get_char_stream(file);
-                ++bytesRead;
-                
-                if (c == 0)
-                {
-                    mult = (unsigned char) glk_get_char_stream(file);
-                    ++bytesRead;
-                }
-                
-                for (++mult ; mult > 0 ; --mult, ++i)
-                    if (i >= protectEnd || i < protectPos)
-                        gMem [i] = gInitMem [i] ^ c;
+                saved = malloc (savedEnd - savedStart);
+                if (saved == NULL)
+                    fatalError ("Couldn't allocate memory for save file");
+                memcpy (saved, gMem + savedStart, savedEnd - savedStart);
             }
 
-            while (i < gEndMem && bytesRead < chunkSize)
+            bad = decompressMemory (chunk + 4, chunkSize - 4);
+            free (chunk);
+
+            if (saved != NULL)
             {
-                int mult = 0;
-                char c = (char) glk_get_char_stream(file);
-                ++bytesRead;
-                
-                if (c == 0)
-                {
-                    mult = (unsigned char) glk_get_char_stream(file);
-                    ++bytesRead;
-                }
-                
-                for (++mult ; mult > 0 ; --mult, ++i)
-                    if (i >= protectEnd || i < protectPos)
-                        gMem [i] = c;
+                memcpy (gMem + savedStart, saved, savedEnd - savedStart);
+                free (saved);
             }
 
-            while (i < gExtStart)
-                if (i >= protectEnd || i < protectPos)
-                    gMem [i] = gInitMem [i], ++i;
+            markMemoryDirty (gRamStart, gEndMem - gRamStart);
 
-            while (i < gEndMem)
-                if (i >= protectEnd || i < protectPos)
-                    gMem [i] = 0, ++i;
-
-            if (bytesRead != chunkSize)
+            if (bad)
                 return 1; // Too much data!
 
             if (chunkSize & 1)
@@ -174,10 +375,13 @@ git_sint32 restoreFromFile (git_sint32 * base, git_sint32 id,
 
             if (chunkSize > 0)
             {
-                heap = malloc (chunkSize);
+                heap = (glui32 *) readChunk (file, chunkSize);
+                if (heap == NULL)
+                    return 1;
+
                 heapSize = chunkSize / 4;
                 for (i = 0 ; i < heapSize ; ++i)
-                    heap[i] = readWord(file);
+                    heap[i] = read32 (heap + i);
 
                 /* The summary might have come from any interpreter, so it could
                   be out of order. We'll sort it. */
@@ -213,13 +417,12 @@ git_sint32 restoreFromFile (git_sint32 * base, git_sint32 id,
 
 git_sint32 saveToFile (git_sint32 * base, git_sint32 * sp, git_sint32 id)
 {
-    git_uint32 n, zeroCount;
-    glui32 fileSize, fileSizePos;
-    glui32 memSize, memSizePos;
+    SaveBuffer buf = { NULL, 0, 0 };
+    git_uint32 memSizePos;
     glui32 heapSize;
     glui32* heap;
 
-    strid_t file, oldFile;
+    strid_t file;
 
     // Find out what stream they want to use, and make sure it's valid.
     file = git_find_stream_by_id (id);
@@ -230,87 +433,46 @@ git_sint32 saveToFile (git_sint32 * base, git_sint32 * sp, git_sint32 id)
     if (heap_get_summary (&heapSize, &heap))
         fatalError ("Couldn't get heap summary");
 
-    // Make the given stream the default.
-    oldFile = glk_stream_get_current ();
-    glk_stream_set_current (file);
-
-    // Write Quetzal header.
-    glk_put_string ("FORM");
-
-    fileSizePos = glk_stream_get_position (file);
-    writeWord (0);
-
-    glk_put_string ("IFZS");
+    // Quetzal header. The file size is filled in at the end.
+    putTag (&buf, "FORM");
+    putWord (&buf, 0);
+    putTag (&buf, "IFZS");
 
     // Header chunk.
-    glk_put_string ("IFhd");
-    writeWord (128);
-    glk_put_buffer ((char *) gInitMem, 128);
+    putTag (&buf, "IFhd");
+    putWord (&buf, 128);
+    putBytes (&buf, gInitMem, 128);
 
     // Stack chunk.
-    glk_put_string ("Stks");
-    writeWord ((sp - base) * 4);
-    for (n = 0 ; n < (git_uint32) (sp - base) ; ++n)
-        writeWord (base [n]);
+    putTag (&buf, "Stks");
+    putWord (&buf, (sp - base) * 4);
+    putWords (&buf, (const git_uint32 *) base, sp - base);
 
     // Heap chunk.
     if (heap != 0)
     {
-        glk_put_string ("MAll");
-        writeWord (heapSize * 4);
-        for (n = 0 ; n < heapSize ; ++n)
-            writeWord (heap [n]);
+        putTag (&buf, "MAll");
+        putWord (&buf, heapSize * 4);
+        putWords (&buf, heap, heapSize);
         free(heap);
     }
 
     // Memory chunk.
-    glk_put_string ("CMem");
-    memSizePos = glk_stream_get_position (file);
-    writeWord (0);
-
-    writeWord (gEndMem);
-    for (zeroCount = 0, n = gRamStart ; n < gEndMem ; ++n)
-    {
-        unsigned char romC = (n < gExtStart) ? gInitMem[n] : 0;
-        unsigned char c = ((git_uint32) romC) ^ ((git_uint32) gMem[n]);
-        if (c == 0)
-            ++zeroCount;
-        else
-        {
-            for ( ; zeroCount > 256 ; zeroCount -= 256)
-            {
-                glk_put_char (0);
-                glk_put_char (0xff);
-            }
-
-            if (zeroCount > 0)
-            {
-                glk_put_char (0);
-                glk_put_char ((char) (zeroCount - 1));
-                zeroCount = 0;
-            }
-
-            glk_put_char (c);
-        }
-    }
-    // Note: we don't bother writing out any remaining zeroes,
-    // because the memory is padded out with zeroes on restore.
-
-    memSize = glk_stream_get_position (file) - memSizePos - 4;
-    if (memSize & 1)
-       glk_put_char (0);
-
-    // Back up and fill in the lengths.
-    fileSize = glk_stream_get_position (file) - fileSizePos - 4;
+    putTag (&buf, "CMem");
+    memSizePos = buf.used;
+    putWord (&buf, 0);
+    putWord (&buf, gEndMem);
+    compressMemory (&buf);
 
-    glk_stream_set_position (file, fileSizePos, seekmode_Start);
-    writeWord (fileSize);
+    write32 (buf.data + memSizePos, buf.used - memSizePos - 4);
+    if ((buf.used - memSizePos) & 1)
+        putBytes (&buf, "", 1);
 
-    glk_stream_set_position (file, memSizePos, seekmode_Start);
-    writeWord (memSize);
+    write32 (buf.data + 4, buf.used - 8);
 
-    // Restore the previous default stream.
-    glk_stream_set_current (oldFile);
+    // Write it all out at once.
+    glk_put_buffer_stream (file, (char *) buf.data, buf.used);
+    free (buf.data);
 
     // And we're done.
     return 0;
@@ -5,8 +5,35 @@
 #include <string.h>
 #include <assert.h>
 
-typedef const git_uint8 * MemoryPage;
-typedef MemoryPage * MemoryMap;
+// Each undo record has a map with one entry for each 256-byte page
+// of RAM. A NULL entry means the page is the same as when the game
+// started; otherwise it points to a copy of the page. Copies are
+// shared between records whenever the page hasn't changed, and are
+// reference-counted so that we know when they can be thrown away.
+
+#define PAGE_SIZE 256
+#define PAGES_PER_SLAB 64
+
+typedef struct UndoPage UndoPage;
+
+struct UndoPage
+{
+    git_uint32 refs;
+    union {
+        git_uint8  data [PAGE_SIZE];
+        UndoPage * nextFree;
+    } u;
+};
+
+typedef struct PageSlab PageSlab;
+
+struct PageSlab
+{
+    PageSlab * next;
+    UndoPage   pages [PAGES_PER_SLAB];
+};
+
+typedef UndoPage ** MemoryMap;
 
 typedef struct UndoRecord UndoRecord;
 
@@ -26,9 +53,72 @@ static UndoRecord * gUndo = NULL;
 static git_uint32 gUndoSize = 0;
 static git_uint32 gMaxUndoSize = 256 * 1024;
 
+static PageSlab * gSlabs = NULL;    // All the slabs we've allocated.
+static UndoPage * gFreePages = NULL; // Pages that aren't being used.
+
 static void reserveSpace (git_uint32);
 static void deleteRecord (UndoRecord * u);
 
+// -------------------------------------------------------------
+// Pages
+
+static UndoPage * newPage (const git_uint8 * contents)
+{
+    UndoPage * page;
+
+    if (gFreePages == NULL)
+    {
+        PageSlab * slab = malloc (sizeof(PageSlab));
+        int i;
+
+        if (slab == NULL)
+            fatalError ("Couldn't allocate memory for undo");
+
+        slab->next = gSlabs;
+        gSlabs = slab;
+
+        for (i = 0 ; i < PAGES_PER_SLAB ; ++i)
+        {
+            slab->pages[i].u.nextFree = gFreePages;
+            gFreePages = slab->pages + i;
+        }
+    }
+
+    page = gFreePages;
+    gFreePages = page->u.nextFree;
+
+    page->refs = 1;
+    memcpy (page->u.data, contents, PAGE_SIZE);
+    gUndoSize += PAGE_SIZE;
+    return page;
+}
+
+static void releasePage (UndoPage * page)
+{
+    if (page != NULL && --page->refs == 0)
+    {
+        page->u.nextFree = gFreePages;
+        gFreePages = page;
+        gUndoSize -= PAGE_SIZE;
+    }
+}
+
+static const git_uint8 sZeroPage [PAGE_SIZE];
+
+// What a page held when the game started.
+static const git_uint8 * initialPage (git_uint32 addr)
+{
+    return (addr < gExtStart) ? gInitMem + addr : sZeroPage;
+}
+
+static const git_uint8 * pageContents (UndoPage * page, git_uint32 addr)
+{
+    return page ? page->u.data : initialPage (addr);
+}
+
+// -------------------------------------------------------------
+// Undo records
+
 void initUndo (git_uint32 size)
 {
     gMaxUndoSize = size;
@@ -47,17 +137,17 @@ int hasUndo ()
 int saveUndo (git_sint32 * base, git_sint32 * sp)
 {
     git_uint32 undoSize = sizeof(UndoRecord);
-    git_uint32 mapSize = sizeof(MemoryPage*) * (gEndMem - gRamStart) / 256;
+    git_uint32 mapSize = sizeof(UndoPage*) * (gEndMem - gRamStart) / PAGE_SIZE;
     git_uint32 stackSize = sizeof(git_sint32) * (sp - base);
-    git_uint32 totalSize = undoSize + mapSize + stackSize;
 
     git_uint32 addr = gRamStart; // Address in glulx memory.
     git_uint32 slot = 0;         // Slot in our memory map.
-    
+    git_uint32 prevEnd = gUndo ? gUndo->endMem : gRamStart;
+
     UndoRecord * undo = malloc (undoSize);
     if (undo == NULL)
         fatalError ("Couldn't allocate undo record");
-        
+
     undo->endMem = gEndMem;
     undo->memoryMap = malloc (mapSize);
     undo->stackSize = stackSize;
@@ -65,98 +155,61 @@ int saveUndo (git_sint32 * base, git_sint32 * sp)
     undo->prev = NULL;
     undo->next = NULL;
 
-    if (undo->memoryMap == NULL || undo->stack == NULL)
+    if (undo->memoryMap == NULL || (stackSize > 0 && undo->stack == NULL))
         fatalError ("Couldn't allocate memory for undo");
 
     // Save the stack.
     memcpy (undo->stack, base, undo->stackSize);
 
-    // Are we diffing against the previous undo record,
-    // or against the initial gamefile state?
-    if (gUndo == NULL)
+    // Save the pages of RAM. If there's an older record, any page that
+    // hasn't been written to since then is exactly what it has, so we
+    // only need to look at the dirty ones. Otherwise we have to check
+    // every page against the gamefile.
+
+    for ( ; addr < gEndMem ; addr += PAGE_SIZE, ++slot)
     {
-        // We're diffing against the gamefile.        
-        for ( ; addr < gExtStart ; addr += 256, ++slot)
+        UndoPage * old = NULL;
+        const git_uint8 * current = gMem + addr;
+
+        if (addr < prevEnd)
         {
-            if (memcmp (gInitMem + addr, gMem + addr, 256) != 0)
-            {
-                // We need to save this page.
-                git_uint8 * page = malloc(256);
-                if (page == NULL)
-                    fatalError ("Couldn't allocate memory for undo");
-                    
-                memcpy (page, gMem + addr, 256);
-                undo->memoryMap[slot] = page;
-                totalSize += 256;
-            }
-            else
+            old = gUndo->memoryMap [slot];
+            if (!gDirtyPages [addr >> 8])
             {
-                // We don't need to save this page.
-                // Just make it point into ROM.
-                undo->memoryMap[slot] = gInitMem + addr;
+                undo->memoryMap [slot] = old;
+                if (old)
+                    ++old->refs;
+                continue;
             }
         }
 
-        // If the memory map has been extended, save the exended area
-        for (addr = gExtStart ; addr < gEndMem ; addr += 256, ++slot)
+        if (memcmp (pageContents (old, addr), current, PAGE_SIZE) == 0)
         {
-            git_uint8 * page = malloc(256);
-            if (page == NULL)
-                fatalError ("Couldn't allocate memory for undo");
-                
-            memcpy (page, gMem + addr, 256);
-            undo->memoryMap[slot] = page;
-            totalSize += 256;
+            undo->memoryMap [slot] = old;
+            if (old)
+                ++old->refs;
         }
-    }
-    else
-    {
-        // We're diffing against the most recent undo record.
-        git_uint32 endMem = (gUndo->endMem < gEndMem) ? gUndo->endMem : gEndMem;
-        for ( ; addr < endMem ; addr += 256, ++slot)
-        {
-            if (memcmp (gUndo->memoryMap [slot], gMem + addr, 256) != 0)
-            {
-                // We need to save this page.
-                git_uint8 * page = malloc(256);
-                memcpy (page, gMem + addr, 256);
-                undo->memoryMap[slot] = page;
-                totalSize += 256;
-            }
-            else
-            {
-                // We don't need to save this page. Just copy
-                // the pointer from the previous undo record.
-                undo->memoryMap[slot] = gUndo->memoryMap[slot];
-            }
-        }
-
-        // If the memory map has been extended, save the exended area
-        for (addr = endMem ; addr < gEndMem ; addr += 256, ++slot)
+        else
         {
-            git_uint8 * page = malloc(256);
-            if (page == NULL)
-                fatalError ("Couldn't allocate memory for undo");
-                
-            memcpy (page, gMem + addr, 256);
-            undo->memoryMap[slot] = page;
-            totalSize += 256;
+            undo->memoryMap [slot] = newPage (current);
         }
     }
 
+    // The new record is now up to date.
+    memset (gDirtyPages + (gRamStart >> 8), 0, (gEndMem - gRamStart) >> 8);
+
     // Save the heap.
     if (heap_get_summary (&(undo->heapSize), &(undo->heap)))
         fatalError ("Couldn't get heap summary");
-    totalSize += undo->heapSize * 4;
 
     // Link this record into the undo list.
-    
+
     undo->prev = gUndo;
     if (gUndo)
         gUndo->next = undo;
-    
+
     gUndo = undo;
-    gUndoSize += totalSize;
+    gUndoSize += undoSize + mapSize + stackSize + undo->heapSize * 4;
 
     // Delete old records until we have enough free space.
     reserveSpace (0);
@@ -165,6 +218,23 @@ int saveUndo (git_sint32 * base, git_sint32 * sp)
     return 0;
 }
 
+// The newest record has gone, so the dirty pages now have to
+// show what's different from the one before it.
+static void markChangedPages (UndoRecord * undo)
+{
+    git_uint32 addr = gRamStart;
+    git_uint32 slot = 0;
+
+    if (undo->prev == NULL)
+        return; // We'll be checking everything next time anyway.
+
+    for ( ; addr < undo->endMem ; addr += PAGE_SIZE, ++slot)
+    {
+        if (addr >= undo->prev->endMem || undo->memoryMap [slot] != undo->prev->memoryMap [slot])
+            gDirtyPages [addr >> 8] = 1;
+    }
+}
+
 int restoreUndo (git_sint32* base, git_uint32 protectPos, git_uint32 protectSize)
 {
     if (gUndo == NULL)
@@ -178,6 +248,10 @@ int restoreUndo (git_sint32* base, git_uint32 protectPos, git_uint32 protectSize
 
         git_uint32 addr = gRamStart;     // Address in glulx memory.
         MemoryMap map = undo->memoryMap; // Glulx memory map.
+        git_uint32 protectEnd = protectPos + protectSize;
+
+        if (protectSize == 0)
+            protectPos = protectEnd = 0;
 
         // Restore the size of the memory map
         heap_clear ();
@@ -187,30 +261,31 @@ int restoreUndo (git_sint32* base, git_uint32 protectPos, git_uint32 protectSize
         memcpy (base, undo->stack, undo->stackSize);
         gStackPointer = base + (undo->stackSize / sizeof(git_sint32));
 
-        // Restore the contents of RAM.
+        // Restore the contents of RAM. Only the pages that have been
+        // written to since the record was made can be different.
 
-        if (protectSize > 0 && protectPos < gEndMem)
+        for ( ; addr < gEndMem ; addr += PAGE_SIZE, ++map)
         {
-            for ( ; addr < (protectPos & ~0xff) ; addr += 256, ++map)
-                memcpy (gMem + addr, *map, 256);
-            
-            memcpy (gMem + addr, *map, protectPos & 0xff);
-            protectSize += protectPos & 0xff;
-            
-            while (protectSize > 256)
-                addr += 256, ++map, protectSize -= 256;
-
-            if (addr < gEndMem)
+            const git_uint8 * page;
+
+            if (!gDirtyPages [addr >> 8])
+                continue;
+
+            page = pageContents (*map, addr);
+
+            if (protectPos < addr + PAGE_SIZE && protectEnd > addr)
             {
-                memcpy (gMem + addr + protectSize,
-                        *map + protectSize,
-                        256 - protectSize);
+                // Part of this page is protected, so we leave that part alone.
+                if (protectPos > addr)
+                    memcpy (gMem + addr, page, protectPos - addr);
+                if (protectEnd < addr + PAGE_SIZE)
+                    memcpy (gMem + protectEnd, page + (protectEnd - addr), addr + PAGE_SIZE - protectEnd);
+                continue;
             }
-            addr += 256, ++map;
-        }
 
-        for ( ; addr < gEndMem ; addr += 256, ++map)
-            memcpy (gMem + addr, *map, 256);
+            memcpy (gMem + addr, page, PAGE_SIZE);
+            gDirtyPages [addr >> 8] = 0;
+        }
 
         // Restore the heap.
         if (heap_apply_summary (undo->heapSize, undo->heap))
@@ -218,6 +293,7 @@ int restoreUndo (git_sint32* base, git_uint32 protectPos, git_uint32 protectSize
 
         // Delete the undo record.
 
+        markChangedPages (undo);
         gUndo = undo->prev;
         deleteRecord (undo);
 
@@ -242,6 +318,7 @@ void discardUndo ()
     {
         UndoRecord * undo = gUndo;
         // Delete the undo record.
+        markChangedPages (undo);
         gUndo = undo->prev;
         deleteRecord (undo);
 
@@ -265,6 +342,14 @@ void resetUndo ()
 void shutdownUndo ()
 {
     resetUndo();
+
+    while (gSlabs)
+    {
+        PageSlab * slab = gSlabs;
+        gSlabs = slab->next;
+        free (slab);
+    }
+    gFreePages = NULL;
 }
 
 static void reserveSpace (git_uint32 n)
@@ -307,66 +392,18 @@ static void reserveSpace (git_uint32 n)
 
 static void deleteRecord (UndoRecord * u)
 {
-    git_uint32 addr = gRamStart; // Address in glulx memory.
-    git_uint32 slot = 0;         // Slot in our memory map.
-
-    // Zero out all the slots which are duplicates
-    // of pages held in older undo records.
-
-    if (u->prev)
-    {
-        // We're diffing against the previous undo record.
-        while (addr < u->endMem && addr < u->prev->endMem)
-        {
-            if (u->memoryMap [slot] == u->prev->memoryMap [slot])
-                u->memoryMap [slot] = NULL;
-            addr += 256, ++slot;
-        }
-    }
-    else
-    {
-        // We're diffing against the gamefile.
-        while (addr < u->endMem && addr < gExtStart)
-        {
-            if (u->memoryMap [slot] == (gInitMem + addr))
-                u->memoryMap [slot] = NULL;
-            addr += 256, ++slot;
-        }
-    }
-
-    // Zero out all the slots which are duplicates
-    // of newer undo records.
-
-    if (u->next)
-    {
-        addr = gRamStart;
-        slot = 0;
-
-        while (addr < u->endMem && addr < u->next->endMem)
-        {
-            if (u->memoryMap [slot] == u->next->memoryMap [slot])
-                u->memoryMap [slot] = NULL;
-            addr += 256, ++slot;
-        }
-    }
+    git_uint32 numPages = (u->endMem - gRamStart) / PAGE_SIZE;
+    git_uint32 slot;
 
-    // Free all the slots which are owned by this record only.
+    // Let go of all the pages. Any that are shared
+    // with other records will stay where they are.
 
-    addr = gRamStart;
-    slot = 0;
-    while (addr < u->endMem)
-    {
-        if (u->memoryMap [slot])
-        {
-            free ((void*) u->memoryMap [slot]);
-            gUndoSize -= 256;
-        }
-        addr += 256, ++slot;
-    }
+    for (slot = 0 ; slot < numPages ; ++slot)
+        releasePage (u->memoryMap [slot]);
 
     // Free the memory map itself.
     free ((void*) u->memoryMap);
-    gUndoSize -= sizeof(MemoryPage*) * (u->endMem - gRamStart) / 256;
+    gUndoSize -= sizeof(UndoPage*) * numPages;
 
     // Free the stack.
     free (u->stack);
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+
+"""
+This script reads opcode profiles written by Git and picks out the
+sequences of opcodes that are worth turning into superinstructions.
+It writes them out as a list of SUPEROP entries.
+
+Git doesn't compile any superinstructions in yet. The list is meant to
+be the table for that, once it has been made from profiles of enough
+real games to be worth having; profiles of test programs mostly pick
+out the opcodes the tests happen to use.
+
+To use it:
+
+- Compile Git with USE_OPCODE_PROFILE defined.
+- Run some games with the "--opprofile FILE" option, writing a
+  different file for each game. Play for a while and quit.
+- Run this script on all the profiles:
+
+    python3 superops.py -o superops.inc profile1 profile2 ...
+
+Each game's counts are scaled by the total number of opcodes it ran,
+so a long session doesn't swamp the others.
+
+A superinstruction is always a run of register loads followed by one
+other opcode from the same glulx instruction, since that's the only
+place where the interpreter is guaranteed to go straight from one
+opcode to the next.
+"""
+
+import argparse
+import re
+import sys
+
+# Every superinstruction saves one dispatch each time it runs, so we
+# rank them by how often they run. Most of the benefit comes from the
+# first few dozen; after that they just make the interpreter bigger.
+DEFAULT_COUNT = 64
+
+# Anything that makes up less than this fraction of the opcodes
+# run isn't worth a superinstruction, however much room is left.
+DEFAULT_SHARE = 0.0001
+
+# A triple (load, load, op) is only worth two superinstructions if the
+# first pair nearly always leads to the same opcode.
+TRIPLE_SHARE = 0.9
+
+SINGLE_LOAD = re.compile(r'^(L[1-7])_(const|stack|local|addr)$')
+DOUBLE_LOAD = re.compile(r'^L1_(const|stack|local|addr)_L2_(const|stack|local|addr)$')
+NARROW_LOAD = re.compile(r'^L1_(addr16|addr8)$')
+BRANCH = re.compile(r'^(j\w+)_(const|by)$')
+
+def parse_loads(name):
+    """Return the (register, mode) pairs loaded by a label, or None
+    if it does anything other than load registers."""
+    loads = []
+    for part in name.split('__'):
+        match = SINGLE_LOAD.match(part)
+        if match:
+            loads.append((match.group(1), match.group(2)))
+            continue
+        match = DOUBLE_LOAD.match(part)
+        if match:
+            loads.append(('L1', match.group(1)))
+            loads.append(('L2', match.group(2)))
+            continue
+        match = NARROW_LOAD.match(part)
+        if match:
+            loads.append(('L1', match.group(1)))
+            continue
+        return None
+    return loads
+
+def is_load(name):
+    return parse_loads(name) is not None
+
+def counterpart(next):
+    """A constant branch may be turned into a 'by' branch when the code
+    is compiled, so we need superinstructions for both or neither."""
+    match = BRANCH.match(next)
+    if not match:
+        return None
+    other = 'by' if match.group(2) == 'const' else 'const'
+    return '%s_%s' % (match.group(1), other)
+
+def read_profile(path, ops, pairs, triples):
+    counts = ([], [], [])
+    total = 0
+    with open(path) as f:
+        for line in f:
+            words = line.split()
+            if not words:
+                continue
+            if words[0] == 'total':
+                total = int(words[1])
+            elif words[0] == 'op':
+                counts[0].append((int(words[1]), words[2]))
+            elif words[0] == 'pair':
+                counts[1].append((int(words[1]), tuple(words[2:4])))
+            elif words[0] == 'triple':
+                counts[2].append((int(words[1]), tuple(words[2:5])))
+    if total == 0:
+        sys.stderr.write('%s: no opcodes counted, skipping\n' % path)
+        return
+    for table, entries in zip((ops, pairs, triples), counts):
+        for count, key in entries:
+            table[key] = table.get(key, 0.0) + float(count) / total
+
+def choose(ops, pairs, triples, limit, share):
+    # Each candidate is a list of (name, first, next) entries that
+    # have to go in together, with the dispatches they'd save.
+    candidates = []
+
+    for (first, next), score in pairs.items():
+        if is_load(next) or first == 'nop':
+            continue
+        candidates.append((score, [(first + '__' + next, first, next)]))
+
+    for (a, b, c), score in triples.items():
+        if is_load(c) or score < TRIPLE_SHARE * pairs.get((a, b), 0.0):
+            continue
+        prefix = a + '__' + b
+        candidates.append((2 * score, [(prefix, a, b), (prefix + '__' + c, prefix, c)]))
+
+    chosen = {}
+    for score, entries in sorted(candidates, key=lambda c: -c[0]):
+        if score < share:
+            break
+
+        # Add the other form of any constant branch as well.
+        for name, first, next in list(entries):
+            other = counterpart(next)
+            if other:
+                entries.append((first + '__' + other, first, other))
+
+        new = [e for e in entries if e[0] not in chosen]
+        if len(chosen) + len(new) > limit:
+            continue
+        for name, first, next in new:
+            chosen[name] = (first, next, score)
+
+    # Superinstructions have to be listed after the ones they use.
+    return sorted(chosen.items(), key=lambda c: (c[0].count('__'), -c[1][2], c[0]))
+
+def main():
+    parser = argparse.ArgumentParser(description='Pick superinstructions from Git opcode profiles.')
+    parser.add_argument('profiles', nargs='+', help='profiles written by git --opprofile')
+    parser.add_argument('-n', '--count', type=int, default=DEFAULT_COUNT,
+                        help='most superinstructions to generate (default %d)' % DEFAULT_COUNT)
+    parser.add_argument('-s', '--share', type=float, default=DEFAULT_SHARE,
+                        help='smallest fraction of opcodes worth fusing (default %g)' % DEFAULT_SHARE)
+    parser.add_argument('-o', '--output', help='file to write (default stdout)')
+    args = parser.parse_args()
+
+    ops, pairs, triples = {}, {}, {}
+    for path in args.profiles:
+        read_profile(path, ops, pairs, triples)
+
+    chosen = choose(ops, pairs, triples, args.count, args.share * len(args.profiles))
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    out.write('// Superinstructions for git. This file is generated by superops.py\n')
+    out.write('// from opcode profiles; edit the profiles rather than this file.\n')
+    out.write('//\n')
+    out.write('// SUPEROP (name, first, next, loads) fuses the opcode \'first\' with the\n')
+    out.write('// opcode \'next\' that follows it in the same instruction. \'first\' is\n')
+    out.write('// always a run of register loads, and \'loads\' lists them in order.\n')
+    if chosen:
+        out.write('\n')
+    for name, (first, next, score) in chosen:
+        loads = ' '.join('LOAD (%s, %s)' % load for load in parse_loads(first))
+        out.write('SUPEROP (%s, %s, %s, %s)\n' % (name, first, next, loads))
+    if args.output:
+        out.close()
+
+if __name__ == '__main__':
+    main()
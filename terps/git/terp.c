@@ -9,17 +9,28 @@
 #include <string.h>
 #include <time.h>
 
+// With USE_DISPATCH_SELECT, this file is compiled a second time from
+// terp_threaded.c, with GIT_THREADED_TERP defined, to make the direct-
+// threaded startThreadedProgram(). The global variables and the random
+// number generator are only compiled the first time.
+
+#ifndef GIT_THREADED_TERP
+
 // -------------------------------------------------------------
 // Global variables
 
 git_sint32* gStackPointer;
 
-#ifdef USE_DIRECT_THREADING
+#if defined(USE_DISPATCH_SELECT)
+git_uint32 gOpcodeWords [MAX_LABEL];
+#elif defined(USE_DIRECT_THREADING)
 Opcode* gOpcodeTable;
 #endif
 
 enum IOMode gIoMode = IO_NULL;
 
+#endif // GIT_THREADED_TERP
+
 // -------------------------------------------------------------
 // Useful macros for manipulating the stack
 
@@ -35,6 +46,8 @@ enum IOMode gIoMode = IO_NULL;
 // -------------------------------------------------------------
 // Random number generator, from Glulxe
 
+#ifndef GIT_THREADED_TERP
+
 static glui32 xo_random(void);
 static void xo_seed_random(glui32 seed);
 
@@ -114,6 +127,8 @@ static glui32 xo_random(void)
   return result;
 }
 
+#endif // GIT_THREADED_TERP
+
 // -------------------------------------------------------------
 // Floating point support
 
@@ -197,7 +212,11 @@ static void testDouble()
 // -------------------------------------------------------------
 // Functions
 
+#ifdef GIT_THREADED_TERP
+void startThreadedProgram (size_t cacheSize)
+#else
 void startProgram (size_t cacheSize)
+#endif
 {
     Block pc; // Program counter (pointer into dynamically generated code)
 
@@ -230,6 +249,11 @@ void startProgram (size_t cacheSize)
 
     acceleration_func accelfunc;
 
+#ifdef USE_NATIVE_CODE
+    NativeState native;
+    Block resume;
+#endif
+
     // Initialise the code cache.
 
 #ifdef USE_DIRECT_THREADING
@@ -237,12 +261,20 @@ void startProgram (size_t cacheSize)
 #define LABEL(label) &&do_ ## label,
 #include "labels.inc"
     NULL};
+# ifdef USE_DISPATCH_SELECT
+    for (L1 = 0 ; L1 < MAX_LABEL ; ++L1)
+        gOpcodeWords [L1] = (git_uint32) (uintptr_t) opcodeTable [L1];
+# else
     gOpcodeTable = opcodeTable;
+# endif
 # if (UINTPTR_MAX > 0xffffffffULL)
     const uintptr_t opcodeHi = (uintptr_t)opcodeTable[0] & ~0xffffffffULL;
     for (L1 = 1; opcodeTable[L1] != NULL; ++L1)
       assert (opcodeHi == ((uintptr_t)opcodeTable[L1] & ~0xffffffffULL));
 # endif
+#elif defined(USE_DISPATCH_SELECT)
+    for (L1 = 0 ; L1 < MAX_LABEL ; ++L1)
+        gOpcodeWords [L1] = L1;
 #endif    
 
     testDouble ();
@@ -277,6 +309,9 @@ next:
 #ifdef GIT_NEED_TICK
     glk_tick();
 #endif
+#ifdef USE_OPCODE_PROFILE
+    profileOpcode (*pc);
+#endif
 
     switch (*pc++)
     {
@@ -345,6 +380,46 @@ do_S1_addr8:  memWrite8 (READ_PC, S1); NEXT;
 do_recompile:
     pc = compile (*pc);
 	NEXT;
+
+do_native:
+    // This block has been translated into machine code (see native.c).
+#ifdef USE_NATIVE_CODE
+    native.L1 = L1;
+    native.L2 = L2;
+    native.L3 = L3;
+    native.sp = sp;
+    native.locals = locals;
+    native.values = values;
+    native.top = top;
+
+    resume = nativeRun (pc - 1, &native);
+
+    L1 = native.L1;
+    L2 = native.L2;
+    L3 = native.L3;
+    sp = native.sp;
+
+    if (resume != pc - 1)
+    {
+        pc = resume;
+        NEXT;
+    }
+
+    // The native code couldn't even get started, so we'll
+    // run the opcode that it replaced and carry on from there.
+# ifdef USE_DIRECT_THREADING
+    goto *opcodeTable [nativeOriginalLabel (resume)];
+# else
+    switch (nativeOriginalLabel (resume))
+    {
+#define LABEL(foo) case label_ ## foo: goto do_ ## foo;
+#include "labels.inc"
+    default: fatalError("exec: bad opcode");
+    }
+# endif
+#else
+    fatalError ("exec: native code is not supported");
+#endif
 	
 do_jump_abs_L7:
     pc = getCode (UL7);
@@ -501,10 +576,23 @@ do_enter_function_L1: // Arg count is in L2.
         memWrite8(L1 + (L2>>3), L4);
         NEXT;
 
+#ifdef USE_NATIVE_CODE
+// A loop within a block never goes back through getCode(), so we
+// count backward jumps as runs of the block too. That way a hot
+// loop gets translated into native code even if it's only entered once.
+#define JUMP_BY(L7) do {                                                                    \
+        pc += L7;                                                                           \
+        if (L7 < 0 && ++gBlockHeader->runCounter == gNativeThreshold)                       \
+            nativeCompileBlock (gBlockHeader);                                              \
+    } while (0)
+#else
+#define JUMP_BY(L7) pc += L7
+#endif
+
 #define DO_JUMP(tag, reg, cond) \
     do_ ## tag ## _var:     L7 = READ_PC; if (cond) goto do_goto_ ## reg ## _from_L7; NEXT; \
     do_ ## tag ## _const:   L7 = READ_PC; if (cond) goto do_jump_abs_L7; NEXT;              \
-    do_ ## tag ## _by:      L7 = READ_PC; if (cond) pc += L7; NEXT;                         \
+    do_ ## tag ## _by:      L7 = READ_PC; if (cond) JUMP_BY(L7); NEXT;                      \
     do_ ## tag ## _return0: if (cond) { L1 = 0; goto do_return; } NEXT;                     \
     do_ ## tag ## _return1: if (cond) { L1 = 1; goto do_return; } NEXT
     
@@ -539,6 +627,7 @@ do_enter_function_L1: // Arg count is in L2.
     DO_JUMP(jdisnan, L3, (((L1 & 0x7FF00000) == 0x7FF00000) && (((L1 & 0xFFFFF) != 0) || (L2 != 0x0))));
 
 #undef DO_JUMP
+#undef JUMP_BY
 
     do_jumpabs: L7 = L1; goto do_jump_abs_L7; NEXT;
 
@@ -1424,6 +1513,7 @@ do_tailcall:
           if (L2 < gRamStart || (L2 + L1) > gEndMem)
             memWriteError(L2);
           memset(gMem + L2, 0, L1);
+          markMemoryDirty(L2, L1);
         }
         NEXT;
         
@@ -1434,6 +1524,7 @@ do_tailcall:
             if (L3 < gRamStart || (L3 + L1) > gEndMem)
                 memWriteError(L3);
             memmove(gMem + L3, gMem + L2, L1);
+            markMemoryDirty(L3, L1);
         }
         NEXT;
         
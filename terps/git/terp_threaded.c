@@ -0,0 +1,10 @@
+// Direct-threaded copy of the interpreter engine, for USE_DISPATCH_SELECT.
+// See the top of terp.c and dispatch.c.
+
+#include "config.h"
+
+#ifdef USE_DISPATCH_SELECT
+#define USE_DIRECT_THREADING
+#define GIT_THREADED_TERP
+#include "terp.c"
+#endif
@@ -6,6 +6,11 @@
 #include "glk.h"
 #include "glulxe.h"
 
+#if ACCEL_CACHE
+#include <stdio.h>
+#include <string.h>
+#endif /* ACCEL_CACHE */
+
 /* Git passes along function arguments in reverse order. To make our lives
    more interesting. */
 #ifdef ARGS_REVERSED
@@ -34,6 +39,7 @@ static glui32 func_12_rv__pr(glui32 argc, glui32 *argv);
 static glui32 func_13_op__pr(glui32 argc, glui32 *argv);
 
 static int obj_in_class(glui32 obj);
+static glui32 find_prop_entry(glui32 otab, glui32 id);
 static glui32 get_prop(glui32 obj, glui32 id);
 static glui32 get_prop_new(glui32 obj, glui32 id);
 
@@ -59,6 +65,50 @@ typedef struct accelentry_struct {
 
 static accelentry_t **accelentries = NULL;
 
+#if ACCEL_CACHE
+
+/* The accelerated property functions spend most of their time finding
+   an id in an object's property table. We remember the results in a
+   direct-mapped cache, keyed by the table address and the id.
+
+   A lookup result depends only on the table's count word and on the
+   ids that the binary search probed; the rest of each entry (length,
+   address, flags) is read fresh every time. We mark those bytes in a
+   bitmap with one bit per byte of RAM, and drop the whole cache when a
+   marked byte is written. Writing property values therefore never
+   causes a drop. Tables in ROM are never marked. */
+
+#define PROPCACHE_SIZE (1024)
+
+typedef struct propcache_struct {
+    glui32 generation; /* 0 if unused */
+    glui32 otab;
+    glui32 id;
+    glui32 prop;
+} propcache_t;
+
+static propcache_t propcache[PROPCACHE_SIZE];
+static glui32 propcache_generation = 1;
+
+static unsigned char *propcache_map = NULL;
+static glui32 propcache_mapsize = 0; /* in bytes */
+
+/* The range of RAM covered by marked bytes, for a quick test in the
+   MemW macros. Empty if nothing is marked. */
+glui32 propcache_watchstart = 0;
+glui32 propcache_watchend = 0;
+
+static glui32 propcache_hits = 0;
+static glui32 propcache_misses = 0;
+static glui32 propcache_drops = 0;
+
+/* Set if the --accelstats switch is used. */
+static strid_t accelstats_stream = NULL;
+
+static void propcache_mark(glui32 addr, glui32 len);
+
+#endif /* ACCEL_CACHE */
+
 void init_accel()
 {
     accelentries = NULL;
@@ -227,6 +277,197 @@ static int obj_in_class(glui32 obj)
     return (Mem4(obj + 13 + num_attr_bytes) == class_metaclass);
 }
 
+/* Find id in the property table at otab, which begins with a count
+   word followed by ten-byte entries sorted by their two-byte id. This
+   is equivalent to
+     @binarysearch id 2 otab+4 10 max 0 0 res;
+   but goes through the property cache. Since ofclass looks up the
+   class list (property 2) through here, it benefits as well. */
+static glui32 find_prop_entry(glui32 otab, glui32 id)
+{
+    glui32 max, bot, top, val, addr, probe;
+    glui32 prop = 0;
+#if ACCEL_CACHE
+    glui32 hash;
+    propcache_t *ent;
+#endif /* ACCEL_CACHE */
+
+    /* A direct two-byte key is the low half of the value. */
+    id &= 0xFFFF;
+
+#if ACCEL_CACHE
+    hash = (otab * 2654435761U) ^ id;
+    hash ^= (hash >> 15);
+    ent = &propcache[hash & (PROPCACHE_SIZE-1)];
+    if (ent->generation == propcache_generation
+        && ent->otab == otab && ent->id == id) {
+        propcache_hits++;
+        return ent->prop;
+    }
+    propcache_misses++;
+    propcache_mark(otab, 4);
+#endif /* ACCEL_CACHE */
+
+    max = Mem4(otab);
+    otab += 4;
+
+    bot = 0;
+    top = max;
+    while (bot < top) {
+        val = (top+bot) / 2;
+        addr = otab + val * 10;
+        probe = Mem2(addr);
+#if ACCEL_CACHE
+        propcache_mark(addr, 2);
+#endif /* ACCEL_CACHE */
+        if (probe == id) {
+            prop = addr;
+            break;
+        }
+        if (probe < id)
+            bot = val+1;
+        else
+            top = val;
+    }
+
+#if ACCEL_CACHE
+    ent->generation = propcache_generation;
+    ent->otab = otab-4;
+    ent->id = id;
+    ent->prop = prop;
+#endif /* ACCEL_CACHE */
+    return prop;
+}
+
+#if ACCEL_CACHE
+
+/* propcache_mark():
+   Note that cached lookups depend on the given bytes of memory.
+*/
+static void propcache_mark(glui32 addr, glui32 len)
+{
+    glui32 first, last, ix;
+
+    if (addr+len <= ramstart || addr+len < addr)
+        return;
+    if (addr < ramstart) {
+        len -= (ramstart - addr);
+        addr = ramstart;
+    }
+
+    first = addr - ramstart;
+    last = addr + len - 1 - ramstart;
+
+    if ((last >> 3) >= propcache_mapsize) {
+        glui32 newsize = ((endmem - ramstart) >> 3) + 1;
+        unsigned char *newmap;
+        if (newsize <= (last >> 3))
+            return; /* past the end of memory; the read will fail anyway */
+        newmap = (unsigned char *)glulx_realloc(propcache_map, newsize);
+        if (!newmap)
+            fatal_error("Unable to allocate property cache map.");
+        memset(newmap+propcache_mapsize, 0, newsize-propcache_mapsize);
+        propcache_map = newmap;
+        propcache_mapsize = newsize;
+    }
+
+    for (ix=first; ix<=last; ix++)
+        propcache_map[ix >> 3] |= (1 << (ix & 7));
+
+    if (propcache_watchend == 0) {
+        propcache_watchstart = addr;
+        propcache_watchend = addr+len;
+    }
+    else {
+        if (addr < propcache_watchstart)
+            propcache_watchstart = addr;
+        if (addr+len > propcache_watchend)
+            propcache_watchend = addr+len;
+    }
+}
+
+/* accel_cache_written():
+   Called by the MemW macros when a write lands in the watched range.
+   If it touches a marked byte, drop all cached lookups.
+*/
+void accel_cache_written(glui32 addr, glui32 len)
+{
+    glui32 first, last, ix;
+
+    if (addr < ramstart)
+        return;
+    first = addr - ramstart;
+    last = addr + len - 1 - ramstart;
+    for (ix=first; ix<=last && (ix >> 3) < propcache_mapsize; ix++) {
+        if (propcache_map[ix >> 3] & (1 << (ix & 7))) {
+            propcache_drops++;
+            accel_cache_invalidate();
+            return;
+        }
+    }
+}
+
+/* accel_cache_invalidate():
+   Forget all cached property lookups. This is also called whenever RAM
+   is replaced wholesale.
+*/
+void accel_cache_invalidate()
+{
+    propcache_generation++;
+    if (propcache_generation == 0) {
+        memset(propcache, 0, sizeof(propcache));
+        propcache_generation = 1;
+    }
+    /* Only the watched range can have marks in it. */
+    if (propcache_map && propcache_watchend) {
+        glui32 first = (propcache_watchstart - ramstart) >> 3;
+        glui32 last = (propcache_watchend - 1 - ramstart) >> 3;
+        if (last >= propcache_mapsize)
+            last = propcache_mapsize-1;
+        if (first <= last)
+            memset(propcache_map+first, 0, last+1-first);
+    }
+    propcache_watchstart = 0;
+    propcache_watchend = 0;
+}
+
+/* setup_accel_stats():
+   Arrange for the property cache counters to be written to the given
+   stream when the game exits.
+*/
+void setup_accel_stats(strid_t stream)
+{
+    accelstats_stream = stream;
+}
+
+/* accel_stats_quit():
+   Write out the property cache counters, if requested.
+*/
+void accel_stats_quit()
+{
+    char buf[128];
+    glui32 total;
+
+    if (!accelstats_stream)
+        return;
+
+    total = propcache_hits + propcache_misses;
+    sprintf(buf, "property lookups: %lu\n", (unsigned long)total);
+    glk_put_string_stream(accelstats_stream, buf);
+    sprintf(buf, "cache hits: %lu (%.1f%%)\n", (unsigned long)propcache_hits,
+        (total ? (100.0 * propcache_hits / total) : 0.0));
+    glk_put_string_stream(accelstats_stream, buf);
+    sprintf(buf, "cache misses: %lu\n", (unsigned long)propcache_misses);
+    glk_put_string_stream(accelstats_stream, buf);
+    sprintf(buf, "cache drops: %lu\n", (unsigned long)propcache_drops);
+    glk_put_string_stream(accelstats_stream, buf);
+
+    glk_stream_close(accelstats_stream, NULL);
+    accelstats_stream = NULL;
+}
+
+#endif /* ACCEL_CACHE */
+
 /* Look up a property entry. */
 static glui32 get_prop(glui32 obj, glui32 id)
 {
@@ -338,7 +579,7 @@ static glui32 func_2_cp__tab(glui32 argc, glui32 *argv)
 {
     glui32 obj;
     glui32 id;
-    glui32 otab, max;
+    glui32 otab;
 
     obj = ARG_IF_GIVEN(argv, argc, 0);
     id = ARG_IF_GIVEN(argv, argc, 1);
@@ -352,10 +593,7 @@ static glui32 func_2_cp__tab(glui32 argc, glui32 *argv)
     if (!otab)
         return 0;
 
-    max = Mem4(otab);
-    otab += 4;
-    /* @binarysearch id 2 otab 10 max 0 0 res; */
-    return binary_search(id, 2, otab, 10, max, 0, 0);
+    return find_prop_entry(otab, id);
 }
 
 static glui32 func_3_ra__pr(glui32 argc, glui32 *argv)
@@ -518,7 +756,7 @@ static glui32 func_8_cp__tab(glui32 argc, glui32 *argv)
 {
     glui32 obj;
     glui32 id;
-    glui32 otab, max;
+    glui32 otab;
 
     obj = ARG_IF_GIVEN(argv, argc, 0);
     id = ARG_IF_GIVEN(argv, argc, 1);
@@ -532,10 +770,7 @@ static glui32 func_8_cp__tab(glui32 argc, glui32 *argv)
     if (!otab)
         return 0;
 
-    max = Mem4(otab);
-    otab += 4;
-    /* @binarysearch id 2 otab 10 max 0 0 res; */
-    return binary_search(id, 2, otab, 10, max, 0, 0);
+    return find_prop_entry(otab, id);
 }
 
 static glui32 func_9_ra__pr(glui32 argc, glui32 *argv)
@@ -45,6 +45,7 @@ void enter_function(glui32 funcaddr, glui32 argc, glui32 *argv)
 
   /* Bump the frameptr to the top. */
   frameptr = stackptr;
+  sample_enter(frameptr, funcaddr);
 
   /* Go through the function's locals-format list, copying it to the
      call frame. At the same time, we work out how much space the locals
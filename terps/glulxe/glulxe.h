@@ -56,6 +56,15 @@ typedef int16_t glsi16;
    _BSD_SOURCE or _DEFAULT_SOURCE or both for the timeradd() macro.) */
 /* #define VM_PROFILING (1) */
 
+/* Comment this definition to turn off the sampling profiler. It costs
+   almost nothing unless the "--sample" option is used; in that mode,
+   the Glulx call stack is recorded every few milliseconds, and written
+   out in the folded-stack format used by flame graph tools. This uses
+   setitimer() and SIGPROF, so it's only available on Unix and MacOS. */
+#if defined(OS_UNIX) || defined(OS_MAC)
+#define VM_SAMPLING (1)
+#endif /* OS_UNIX */
+
 /* Uncomment this definition to turn on the Glulx debugger. You should
    only do this when debugging facilities are desired; it slows down
    the interpreter. If you do, you will need to build with libxml2;
@@ -72,6 +81,16 @@ typedef int16_t glsi16;
 #define FLOAT_SUPPORT (1)
 #define DOUBLE_SUPPORT (1)
 
+/* Comment this definition to turn off the memo of recent @linearsearch
+   and @binarysearch results. The memo is dropped whenever a memoized
+   table in RAM is written. */
+#define SEARCH_MEMO (1)
+
+/* Comment this definition to turn off the cache of property-table
+   lookups made by the accelerated Inform functions (accel.c). The
+   cache is dropped whenever a cached property table is written. */
+#define ACCEL_CACHE (1)
+
 /* Comment this definition to not cache the original state of RAM in
    (real) memory. This saves some memory, but slows down save/restore/undo
    operations, which will have to read the original state off disk
@@ -115,9 +134,38 @@ typedef int16_t glsi16;
 #define Mem1(adr)  (Verify(adr, 1), Read1(memmap+(adr)))
 #define Mem2(adr)  (Verify(adr, 2), Read2(memmap+(adr)))
 #define Mem4(adr)  (Verify(adr, 4), Read4(memmap+(adr)))
-#define MemW1(adr, vl)  (VerifyW(adr, 1), Write1(memmap+(adr), (vl)))
-#define MemW2(adr, vl)  (VerifyW(adr, 2), Write2(memmap+(adr), (vl)))
-#define MemW4(adr, vl)  (VerifyW(adr, 4), Write4(memmap+(adr), (vl)))
+#define MemW1(adr, vl)  (VerifyW(adr, 1), WatchW(adr, 1), Write1(memmap+(adr), (vl)))
+#define MemW2(adr, vl)  (VerifyW(adr, 2), WatchW(adr, 2), Write2(memmap+(adr), (vl)))
+#define MemW4(adr, vl)  (VerifyW(adr, 4), WatchW(adr, 4), Write4(memmap+(adr), (vl)))
+
+/* Writes to a string-decoding table in RAM must drop its cached form,
+   writes to a searched table must drop memoized search results, and
+   writes to a property table must drop cached property lookups.
+   Each watched range is empty unless there is something in RAM to
+   watch, so this costs a comparison or two per write in the usual
+   case. */
+#define WatchW(adr, ln)  \
+  ((((adr) < tablecache_watchend && (adr)+(ln) > tablecache_watchstart) \
+    ? (stream_cache_invalidate(adr, ln), 0) : 0), \
+   WatchSearchW(adr, ln), WatchAccelW(adr, ln))
+
+/* Likewise for tables whose search results have been memoized. */
+#if SEARCH_MEMO
+#define WatchSearchW(adr, ln)  \
+  (((adr) < searchmemo_watchend && (adr)+(ln) > searchmemo_watchstart) \
+    ? (search_memo_invalidate(), 0) : 0)
+#else /* SEARCH_MEMO */
+#define WatchSearchW(adr, ln) (0)
+#endif /* SEARCH_MEMO */
+
+/* And for property tables whose lookups have been cached. */
+#if ACCEL_CACHE
+#define WatchAccelW(adr, ln)  \
+  (((adr) < propcache_watchend && (adr)+(ln) > propcache_watchstart) \
+    ? (accel_cache_written(adr, ln), 0) : 0)
+#else /* ACCEL_CACHE */
+#define WatchAccelW(adr, ln) (0)
+#endif /* ACCEL_CACHE */
 
 /* Macros to access values on the stack. These *must* be used 
    with proper alignment! (That is, Stk4 and StkW4 must take 
@@ -244,8 +292,10 @@ extern glui32 pop_callstub_string(int *bitnum);
 /* string.c */
 extern void stream_num(glsi32 val, int inmiddle, int charnum);
 extern void stream_string(glui32 addr, int inmiddle, int bitnum);
+extern glui32 tablecache_watchstart, tablecache_watchend;
 extern glui32 stream_get_table(void);
 extern void stream_set_table(glui32 addr);
+extern void stream_cache_invalidate(glui32 addr, glui32 len);
 extern void stream_get_iosys(glui32 *mode, glui32 *rock);
 extern void stream_set_iosys(glui32 mode, glui32 rock);
 extern char *make_temp_string(glui32 addr);
@@ -285,6 +335,12 @@ extern glui32 binary_search(glui32 key, glui32 keysize,
 extern glui32 linked_search(glui32 key, glui32 keysize, 
   glui32 start, glui32 keyoffset, glui32 nextoffset,
   glui32 options);
+#if SEARCH_MEMO
+extern glui32 searchmemo_watchstart, searchmemo_watchend;
+extern void search_memo_invalidate(void);
+#else /* SEARCH_MEMO */
+#define search_memo_invalidate() (0)
+#endif /* SEARCH_MEMO */
 
 /* osdepend.c */
 extern void *glulx_malloc(glui32 len);
@@ -329,6 +385,27 @@ extern void profile_quit(void);
 #define profile_quit()         (0)
 #endif /* VM_PROFILING */
 
+/* sampler.c */
+extern void setup_sampler(strid_t stream, glui32 rate);
+extern int init_sampler(void);
+#if VM_SAMPLING
+#include <signal.h>
+extern volatile sig_atomic_t sample_pending;
+extern glui32 *sample_frames;
+extern int sample_load_info_chunk(strid_t stream, glui32 pos, glui32 len);
+extern void sample_take(void);
+extern void sample_reset_frames(void);
+extern void sample_quit(void);
+#define sample_tick() (sample_pending ? (sample_take(), 0) : 0)
+#define sample_enter(fp, addr)  \
+  (sample_frames ? (sample_frames[(fp) >> 2] = (addr)) : 0)
+#else /* VM_SAMPLING */
+#define sample_tick()          (0)
+#define sample_enter(fp, addr) (0)
+#define sample_reset_frames()  (0)
+#define sample_quit()          (0)
+#endif /* VM_SAMPLING */
+
 #if VM_DEBUGGER
 extern unsigned long debugger_opcount;
 #define debugger_tick() (debugger_opcount++)
@@ -365,6 +442,16 @@ extern void accel_set_param(glui32 index, glui32 val);
 extern glui32 accel_get_param_count(void);
 extern glui32 accel_get_param(glui32 index);
 extern void accel_iterate_funcs(void (*func)(glui32 index, glui32 addr));
+#if ACCEL_CACHE
+extern glui32 propcache_watchstart, propcache_watchend;
+extern void accel_cache_written(glui32 addr, glui32 len);
+extern void accel_cache_invalidate(void);
+extern void setup_accel_stats(strid_t stream);
+extern void accel_stats_quit(void);
+#else /* ACCEL_CACHE */
+#define accel_cache_invalidate() (0)
+#define accel_stats_quit() (0)
+#endif /* ACCEL_CACHE */
 
 #ifdef FLOAT_SUPPORT
 
@@ -65,6 +65,10 @@ void glk_main()
   }
 
   setup_vm();
+  if (!init_sampler()) {
+    fatal_error("Unable to start the sampling profiler.");
+    return;
+  }
   if (library_autorestore_hook)
     library_autorestore_hook();
   execute_loop();
@@ -77,6 +81,8 @@ void glk_main()
   vm_exited_cleanly = TRUE;
   
   profile_quit();
+  sample_quit();
+  accel_stats_quit();
   glk_exit();
 }
 
@@ -0,0 +1,521 @@
+/* sampler.c: Glulxe sampling profiler, which records the call stack
+    at timer intervals and writes it out as folded stacks.
+*/
+
+/*
+If compiled in, and turned on with the "--sample" option, this records
+the Glulx call stack at regular intervals while the game runs. Unlike
+the instrumenting profiler in profile.c, it costs nothing per call and
+one flag test per opcode, so it can be left on while playing normally.
+
+A SIGPROF interval timer (which only counts CPU time used by the
+interpreter, so it is quiet while waiting for input) sets a flag. The
+main loop notices the flag between opcodes, when the VM state is
+consistent, and walks the call frames from frameptr. Time spent in
+accelerated functions and in the Glk library is charged to the Glulx
+function that called them.
+
+Call frames don't record which function they belong to, so
+enter_function() notes the function address in a side table indexed
+by frame position. After @restore, @restoreundo, or @restart this
+table is cleared; frames that predate that are then identified by
+their PC, if debug info is available, or reported as "[unknown]".
+
+On a normal VM exit, the sampler writes one line per distinct call
+stack, outermost function first, with the sample count at the end:
+
+  Main__;main;InformLibrary.play;PrintRank 12
+
+This is the "folded stack" format read by Brendan Gregg's
+flamegraph.pl. Functions are named from the game's Inform debug info
+(a gameinfo.dbg file, or the Dbug chunk of a Blorb file), or else
+given as hex addresses.
+*/
+
+#include "glk.h"
+#include "glulxe.h"
+
+#if VM_SAMPLING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* Set if the --sample switch is used. */
+static int sampling_active = FALSE;
+static strid_t sampling_stream = NULL;
+static glui32 sampling_rate = 99;
+
+/* Set by the signal handler; checked by sample_tick(). */
+volatile sig_atomic_t sample_pending = 0;
+
+/* The function address of each live call frame, indexed by
+   frameptr/4. Entries are zero if unknown. This is NULL unless
+   sampling is active. */
+glui32 *sample_frames = NULL;
+
+#define SAMPLE_MAX_DEPTH (128)
+#define SAMPLE_HASH_SIZE (1021)
+
+typedef struct stacksample_struct {
+  glui32 hash;
+  int depth;
+  int truncated;
+  glui32 count;
+  glui32 *funcs; /* innermost first */
+  struct stacksample_struct *next;
+} stacksample_t;
+
+static stacksample_t **samples = NULL;
+
+typedef struct sampleroutine_struct {
+  glui32 address;
+  glui32 endaddress;
+  char *name;
+} sampleroutine_t;
+
+static sampleroutine_t *routines = NULL;
+static int numroutines = 0;
+
+static void sample_signal(int sig);
+static glui32 frame_function(glui32 fp, glui32 curpc);
+static sampleroutine_t *find_routine(glui32 addr);
+static int parse_info(char *buf, glui32 len);
+static int sort_routines(const void *p1, const void *p2);
+static void put_func_name(strid_t str, glui32 addr);
+
+/* This is called from the setup code -- glkunix_startup_code(), for
+   the Unix version. Pass a writable stream; at game-shutdown time,
+   the terp will write the samples to it and close it. The rate is
+   in samples per second of CPU time; zero means the default. */
+void setup_sampler(strid_t stream, glui32 rate)
+{
+  sampling_active = TRUE;
+  sampling_stream = stream;
+  if (rate)
+    sampling_rate = rate;
+}
+
+/* Start the timer. This must be called after setup_vm(), since it
+   needs to know the stack size. */
+int init_sampler()
+{
+  struct sigaction act;
+  struct itimerval timer;
+  glui32 ix;
+
+  if (!sampling_active)
+    return TRUE;
+
+  samples = (stacksample_t **)glulx_malloc(SAMPLE_HASH_SIZE
+    * sizeof(stacksample_t *));
+  sample_frames = (glui32 *)glulx_malloc((stacksize/4) * sizeof(glui32));
+  if (!samples || !sample_frames)
+    return FALSE;
+
+  for (ix=0; ix<SAMPLE_HASH_SIZE; ix++)
+    samples[ix] = NULL;
+  sample_reset_frames();
+
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = sample_signal;
+  sigemptyset(&act.sa_mask);
+  act.sa_flags = SA_RESTART;
+  if (sigaction(SIGPROF, &act, NULL))
+    return FALSE;
+
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 1000000 / sampling_rate;
+  if (timer.it_interval.tv_usec == 0)
+    timer.it_interval.tv_usec = 1;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, NULL))
+    return FALSE;
+
+  return TRUE;
+}
+
+static void sample_signal(int sig)
+{
+  sample_pending = 1;
+}
+
+/* Forget which function owns each call frame. This is called
+   whenever the stack is replaced wholesale. */
+void sample_reset_frames()
+{
+  if (!sample_frames)
+    return;
+  memset(sample_frames, 0, (stacksize/4) * sizeof(glui32));
+}
+
+/* sample_take():
+   Record the current call stack. This is called from the main loop
+   (via the sample_tick() macro) when the timer has gone off.
+*/
+void sample_take()
+{
+  glui32 funcs[SAMPLE_MAX_DEPTH];
+  glui32 fp, curpc, newfp, hash;
+  int depth, truncated, bucknum;
+  stacksample_t *samp;
+
+  sample_pending = 0;
+  if (!samples)
+    return;
+
+  fp = frameptr;
+  curpc = pc;
+  depth = 0;
+  truncated = FALSE;
+  hash = 2166136261U;
+
+  while (1) {
+    if (depth >= SAMPLE_MAX_DEPTH) {
+      truncated = TRUE;
+      break;
+    }
+    funcs[depth] = frame_function(fp, curpc);
+    hash = (hash ^ funcs[depth]) * 16777619U;
+    depth++;
+
+    /* The call stub below this frame holds the caller's PC and
+       frameptr. The first frame has no stub. */
+    if (fp < 16)
+      break;
+    newfp = Stk4(fp-4);
+    curpc = Stk4(fp-8);
+    if (newfp >= fp)
+      break;
+    fp = newfp;
+  }
+
+  bucknum = (hash % SAMPLE_HASH_SIZE);
+  for (samp = samples[bucknum]; samp; samp = samp->next) {
+    if (samp->hash == hash && samp->depth == depth
+      && samp->truncated == truncated
+      && !memcmp(samp->funcs, funcs, depth * sizeof(glui32)))
+      break;
+  }
+
+  if (!samp) {
+    samp = (stacksample_t *)glulx_malloc(sizeof(stacksample_t));
+    if (!samp)
+      fatal_error("Sampler: cannot malloc sample.");
+    samp->funcs = (glui32 *)glulx_malloc(depth * sizeof(glui32));
+    if (!samp->funcs)
+      fatal_error("Sampler: cannot malloc sample.");
+    memcpy(samp->funcs, funcs, depth * sizeof(glui32));
+    samp->hash = hash;
+    samp->depth = depth;
+    samp->truncated = truncated;
+    samp->count = 0;
+    samp->next = samples[bucknum];
+    samples[bucknum] = samp;
+  }
+
+  samp->count++;
+}
+
+/* Work out the function address for the frame at fp, which is
+   currently executing at curpc. Returns zero if we can't tell.
+*/
+static glui32 frame_function(glui32 fp, glui32 curpc)
+{
+  glui32 addr = sample_frames[fp >> 2];
+  sampleroutine_t *routine;
+
+  if (addr)
+    return addr;
+  if (fp == 0)
+    return startfuncaddr;
+  routine = find_routine(curpc);
+  if (routine)
+    return routine->address;
+  return 0;
+}
+
+/* sample_quit():
+   Stop the timer and write out the folded stacks.
+*/
+void sample_quit()
+{
+  struct itimerval timer;
+  stacksample_t *samp, *next;
+  char buf[32];
+  int bucknum, ix;
+
+  if (!sampling_active || !samples)
+    return;
+
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+  signal(SIGPROF, SIG_IGN);
+
+  for (bucknum=0; bucknum<SAMPLE_HASH_SIZE; bucknum++) {
+    for (samp = samples[bucknum]; samp; samp = next) {
+      next = samp->next;
+      if (samp->truncated)
+        glk_put_string_stream(sampling_stream, "[truncated];");
+      for (ix=samp->depth-1; ix>=0; ix--) {
+        put_func_name(sampling_stream, samp->funcs[ix]);
+        if (ix)
+          glk_put_char_stream(sampling_stream, ';');
+      }
+      sprintf(buf, " %lu\n", (unsigned long)samp->count);
+      glk_put_string_stream(sampling_stream, buf);
+      glulx_free(samp->funcs);
+      glulx_free(samp);
+    }
+  }
+
+  glk_stream_close(sampling_stream, NULL);
+  sampling_stream = NULL;
+
+  glulx_free(samples);
+  samples = NULL;
+  glulx_free(sample_frames);
+  sample_frames = NULL;
+}
+
+static void put_func_name(strid_t str, glui32 addr)
+{
+  sampleroutine_t *routine;
+  char buf[16];
+
+  if (!addr) {
+    glk_put_string_stream(str, "[unknown]");
+    return;
+  }
+
+  routine = find_routine(addr);
+  if (routine && routine->address == addr) {
+    glk_put_string_stream(str, routine->name);
+    return;
+  }
+
+  sprintf(buf, "0x%06lx", (unsigned long)addr);
+  glk_put_string_stream(str, buf);
+}
+
+static sampleroutine_t *find_routine(glui32 addr)
+{
+  int lo = 0, hi = numroutines;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    sampleroutine_t *routine = &routines[mid];
+    if (addr < routine->address)
+      hi = mid;
+    else if (addr >= routine->endaddress)
+      lo = mid+1;
+    else
+      return routine;
+  }
+
+  return NULL;
+}
+
+/* sample_load_info_chunk():
+   Read routine names from an Inform debug info file (the XML format
+   written by Inform 6.33 and later). Pass the stream, and the position
+   and length of the data; a len of zero means "to the end of the
+   stream". Returns TRUE on success.
+*/
+int sample_load_info_chunk(strid_t stream, glui32 pos, glui32 len)
+{
+  char *buf = NULL;
+  glui32 buflen = 0, bufsize = 0;
+  int res;
+
+  glk_stream_set_position(stream, pos, seekmode_Start);
+
+  while (len == 0 || buflen < len) {
+    glui32 count;
+    if (buflen == bufsize) {
+      char *newbuf;
+      bufsize = (bufsize ? bufsize*2 : 0x10000);
+      newbuf = (char *)glulx_realloc(buf, bufsize);
+      if (!newbuf) {
+        if (buf)
+          glulx_free(buf);
+        return FALSE;
+      }
+      buf = newbuf;
+    }
+    count = bufsize - buflen;
+    if (len && count > len - buflen)
+      count = len - buflen;
+    count = glk_get_buffer_stream(stream, buf+buflen, count);
+    if (count == 0)
+      break;
+    buflen += count;
+  }
+
+  res = parse_info(buf, buflen);
+  if (buf)
+    glulx_free(buf);
+  return res;
+}
+
+/* A very small XML scanner. We only care about the identifier, value,
+   and byte-count children of each <routine> element, so we track the
+   element depth and ignore everything else. */
+static int parse_info(char *buf, glui32 len)
+{
+  char *pos = buf;
+  char *end = buf+len;
+  int depth = 0;
+  int inroutine = FALSE;
+  char *field = NULL;
+  int fieldlen = 0;
+  sampleroutine_t cur;
+  int routinesize = 0;
+  int ix;
+
+  memset(&cur, 0, sizeof(cur));
+
+  while (pos < end) {
+    char *tag, *tagend;
+    int taglen, closing, selfclosing;
+
+    if (*pos != '<') {
+      pos++;
+      continue;
+    }
+
+    if (pos+4 <= end && !strncmp(pos, "<!--", 4)) {
+      for (pos += 4; pos+3 <= end && strncmp(pos, "-->", 3); pos++) { };
+      pos += 3;
+      continue;
+    }
+    if (pos+1 < end && (pos[1] == '?' || pos[1] == '!')) {
+      while (pos < end && *pos != '>')
+        pos++;
+      pos++;
+      continue;
+    }
+
+    tag = pos+1;
+    closing = (tag < end && *tag == '/');
+    if (closing)
+      tag++;
+    for (tagend = tag; tagend < end && *tagend != '>' && *tagend != '/'
+      && *tagend != ' ' && *tagend != '\t' && *tagend != '\n'
+      && *tagend != '\r'; tagend++) { };
+    taglen = tagend - tag;
+    while (tagend < end && *tagend != '>')
+      tagend++;
+    if (tagend >= end)
+      break;
+    selfclosing = (tagend[-1] == '/');
+    pos = tagend+1;
+
+    if (closing) {
+      depth--;
+      if (depth == 1 && inroutine && taglen == 7
+        && !strncmp(tag, "routine", 7)) {
+        inroutine = FALSE;
+        /* An address of 0 is a routine that Inform eliminated. */
+        if (cur.address != 0 && cur.name) {
+          if (numroutines >= routinesize) {
+            sampleroutine_t *newlist;
+            routinesize = (routinesize ? routinesize*2 : 256);
+            newlist = (sampleroutine_t *)glulx_realloc(routines,
+              routinesize * sizeof(sampleroutine_t));
+            if (!newlist)
+              return FALSE;
+            routines = newlist;
+          }
+          routines[numroutines++] = cur;
+        }
+        else if (cur.name) {
+          glulx_free(cur.name);
+        }
+        memset(&cur, 0, sizeof(cur));
+      }
+      continue;
+    }
+
+    if (depth == 1 && taglen == 7 && !strncmp(tag, "routine", 7)) {
+      inroutine = !selfclosing;
+      memset(&cur, 0, sizeof(cur));
+    }
+    else if (depth == 2 && inroutine && !selfclosing) {
+      /* The text content runs up to the next tag. */
+      for (field = pos, fieldlen = 0; pos < end && *pos != '<';
+        pos++, fieldlen++) { };
+      if (taglen == 10 && !strncmp(tag, "identifier", 10) && !cur.name) {
+        cur.name = (char *)glulx_malloc(fieldlen+1);
+        if (!cur.name)
+          return FALSE;
+        /* Spaces and semicolons are separators in the folded format. */
+        for (ix=0; ix<fieldlen; ix++) {
+          char ch = field[ix];
+          cur.name[ix] = ((ch == ';' || ch == ' ' || ch == '\t'
+            || ch == '\n' || ch == '\r') ? '_' : ch);
+        }
+        cur.name[fieldlen] = '\0';
+      }
+      else if (taglen == 5 && !strncmp(tag, "value", 5)) {
+        cur.address = strtoul(field, NULL, 10);
+      }
+      else if (taglen == 10 && !strncmp(tag, "byte-count", 10)) {
+        cur.endaddress = strtoul(field, NULL, 10);
+      }
+    }
+
+    if (!selfclosing)
+      depth++;
+  }
+
+  if (cur.name)
+    glulx_free(cur.name);
+
+  if (numroutines == 0)
+    return FALSE;
+
+  qsort(routines, numroutines, sizeof(sampleroutine_t), sort_routines);
+
+  /* endaddress was read as a length. If it's missing, run up to the
+     next routine. */
+  for (ix=0; ix<numroutines; ix++) {
+    sampleroutine_t *routine = &routines[ix];
+    if (routine->endaddress)
+      routine->endaddress += routine->address;
+    else if (ix+1 < numroutines)
+      routine->endaddress = routines[ix+1].address;
+    else
+      routine->endaddress = routine->address+1;
+  }
+
+  return TRUE;
+}
+
+static int sort_routines(const void *p1, const void *p2)
+{
+  const sampleroutine_t *routine1 = p1;
+  const sampleroutine_t *routine2 = p2;
+
+  if (routine1->address < routine2->address)
+    return -1;
+  if (routine1->address > routine2->address)
+    return 1;
+  return 0;
+}
+
+#else /* VM_SAMPLING */
+
+void setup_sampler(strid_t stream, glui32 rate)
+{
+    /* Sampling is not compiled in. Do nothing. */
+}
+
+int init_sampler()
+{
+    /* Sampling is not compiled in. Do nothing. */
+    return TRUE;
+}
+
+#endif /* VM_SAMPLING */
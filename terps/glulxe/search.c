@@ -3,9 +3,17 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 
+/* Packed arrays of keys (where each struct is just its key) are
+   scanned sixteen bytes at a time, if the compiler offers SSE2. */
+#if defined(__SSE2__) && defined(__GNUC__)
+#define SEARCH_SSE2 (1)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
 #define serop_KeyIndirect (0x01)
 #define serop_ZeroKeyTerminates (0x02)
 #define serop_ReturnIndex (0x04)
@@ -39,6 +47,59 @@
 
 static void fetchkey(unsigned char *keybuf, glui32 key, glui32 keysize, 
   glui32 options);
+static glui32 native_key(unsigned char *keybuf, glui32 keysize);
+static int linear_native(glui32 keyval, unsigned char *keybuf,
+  glui32 keysize, glui32 start, glui32 structsize, glui32 numstructs,
+  glui32 keyoffset, int zeroterm, glui32 *countref);
+
+/* The common key sizes (1, 2, and 4 bytes) are compared as native
+   integers rather than byte by byte. Since keys are big-endian, the
+   integer order is the same as the byte order, which is what
+   binary_search() needs. */
+#define NativeKeySize(keysize) ((keysize) == 1 || (keysize) == 2 || (keysize) == 4)
+#define ReadKey(ptr, keysize)  \
+  ((keysize) == 4 ? Read4(ptr) : ((keysize) == 2 ? Read2(ptr) : Read1(ptr)))
+#define MemKey(adr, keysize)  \
+  ((keysize) == 4 ? Mem4(adr) : ((keysize) == 2 ? Mem2(adr) : Mem1(adr)))
+
+#if SEARCH_MEMO
+
+/* A small direct-mapped memo of recent search results, for searches
+   with native-size keys over tables of known extent. An entry depends
+   only on the memory between start and end, so we watch that range (if
+   it's in RAM) and forget everything when it's written. Forgetting is
+   just a matter of bumping the generation number. */
+
+#define SEARCH_MEMO_SIZE (256)
+
+typedef struct searchmemo_struct {
+  glui32 generation; /* 0 if unused */
+  glui32 key;
+  glui32 start;
+  glui32 structsize;
+  glui32 numstructs;
+  glui32 keyoffset;
+  glui32 kind; /* keysize, options, and which search */
+  glui32 result;
+} searchmemo_t;
+
+#define memokind_Linear (0x100)
+#define memokind_Binary (0x200)
+
+static searchmemo_t searchmemo[SEARCH_MEMO_SIZE];
+static glui32 searchmemo_generation = 1;
+
+glui32 searchmemo_watchstart = 0;
+glui32 searchmemo_watchend = 0;
+
+static searchmemo_t *memo_find(glui32 key, glui32 start,
+  glui32 structsize, glui32 numstructs, glui32 keyoffset, glui32 kind,
+  int *hitref);
+static void memo_store(searchmemo_t *memo, glui32 key, glui32 start,
+  glui32 structsize, glui32 numstructs, glui32 keyoffset, glui32 kind,
+  glui32 result, glui32 lowaddr, glui32 highaddr);
+
+#endif /* SEARCH_MEMO */
 
 /* linear_search():
    An array of data structures is stored in memory, beginning at start,
@@ -67,6 +128,39 @@ glui32 linear_search(glui32 key, glui32 keysize,
 
   fetchkey(keybuf, key, keysize, options);
 
+  if (NativeKeySize(keysize) && structsize) {
+    glui32 keyval = native_key(keybuf, keysize);
+    glui32 result;
+    int found;
+#if SEARCH_MEMO
+    int hit;
+    glui32 kind = memokind_Linear | ((options & 0x0F) << 4) | keysize;
+    searchmemo_t *memo = memo_find(keyval, start, structsize, numstructs,
+      keyoffset, kind, &hit);
+    if (hit)
+      return memo->result;
+#endif /* SEARCH_MEMO */
+
+    found = linear_native(keyval, keybuf, keysize, start, structsize,
+      numstructs, keyoffset, zeroterm, &count);
+    if (found)
+      result = (retindex ? count : start + count*structsize);
+    else
+      result = (retindex ? -1 : 0);
+
+#if SEARCH_MEMO
+    /* The result depends on the keys up to the match, or up to the
+       point where the search gave up. */
+    if (found)
+      count++;
+    if (count)
+      memo_store(memo, keyval, start, structsize, numstructs, keyoffset,
+        kind, result, start+keyoffset,
+        start+keyoffset+(count-1)*structsize+keysize);
+#endif /* SEARCH_MEMO */
+    return result;
+  }
+
   for (count=0; count<numstructs; count++, start+=structsize) {
     int match = TRUE;
     if (keysize <= 4) {
@@ -128,6 +222,46 @@ glui32 binary_search(glui32 key, glui32 keysize,
 
   fetchkey(keybuf, key, keysize, options);
   
+  if (NativeKeySize(keysize)) {
+    glui32 keyval = native_key(keybuf, keysize);
+    glui32 probe;
+    glui32 result = (retindex ? -1 : 0);
+#if SEARCH_MEMO
+    int hit;
+    glui32 kind = memokind_Binary | ((options & 0x0F) << 4) | keysize;
+    searchmemo_t *memo = memo_find(keyval, start, structsize, numstructs,
+      keyoffset, kind, &hit);
+    if (hit)
+      return memo->result;
+#endif /* SEARCH_MEMO */
+
+    bot = 0;
+    top = numstructs;
+    while (bot < top) {
+      val = (top+bot) / 2;
+      addr = start + val * structsize;
+      probe = MemKey(addr + keyoffset, keysize);
+      if (probe == keyval) {
+        result = (retindex ? val : addr);
+        break;
+      }
+      if (probe < keyval)
+        bot = val+1;
+      else
+        top = val;
+    }
+
+#if SEARCH_MEMO
+    /* The result depends on the whole table (as long as its size is
+       sane). */
+    if (numstructs && numstructs-1 <= endmem / (structsize ? structsize : 1))
+      memo_store(memo, keyval, start, structsize, numstructs, keyoffset,
+        kind, result, start+keyoffset,
+        start+keyoffset+(numstructs-1)*structsize+keysize);
+#endif /* SEARCH_MEMO */
+    return result;
+  }
+
   bot = 0;
   top = numstructs;
   while (bot < top) {
@@ -195,6 +329,19 @@ glui32 linked_search(glui32 key, glui32 keysize,
 
   fetchkey(keybuf, key, keysize, options);
 
+  if (NativeKeySize(keysize)) {
+    glui32 keyval = native_key(keybuf, keysize);
+    while (start != 0) {
+      val = MemKey(start + keyoffset, keysize);
+      if (val == keyval)
+        return start;
+      if (zeroterm && val == 0)
+        break;
+      start = Mem4(start + nextoffset);
+    }
+    return 0;
+  }
+
   while (start != 0) {
     int match = TRUE;
     if (keysize <= 4) {
@@ -264,3 +411,205 @@ static void fetchkey(unsigned char *keybuf, glui32 key, glui32 keysize,
     }
   }
 }
+
+/* native_key():
+   Turn a fetched key of 1, 2, or 4 bytes into an integer.
+*/
+static glui32 native_key(unsigned char *keybuf, glui32 keysize)
+{
+  return ReadKey(keybuf, keysize);
+}
+
+#if SEARCH_SSE2
+
+/* packed_skip():
+   Given limit keys packed together at ptr, return how many of them
+   can be skipped because they match neither the key nor (if zeroterm)
+   zero. This stops at the first sixteen-byte block containing a
+   candidate; the caller checks the rest one key at a time.
+*/
+static glui32 packed_skip(unsigned char *keybuf, glui32 keysize,
+  unsigned char *ptr, glui32 limit, int zeroterm)
+{
+  __m128i keyvec, vec, hits;
+  __m128i zerovec = _mm_setzero_si128();
+  glui32 per = 16 / keysize;
+  glui32 count = 0;
+  glui16 key16;
+  glui32 key32;
+
+  switch (keysize) {
+  case 1:
+    keyvec = _mm_set1_epi8((char)keybuf[0]);
+    break;
+  case 2:
+    memcpy(&key16, keybuf, 2);
+    keyvec = _mm_set1_epi16((short)key16);
+    break;
+  default:
+    memcpy(&key32, keybuf, 4);
+    keyvec = _mm_set1_epi32((int)key32);
+    break;
+  }
+
+#define PACKED_LOOP(cmpeq)  \
+  for (; count+per <= limit; count += per, ptr += 16) {  \
+    vec = _mm_loadu_si128((__m128i *)ptr);  \
+    hits = cmpeq(vec, keyvec);  \
+    if (zeroterm)  \
+      hits = _mm_or_si128(hits, cmpeq(vec, zerovec));  \
+    if (_mm_movemask_epi8(hits))  \
+      break;  \
+  }
+
+  switch (keysize) {
+  case 1:
+    PACKED_LOOP(_mm_cmpeq_epi8);
+    break;
+  case 2:
+    PACKED_LOOP(_mm_cmpeq_epi16);
+    break;
+  default:
+    PACKED_LOOP(_mm_cmpeq_epi32);
+    break;
+  }
+
+#undef PACKED_LOOP
+
+  return count;
+}
+
+#endif /* SEARCH_SSE2 */
+
+/* linear_native():
+   The body of linear_search() for native-size keys. Returns TRUE if
+   the key is found, with its index in *countref. Otherwise, returns
+   FALSE with the number of structs examined in *countref.
+*/
+static int linear_native(glui32 keyval, unsigned char *keybuf,
+  glui32 keysize, glui32 start, glui32 structsize, glui32 numstructs,
+  glui32 keyoffset, int zeroterm, glui32 *countref)
+{
+  glui32 base = start + keyoffset;
+  glui32 avail, limit, count, addr;
+
+  /* Work out how many keys lie entirely within memory, so that we
+     don't have to check each address as we go. */
+  if (base > endmem || endmem - base < keysize)
+    avail = 0;
+  else
+    avail = (endmem - base - keysize) / structsize + 1;
+  limit = (numstructs < avail) ? numstructs : avail;
+
+  count = 0;
+#if SEARCH_SSE2
+  if (structsize == keysize)
+    count = packed_skip(keybuf, keysize, memmap+base, limit, zeroterm);
+#endif /* SEARCH_SSE2 */
+
+#define LINEAR_LOOP(readkey)  \
+  for (addr = base + count*structsize; count < limit;  \
+       count++, addr += structsize) {  \
+    glui32 val = readkey(memmap+addr);  \
+    if (val == keyval) {  \
+      *countref = count;  \
+      return TRUE;  \
+    }  \
+    if (zeroterm && val == 0) {  \
+      *countref = count+1;  \
+      return FALSE;  \
+    }  \
+  }
+
+  switch (keysize) {
+  case 1:
+    LINEAR_LOOP(Read1);
+    break;
+  case 2:
+    LINEAR_LOOP(Read2);
+    break;
+  default:
+    LINEAR_LOOP(Read4);
+    break;
+  }
+
+#undef LINEAR_LOOP
+
+  /* The search ran off the end of memory. */
+  if (limit < numstructs)
+    fatal_error_i("Memory access out of range", base + limit*structsize);
+
+  *countref = count;
+  return FALSE;
+}
+
+#if SEARCH_MEMO
+
+static searchmemo_t *memo_find(glui32 key, glui32 start,
+  glui32 structsize, glui32 numstructs, glui32 keyoffset, glui32 kind,
+  int *hitref)
+{
+  searchmemo_t *memo;
+  glui32 hash;
+
+  hash = start ^ (key * 2654435761U) ^ (keyoffset << 7) ^ kind;
+  hash ^= (hash >> 16);
+  memo = &searchmemo[hash & (SEARCH_MEMO_SIZE-1)];
+
+  *hitref = (memo->generation == searchmemo_generation
+    && memo->key == key && memo->start == start
+    && memo->kind == kind && memo->structsize == structsize
+    && memo->numstructs == numstructs && memo->keyoffset == keyoffset);
+  return memo;
+}
+
+static void memo_store(searchmemo_t *memo, glui32 key, glui32 start,
+  glui32 structsize, glui32 numstructs, glui32 keyoffset, glui32 kind,
+  glui32 result, glui32 lowaddr, glui32 highaddr)
+{
+  /* Don't bother with tables that wrap around the address space. */
+  if (highaddr < lowaddr)
+    return;
+
+  memo->generation = searchmemo_generation;
+  memo->key = key;
+  memo->start = start;
+  memo->structsize = structsize;
+  memo->numstructs = numstructs;
+  memo->keyoffset = keyoffset;
+  memo->kind = kind;
+  memo->result = result;
+
+  /* Tables in ROM can't change. */
+  if (highaddr <= ramstart)
+    return;
+
+  if (searchmemo_watchend == 0) {
+    searchmemo_watchstart = lowaddr;
+    searchmemo_watchend = highaddr;
+  }
+  else {
+    if (lowaddr < searchmemo_watchstart)
+      searchmemo_watchstart = lowaddr;
+    if (highaddr > searchmemo_watchend)
+      searchmemo_watchend = highaddr;
+  }
+}
+
+/* search_memo_invalidate():
+   Forget all memoized search results. This is called by the MemW
+   macros when a write lands in a memoized table, and whenever RAM is
+   replaced wholesale.
+*/
+void search_memo_invalidate()
+{
+  searchmemo_generation++;
+  if (searchmemo_generation == 0) {
+    memset(searchmemo, 0, sizeof(searchmemo));
+    searchmemo_generation = 1;
+  }
+  searchmemo_watchstart = 0;
+  searchmemo_watchend = 0;
+}
+
+#endif /* SEARCH_MEMO */
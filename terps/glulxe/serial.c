@@ -1101,6 +1101,7 @@ static glui32 read_stackstate(dest_t *dest, glui32 chunklen, int portable)
   frameptr = 0;
   valstackbase = 0;
   localsbase = 0;
+  sample_reset_frames();
 
   if (!portable) {
     res = read_buffer(dest, stack, stackptr);
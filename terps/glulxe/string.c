@@ -13,12 +13,15 @@ static glui32 iosys_rock;
 #define iosys_Filter (1)
 #define iosys_Glk (2)
 
-#define CACHEBITS (4)
+/* The decoding cache resolves CACHEBITS bits of the compressed stream
+   per table lookup. Eight bits keeps the readahead logic in
+   stream_string() down to a single extra byte. */
+#define CACHEBITS (8)
 #define CACHESIZE (1<<CACHEBITS) 
-#define CACHEMASK (15)
+#define CACHEMASK (CACHESIZE-1)
 
 typedef struct cacheblock_struct {
-  int depth; /* 1 to 4 */
+  int depth; /* 1 to CACHEBITS */
   int type;
   union {
     struct cacheblock_struct *branches;
@@ -28,10 +31,34 @@ typedef struct cacheblock_struct {
   } u;
 } cacheblock_t;
 
-/* The current string-decoding tables, broken out into a fast and
-   easy-to-use form. */
-static int tablecache_valid = FALSE;
-static cacheblock_t tablecache;
+/* A string-decoding table, broken out into a fast and easy-to-use
+   form. We keep a few of these around, so that a game which switches
+   between tables with @setstringtbl doesn't rebuild them every time.
+   Tables that live in RAM are dropped when any part of them is
+   written; see tablecache_watchstart and stream_cache_invalidate(). */
+typedef struct tablecache_struct {
+  glui32 addr; /* 0 if this slot is unused */
+  glui32 endaddr;
+  glui32 lastuse;
+  cacheblock_t root;
+} tablecache_t;
+
+#define TABLECACHE_COUNT (4)
+
+static tablecache_t tablecaches[TABLECACHE_COUNT];
+static glui32 tablecache_counter = 0;
+
+/* The cache entry for the current stringtable, or NULL if there is
+   none. If tablecache_stale is set, the entry was dropped (or never
+   built) and we should try again the next time a string is decoded. */
+static tablecache_t *curtablecache = NULL;
+static int tablecache_stale = FALSE;
+
+/* The range of memory covered by cached tables in RAM. Every memory
+   write is checked against this (see MemW1() in glulxe.h), so it is
+   an empty range whenever no RAM table is cached. */
+glui32 tablecache_watchstart = 0;
+glui32 tablecache_watchend = 0;
 
 static void stream_setup_unichar(void);
 
@@ -42,6 +69,9 @@ static void filio_unichar_han(glui32 ch);
 static void glkio_unichar_nouni_han(glui32 val);
 static void (*glkio_unichar_han_ptr)(glui32 val) = NULL;
 
+static tablecache_t *find_tablecache(glui32 addr);
+static void drop_tablecache(tablecache_t *tab);
+static void set_watch_range(void);
 static void dropcache(cacheblock_t *cablist);
 static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
   int mask, int recdepth);
@@ -226,7 +256,12 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
     }
 
     if (type == 0xE1) {
-      if (tablecache_valid) {
+      if (tablecache_stale) {
+        tablecache_stale = FALSE;
+        curtablecache = find_tablecache(stringtable);
+      }
+      if (curtablecache) {
+        cacheblock_t *root = &(curtablecache->root);
         int bits, numbits;
         int readahead;
         glui32 tmpaddr;
@@ -240,7 +275,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
         numbits = (8 - bitnum);
         readahead = FALSE;
 
-        if (tablecache.type != 0) {
+        if (root->type != 0) {
           /* This is a bit of a cheat. If the top-level block is not
              a branch, then it must be a string-terminator -- otherwise
              the string would be an infinite repetition of that block.
@@ -248,13 +283,14 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
           done = 1;
         }
 
-        cablist = tablecache.u.branches;
+        cablist = root->u.branches;
         while (!done) {
           cacheblock_t *cab;
 
           if (numbits < CACHEBITS) {
-            /* readahead is certainly false */
-            int newbyte = Mem1(addr+1);
+            /* readahead is certainly false. The string may end in the
+               last byte of memory, so don't read past that. */
+            int newbyte = (addr+1 < endmem) ? Mem1(addr+1) : 0;
             bits |= (newbyte << numbits);
             numbits += 8;
             readahead = TRUE;
@@ -271,7 +307,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               readahead = FALSE;
             }
             else {
-              int newbyte = Mem1(addr);
+              int newbyte = (addr < endmem) ? Mem1(addr) : 0;
               bits |= (newbyte << numbits);
               numbits += 8;
             }
@@ -300,7 +336,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
+            cablist = root->u.branches;
             break;
           case 0x04: /* single Unicode character */
             switch (iosys_mode) {
@@ -318,14 +354,14 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
+            cablist = root->u.branches;
             break;
           case 0x03: /* C string */
             switch (iosys_mode) {
             case iosys_Glk:
               for (tmpaddr=cab->u.addr; (ch=Mem1(tmpaddr)) != '\0'; tmpaddr++) 
                 glk_put_char(ch);
-              cablist = tablecache.u.branches; 
+              cablist = root->u.branches; 
               break;
             case iosys_Filter:
               if (!substring) {
@@ -339,7 +375,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               done = 2;
               break;
             default:
-              cablist = tablecache.u.branches; 
+              cablist = root->u.branches; 
               break;
             }
             break;
@@ -348,7 +384,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             case iosys_Glk:
               for (tmpaddr=cab->u.addr; (ival=Mem4(tmpaddr)) != 0; tmpaddr+=4) 
                 glkio_unichar_han_ptr(ival);
-              cablist = tablecache.u.branches; 
+              cablist = root->u.branches; 
               break;
             case iosys_Filter:
               if (!substring) {
@@ -362,7 +398,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               done = 2;
               break;
             default:
-              cablist = tablecache.u.branches; 
+              cablist = root->u.branches; 
               break;
             }
             break;
@@ -679,36 +715,130 @@ glui32 stream_get_table()
 }
 
 /* stream_set_table():
-   Set the current table address, and rebuild decoding cache. 
+   Set the current table address. The decoding cache is found (or
+   built) when the first compressed string is printed, since a game may
+   set a table in RAM before it has finished filling it in.
 */
 void stream_set_table(glui32 addr)
 {
   if (stringtable == addr)
     return;
 
-  /* Drop cache. */
-  if (tablecache_valid) {
-    if (tablecache.type == 0)
-      dropcache(tablecache.u.branches);
-    tablecache.u.branches = NULL;
-    tablecache_valid = FALSE;
+  stringtable = addr;
+  curtablecache = NULL;
+  tablecache_stale = (stringtable != 0);
+}
+
+/* stream_cache_invalidate():
+   Drop any cached decoding table which overlaps the given range of
+   memory. This is called by the MemW macros when a write lands in the
+   watched range, and by vm_restart() when all of RAM is reloaded.
+   The current table's cache will be rebuilt the next time a
+   compressed string is printed.
+*/
+void stream_cache_invalidate(glui32 addr, glui32 len)
+{
+  int ix;
+  glui32 endaddr = addr+len;
+
+  if (endaddr < addr)
+    endaddr = 0xFFFFFFFF;
+
+  for (ix=0; ix<TABLECACHE_COUNT; ix++) {
+    tablecache_t *tab = &(tablecaches[ix]);
+    if (!tab->addr || tab->endaddr <= ramstart)
+      continue;
+    if (addr < tab->endaddr && endaddr > tab->addr) {
+      if (tab == curtablecache) {
+        curtablecache = NULL;
+        tablecache_stale = TRUE;
+      }
+      drop_tablecache(tab);
+    }
   }
 
-  stringtable = addr;
+  set_watch_range();
+}
+
+/* find_tablecache():
+   Return the decoding cache for the table at addr, building it if
+   necessary. Returns NULL if the table can't be cached.
+*/
+static tablecache_t *find_tablecache(glui32 addr)
+{
+  int ix;
+  glui32 tablelen, rootaddr;
+  tablecache_t *tab = NULL;
+
+  tablecache_counter++;
 
-  if (stringtable) {
-    /* Build cache. We can only do this if the table is entirely in ROM. */
-    glui32 tablelen = Mem4(stringtable);
-    glui32 rootaddr = Mem4(stringtable+8);
-    int cache_stringtable = (stringtable+tablelen <= ramstart);
-    /* cache_stringtable = TRUE; ...for testing only */
-    /* cache_stringtable = FALSE; ...for testing only */
-    if (cache_stringtable) {
-      buildcache(&tablecache, rootaddr, CACHEBITS, 0, 0);
-      /* dumpcache(&tablecache, 1, 0); */
-      tablecache_valid = TRUE;
+  for (ix=0; ix<TABLECACHE_COUNT; ix++) {
+    if (tablecaches[ix].addr == addr) {
+      tab = &(tablecaches[ix]);
+      tab->lastuse = tablecache_counter;
+      return tab;
     }
   }
+
+  tablelen = Mem4(addr);
+  rootaddr = Mem4(addr+8);
+  /* The table must lie entirely within memory; otherwise leave it to
+     the uncached decoder, which will complain at the bad address. */
+  if (tablelen < 12 || addr+tablelen < addr || addr+tablelen > endmem)
+    return NULL;
+
+  /* Replace an empty slot, or else the least recently used one. */
+  for (ix=0; ix<TABLECACHE_COUNT; ix++) {
+    if (!tablecaches[ix].addr) {
+      tab = &(tablecaches[ix]);
+      break;
+    }
+    if (!tab || tablecaches[ix].lastuse < tab->lastuse)
+      tab = &(tablecaches[ix]);
+  }
+  if (tab->addr)
+    drop_tablecache(tab);
+
+  buildcache(&(tab->root), rootaddr, CACHEBITS, 0, 0);
+  /* dumpcache(&(tab->root), 1, 0); */
+  tab->addr = addr;
+  tab->endaddr = addr+tablelen;
+  tab->lastuse = tablecache_counter;
+
+  set_watch_range();
+  return tab;
+}
+
+static void drop_tablecache(tablecache_t *tab)
+{
+  if (tab->root.type == 0)
+    dropcache(tab->root.u.branches);
+  tab->root.u.branches = NULL;
+  tab->addr = 0;
+  tab->endaddr = 0;
+}
+
+/* set_watch_range():
+   Recompute the range of memory which must be watched for writes: the
+   smallest range covering every cached table that extends into RAM.
+*/
+static void set_watch_range()
+{
+  int ix;
+  glui32 start = 0, end = 0;
+
+  for (ix=0; ix<TABLECACHE_COUNT; ix++) {
+    tablecache_t *tab = &(tablecaches[ix]);
+    if (!tab->addr || tab->endaddr <= ramstart)
+      continue;
+    if (end == 0 || tab->addr < start)
+      start = tab->addr;
+    if (tab->endaddr > end)
+      end = tab->endaddr;
+  }
+
+  tablecache_watchstart = start;
+  tablecache_watchend = end;
 }
 
 static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
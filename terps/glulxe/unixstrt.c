@@ -49,6 +49,16 @@ glkunix_argumentlist_t glkunix_arguments[] = {
   { "--profcalls", glkunix_arg_NoValue, "Include what-called-what details in profiling. (Slow!)" },
 #endif /* VM_PROFILING */
 
+#if VM_SAMPLING
+  { "--sample", glkunix_arg_ValueFollows, "Write sampled call stacks (flame graph format) to a file." },
+  { "--samplerate", glkunix_arg_ValueFollows, "Samples per second of CPU time (default 99)." },
+  { "--sampleinfo", glkunix_arg_ValueFollows, "Read routine names for sampling from a debug info file." },
+#endif /* VM_SAMPLING */
+
+#if ACCEL_CACHE
+  { "--accelstats", glkunix_arg_ValueFollows, "Write property cache hit/miss counts to a file." },
+#endif /* ACCEL_CACHE */
+
 #if VM_DEBUGGER
   { "--gameinfo", glkunix_arg_ValueFollows, "Read debug information from a file." },
   { "--cpu", glkunix_arg_NoValue, "Display CPU usage of each command (debug)." },
@@ -72,6 +82,9 @@ int glkunix_startup_code(glkunix_startup_t *data)
   int gameinfoloaded = FALSE;
   int pref_autosave = FALSE;
   int pref_autorestore = FALSE;
+  char *samplefilename = NULL;
+  char *sampleinfofilename = NULL;
+  glui32 samplerate = 0;
   unsigned char buf[12];
   int res;
 
@@ -166,6 +179,52 @@ int glkunix_startup_code(glkunix_startup_t *data)
     }
 #endif /* VM_PROFILING */
 
+#if VM_SAMPLING
+    if (!strcmp(data->argv[ix], "--sample")) {
+      ix++;
+      if (ix<data->argc) {
+        samplefilename = data->argv[ix];
+      }
+      continue;
+    }
+    if (!strcmp(data->argv[ix], "--samplerate")) {
+      ix++;
+      if (ix<data->argc) {
+        char *endptr = NULL;
+        int val = strtol(data->argv[ix], &endptr, 10);
+        if (*endptr || val <= 0) {
+          init_err = "--samplerate must be a positive number.";
+          return TRUE;
+        }
+        samplerate = val;
+      }
+      continue;
+    }
+    if (!strcmp(data->argv[ix], "--sampleinfo")) {
+      ix++;
+      if (ix<data->argc) {
+        sampleinfofilename = data->argv[ix];
+      }
+      continue;
+    }
+#endif /* VM_SAMPLING */
+
+#if ACCEL_CACHE
+    if (!strcmp(data->argv[ix], "--accelstats")) {
+      ix++;
+      if (ix<data->argc) {
+        strid_t statstr = glkunix_stream_open_pathname_gen(data->argv[ix], TRUE, FALSE, 1);
+        if (!statstr) {
+          init_err = "Unable to open accelstats output file.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+        setup_accel_stats(statstr);
+      }
+      continue;
+    }
+#endif /* ACCEL_CACHE */
+
 #if VM_DEBUGGER
     if (!strcmp(data->argv[ix], "--gameinfo")) {
       ix++;
@@ -247,6 +306,29 @@ int glkunix_startup_code(glkunix_startup_t *data)
   gidebug_debugging_available(debugger_cmd_handler, debugger_cycle_handler);
 #endif /* VM_DEBUGGER */
 
+#if VM_SAMPLING
+  if (samplefilename) {
+    strid_t samplestr = glkunix_stream_open_pathname_gen(samplefilename, TRUE, TRUE, 1);
+    if (!samplestr) {
+      init_err = "Unable to open sample output file.";
+      init_err2 = samplefilename;
+      return TRUE;
+    }
+    setup_sampler(samplestr, samplerate);
+  }
+  if (samplefilename && sampleinfofilename) {
+    strid_t infostr = glkunix_stream_open_pathname_gen(sampleinfofilename, FALSE, FALSE, 1);
+    if (!infostr) {
+      nonfatal_warning("Unable to open debug info file for sampling.");
+    }
+    else {
+      if (!sample_load_info_chunk(infostr, 0, 0))
+        nonfatal_warning("Unable to parse debug info for sampling.");
+      glk_stream_close(infostr, NULL);
+    }
+  }
+#endif /* VM_SAMPLING */
+
   /* Now we have to check to see if it's a Blorb file. */
 
   glk_stream_set_position(gamefile, 0, seekmode_Start);
@@ -285,6 +367,23 @@ int glkunix_startup_code(glkunix_startup_t *data)
       }
     }
 #endif /* VM_DEBUGGER */
+
+#if VM_SAMPLING
+    /* Take routine names for the sampler from the Blorb, if there
+       wasn't a separate file. */
+    if (samplefilename && !sampleinfofilename) {
+      glui32 giblorb_ID_Dbug = giblorb_make_id('D', 'b', 'u', 'g');
+      giblorb_err_t err;
+      giblorb_result_t blorbres;
+      err = giblorb_load_chunk_by_type(giblorb_get_resource_map(), 
+        giblorb_method_FilePos, 
+        &blorbres, giblorb_ID_Dbug, 0);
+      if (!err && blorbres.length) {
+        if (!sample_load_info_chunk(gamefile, blorbres.data.startpos, blorbres.length))
+          nonfatal_warning("Unable to parse debug info for sampling.");
+      }
+    }
+#endif /* VM_SAMPLING */
     return TRUE;
   }
   else {
@@ -188,6 +188,13 @@ void vm_restart()
     memmap[lx] = 0;
   }
 
+  /* RAM was rewritten behind the back of the MemW macros, so any
+     string-decoding cache, search memo, or property cache built from it
+     is now suspect. */
+  stream_cache_invalidate(ramstart, endmem-ramstart);
+  search_memo_invalidate();
+  accel_cache_invalidate();
+
   /* Reset all the registers */
   stackptr = 0;
   frameptr = 0;
@@ -200,6 +207,8 @@ void vm_restart()
 
   /* Note that we do not reset the protection range. */
 
+  sample_reset_frames();
+
   /* Push the first function call. (No arguments.) */
   enter_function(startfuncaddr, 0, NULL);
 
@@ -241,6 +250,13 @@ glui32 change_memsize(glui32 newlen, int internal)
   }
   memmap = newmemmap;
 
+  /* Cached tables may have fallen off the end of memory. */
+  if (newlen < endmem) {
+    stream_cache_invalidate(newlen, endmem-newlen);
+    search_memo_invalidate();
+    accel_cache_invalidate();
+  }
+
   if (newlen > endmem) {
     for (lx=endmem; lx<newlen; lx++) {
       memmap[lx] = 0;
@@ -47,41 +47,84 @@ unsigned char *os_fill_buffer (unsigned char *buf, size_t len)
 
 #else
 
+/* Line input buffer.  Glk holds onto this while a line request is
+ * pending; we keep it between requests, and only ever grow it. */
 static glui32 *input = 0;
+static glui32 inputmax = 0;
 static glui32 max = 0;
 
+/* Output conversion buffer, kept between calls and grown as needed. */
+static glui32 *output = 0;
+static size_t outputmax = 0;
+
 extern glui32 os_parse_chars(unsigned char *buf, glui32 buflen,
                              glui32 *out, glui32 outlen);
 
 extern glui32 os_prepare_chars (glui32 *buf, glui32 buflen,
                                 unsigned char *out, glui32 outlen);
 
+/* Check whether a buffer is plain 7-bit ASCII.  We test a machine word
+ * at a time, since nearly all game output is ASCII. */
+static int is_ascii (const unsigned char *buf, size_t len)
+{
+    const size_t high = ((size_t)-1 / 0xFF) * 0x80;
+    size_t i = 0;
+
+    for ( ; i + sizeof(size_t) <= len ; i += sizeof(size_t))
+    {
+        size_t w;
+        memcpy(&w, buf + i, sizeof(w));
+        if (w & high)
+            return 0;
+    }
+
+    for ( ; i < len ; i++)
+        if (buf[i] & 0x80)
+            return 0;
+
+    return 1;
+}
+
 void os_put_buffer (unsigned char *buf, size_t len)
 {
-    glui32 *out;
     glui32 outlen;
 
     if (!len)
         return;
 
-    out = malloc(sizeof(glui32)*(len+1));
-    if (!out)
+    /* ASCII reads the same in every character map we support, and Glk
+     * takes it as Latin-1, so there's nothing to convert. */
+    if (is_ascii(buf, len))
+    {
+        glk_put_buffer((char *)buf, len);
         return;
-    outlen = len;
+    }
+
+    if (len + 1 > outputmax)
+    {
+        glui32 *out = realloc(output, sizeof(glui32)*(len+1));
+        if (!out)
+            return;
+        output = out;
+        outputmax = len + 1;
+    }
 
-    outlen = os_parse_chars(buf, len, out, outlen);
+    outlen = os_parse_chars(buf, len, output, len);
 
     if (outlen)
-        glk_put_buffer_uni(out, outlen);
+        glk_put_buffer_uni(output, outlen);
     else
         glk_put_buffer((char *)buf, len);
-
-    free(out);
 }
 
 void os_get_buffer (unsigned char *buf, size_t len, size_t init)
 {
-    input = malloc(sizeof(glui32)*(len+1));
+    if (len + 1 > inputmax)
+    {
+        free(input);
+        input = malloc(sizeof(glui32)*(len+1));
+        inputmax = input ? len + 1 : 0;
+    }
     max = len;
 
     if (init)
@@ -95,8 +138,6 @@ unsigned char *os_fill_buffer (unsigned char *buf, size_t len)
     glui32 res = os_prepare_chars(input, len, buf, max);
     buf[res] = '\0';
 
-    free(input);
-    input = 0;
     max = 0;
 
     return buf;
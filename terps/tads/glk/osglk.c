@@ -618,6 +618,35 @@ int os_askfile(const char *prompt, char *fname_buf, int fname_buf_len,
 #endif
 }
 
+/*
+ *   Idle-time work.  While the hook has work to do, we poll for events
+ *   between slices of it rather than blocking in glk_select(), so that
+ *   the work gets done while the player is typing.  
+ */
+int (*os_idle_hook)(int finish) = NULL;
+
+static void os_idle_select(event_t *event)
+{
+    if (os_idle_hook)
+    {
+        while (os_idle_hook(FALSE))
+        {
+            glk_select_poll(event);
+            if (event->type != evtype_None)
+                return;
+        }
+    }
+
+    glk_select(event);
+}
+
+/* finish any idle-time work before returning input to the caller */
+static void os_idle_finish(void)
+{
+    if (os_idle_hook)
+        os_idle_hook(TRUE);
+}
+
 /* 
  *   Read a string of input.  Fills in the buffer with a null-terminated
  *   string containing a line of text read from the standard input.  The
@@ -633,12 +662,14 @@ unsigned char *os_gets(unsigned char *buf, size_t buflen)
 
     do
     {
-        glk_select(&event);
+        os_idle_select(&event);
         if (event.type == evtype_Arrange)
             redraw_windows();
     }
     while (event.type != evtype_LineInput);
 
+    os_idle_finish();
+
     return os_fill_buffer(buf, event.val1);
 }
 
@@ -750,7 +781,7 @@ int os_gets_timeout(unsigned char *buf, size_t bufl,
 
     do
     {
-        glk_select(&event);
+        os_idle_select(&event);
         if (event.type == evtype_Arrange)
             redraw_windows();
         else if (event.type == evtype_Timer && (timeout = 1))
@@ -758,6 +789,8 @@ int os_gets_timeout(unsigned char *buf, size_t bufl,
     }
     while (event.type != evtype_LineInput);
 
+    os_idle_finish();
+
     unsigned char *res = os_fill_buffer(buf, event.val1);
 
     /* stop timer and turn on line echo */
@@ -902,6 +935,7 @@ static int glktotads(unsigned int key)
 static int bufchar = 0;
 static int waitchar = 0;
 static int timechar = 0;
+static int idlechar = 0;
 
 static int getglkchar(void)
 {
@@ -913,7 +947,10 @@ static int getglkchar(void)
 
     do
     {
-        glk_select(&event);
+        if (idlechar)
+            os_idle_select(&event);
+        else
+            glk_select(&event);
         if (event.type == evtype_Arrange)
             redraw_windows();
         else if (event.type == evtype_Timer)
@@ -1021,10 +1058,13 @@ int os_get_event(unsigned long timeout_in_milliseconds, int use_timeout,
         return OS_EVT_NOTIMEOUT;
 #endif
 
-    /* get a key */
+    /* get a key, doing idle-time work while we wait */
+    idlechar = 1;
     info->key[0] = os_getc_raw();
     if (info->key[0] == 0 && timechar == 0)
         info->key[1] = os_getc_raw();
+    idlechar = 0;
+    os_idle_finish();
 
 #ifdef GLK_TIMERS
     /* stop timer */
@@ -39,6 +39,7 @@
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
+#include <io.h>
 #else
 #include <dirent.h>
 #endif
@@ -219,6 +220,14 @@ typedef FILE osfildef;
 /* Flush buffered writes to a file. */
 #define osfflush fflush
 
+/* Flush buffered writes to a file all the way through to the disk.
+ * Returns zero on success, like osfflush(). */
+#ifdef _WIN32
+#define osfsync(fp) (fflush(fp) != 0 || _commit(_fileno(fp)) != 0)
+#else
+#define osfsync(fp) (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+#endif
+
 /* Read bytes from file. */
 #define osfrb(fp,buf,bufl) (fread((buf),(bufl),1,(fp))!=1)
 
@@ -247,6 +256,16 @@ typedef FILE osfildef;
 /* Rename a file. */
 #define os_rename_file(from, to) (rename(from, to) == 0)
 
+/* Rename a file, replacing any existing file of the new name in one
+ * step.  rename() does this on POSIX systems, but not on Windows. */
+#ifdef _WIN32
+#define os_replace_file(from, to) \
+    (MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING \
+                 | MOVEFILE_WRITE_THROUGH) != 0)
+#else
+#define os_replace_file(from, to) (rename(from, to) == 0)
+#endif
+
 /* Get a file's stat() type. */
 struct os_file_stat_t;
 int os_file_stat( const char* fname, int follow_links,
@@ -330,6 +349,13 @@ void os_put_buffer (unsigned char *buf, size_t len);
 void os_get_buffer (unsigned char *buf, size_t len, size_t init);
 unsigned char *os_fill_buffer (unsigned char *buf, size_t len);
 
+/* Idle-time work hook.  The T3 runtime sets this while a game is running
+ * so that it can collect garbage while we wait for input.  We call it
+ * with finish == 0 repeatedly while waiting, for as long as it returns
+ * true to say it has more work to do, and with finish == 1 before we
+ * return the input to the caller. */
+extern int (*os_idle_hook)(int finish);
+
 #define OS_MAXWIDTH 255
 
 #define OS_ATTR_HILITE  OS_ATTR_BOLD
@@ -39,6 +39,8 @@
 #include "vmvsn.h"
 #include "vmmaincn.h"
 #include "vmhostsi.h"
+#include "vmglob.h"
+#include "vmobj.h"
 
 /* ------------------------------------------------------------------------ */
 
@@ -99,13 +101,70 @@ static int main_t2(int argc, char **argv)
     return stat;
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Idle-time garbage collection.  The OS layer calls this while it waits
+ *   for input, so that the collector runs while the player is typing
+ *   rather than in the middle of a turn.  
+ */
+static struct vm_globals *idle_vmg = 0;
+
+static int t3_idle_gc(int finish)
+{
+    /* set up for global access */
+    VMGLOB_PTR(idle_vmg);
+
+    /* finish the pass before the VM gets control back */
+    if (finish)
+    {
+        G_obj_table->gc_idle_finish(vmg0_);
+        return FALSE;
+    }
+
+    /* run the next slice */
+    return G_obj_table->gc_idle_step(vmg0_);
+}
+
+/*
+ *   Client services interface - the standard console version, plus the
+ *   idle-time hook, which we install for as long as the VM is running 
+ */
+class CVmMainClientGlk: public CVmMainClientConsole
+{
+public:
+    void client_init(struct vm_globals *vmg,
+                     const char *script_file, int script_quiet,
+                     const char *log_file,
+                     const char *cmd_log_file,
+                     const char *banner_str,
+                     int more_mode)
+    {
+        CVmMainClientConsole::client_init(vmg, script_file, script_quiet,
+                                          log_file, cmd_log_file,
+                                          banner_str, more_mode);
+
+        /* install the idle-time garbage collector */
+        idle_vmg = vmg;
+        os_idle_hook = t3_idle_gc;
+    }
+
+    void client_terminate(struct vm_globals *vmg)
+    {
+        /* remove the idle-time garbage collector */
+        os_idle_hook = 0;
+        idle_vmg = 0;
+
+        CVmMainClientConsole::client_terminate(vmg);
+    }
+};
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Invoke the T3 VM with the given command-line arguments
  */
 static int main_t3(int argc, char **argv)
 {
-    CVmMainClientConsole clientifc;
+    CVmMainClientGlk clientifc;
     int stat;
     CVmHostIfc *hostifc = new CVmHostIfcStdio(argv[0]);
 
@@ -66,6 +66,9 @@ CVmBifTADSGlobals::CVmBifTADSGlobals(VMG0_)
     rex_parser = new CRegexParser();
     rex_searcher = new CRegexSearcherSimple(rex_parser);
 
+    /* create the compiled pattern cache */
+    rex_cache = new CRegexCache(rex_parser, VMBIFTADS_REX_CACHE_SIZE);
+
     /* 
      *   Allocate a global variable to hold the most recent regular
      *   expression search string.  We need this in a global so that the last
@@ -104,7 +107,8 @@ CVmBifTADSGlobals::CVmBifTADSGlobals(VMG0_)
  */
 CVmBifTADSGlobals::~CVmBifTADSGlobals()
 {
-    /* delete our regular expression searcher and parser */
+    /* delete our regular expression cache, searcher, and parser */
+    delete rex_cache;
     delete rex_searcher;
     delete rex_parser;
 
@@ -2433,6 +2437,7 @@ void CVmBifTADS::re_match(VMG_ uint argc)
     int start_idx;
     CVmObjPattern *pat_obj = 0;
     const char *pat_str = 0;
+    re_cached_pattern *cpat;
     
     /* check arguments */
     check_argc_range(vmg_ argc, 2, 3);
@@ -2506,9 +2511,20 @@ void CVmBifTADS::re_match(VMG_ uint argc)
                     match_pattern(pat_obj->get_pattern(vmg0_),
                                   str + VMB_LEN, p.getptr(), len);
     }
+    else if ((cpat = G_bif_tads_globals->rex_cache->get(
+        pat_str + VMB_LEN, vmb_get_len(pat_str))) != 0)
+    {
+        /* match the cached compiled pattern for the string */
+        match_len = G_bif_tads_globals->rex_searcher->
+                    match_pattern(cpat->pat, str + VMB_LEN, p.getptr(), len);
+        G_bif_tads_globals->rex_cache->release(cpat);
+    }
     else
     {
-        /* match the pattern to the regular expression string */
+        /* 
+         *   the string doesn't compile - let the searcher handle the error
+         *   the same way it always has 
+         */
         match_len = G_bif_tads_globals->rex_searcher->
                     compile_and_match(pat_str + VMB_LEN, vmb_get_len(pat_str),
                                       str + VMB_LEN, p.getptr(), len);
@@ -2573,6 +2589,7 @@ template<int dir> inline void CVmBifTADS::re_search_common(VMG_ uint argc)
     /* check to see if we have a RexPattern object or an uncompiled string */
     const char *pat_str = 0;
     CVmObjPattern *pat_obj = 0;
+    re_cached_pattern *cpat;
     if (G_stk->get(0)->typ == VM_OBJ
         && CVmObjPattern::is_pattern_obj(vmg_ G_stk->get(0)->val.obj))
     {
@@ -2616,9 +2633,21 @@ template<int dir> inline void CVmBifTADS::re_search_common(VMG_ uint argc)
                  pat_obj->get_pattern(vmg0_),
                  str + VMB_LEN, p.getptr(), len, &match_len));
     }
+    else if ((cpat = G_bif_tads_globals->rex_cache->get(
+        pat_str + VMB_LEN, vmb_get_len(pat_str))) != 0)
+    {
+        /* search for the cached compiled pattern for the string */
+        match_idx =
+            (dir > 0
+             ? G_bif_tads_globals->rex_searcher->search_for_pattern(
+                 cpat->pat, str + VMB_LEN, p.getptr(), len, &match_len)
+             : G_bif_tads_globals->rex_searcher->search_back_for_pattern(
+                 cpat->pat, str + VMB_LEN, p.getptr(), len, &match_len));
+        G_bif_tads_globals->rex_cache->release(cpat);
+    }
     else
     {
-        /* try finding the regular expression string pattern */
+        /* the string doesn't compile - let the searcher report failure */
         match_idx =
             (dir > 0
              ? G_bif_tads_globals->rex_searcher->compile_and_search(
@@ -2908,35 +2937,17 @@ void CVmBifTADS::save(VMG_ uint argc)
         vmg_ filespec, &rc, NETF_WRITE | NETF_CREATE | NETF_TRUNC,
         OSFTT3SAV, "application/x-t3vm-state");
 
-    /* open the file and save the game */
-    CVmFile *file = 0;
+    /* save the game */
     err_try
     {
         /* validate file safety */
         CVmObjFile::check_safety_for_open(vmg_ netfile, VMOBJFILE_ACCESS_WRITE);
 
-        /* open the file */
-        osfildef *fp = osfoprwtb(netfile->lclfname, OSFTT3SAV);
-        if (fp == 0)
-            err_throw(VMERR_CREATE_FILE);
-
-        /* set up the file writer */
-        file = new CVmFile();
-        file->set_file(fp, 0);
-
         /* save the state */
-        CVmSaveFile::save(vmg_ file, metatab);
-
-        /* close the file */
-        delete file;
-        file = 0;
+        CVmSaveFile::save(vmg_ netfile->lclfname, metatab);
     }
     err_catch_disc
     {
-        /* close the file if it's still open */
-        if (file != 0)
-            delete file;
-        
         /* abandon the network file */
         if (netfile != 0)
             netfile->abandon(vmg0_);
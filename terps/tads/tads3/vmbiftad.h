@@ -104,6 +104,13 @@ protected:
 #define VMBT_RNGID_BITSHIFT  4
 
 
+/*
+ *   Maximum number of compiled regular expressions to keep in the cache for
+ *   expressions passed as strings 
+ */
+#define VMBIFTADS_REX_CACHE_SIZE  64
+
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Global information for the TADS intrinsics.  We allocate this
@@ -123,6 +130,12 @@ public:
     class CRegexParser *rex_parser;
     class CRegexSearcherSimple *rex_searcher;
 
+    /* 
+     *   cache of compiled patterns for regular expressions passed as
+     *   strings rather than RexPattern objects 
+     */
+    class CRegexCache *rex_cache;
+
     /* 
      *   global variable for the last regular expression search string (we
      *   need to hold onto this because we might need to extract group-match
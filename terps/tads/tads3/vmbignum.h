@@ -1301,6 +1301,29 @@ protected:
                                       char *new_rem_ext,
                                       const char *ext1, const char *ext2);
 
+    /*
+     *   Binary limb versions of the product and quotient calculations.
+     *   These convert the mantissas to base 10^9 limbs, do the arithmetic
+     *   a limb at a time, and convert the result back to BCD, giving
+     *   exactly the same result as the digit-at-a-time calculations.
+     *   They return true if they computed the result, false if the caller
+     *   must use the digit-at-a-time calculation instead (for operands
+     *   that aren't normalized, or if we can't allocate working memory).
+     *   The quotient version doesn't compute a remainder.  
+     */
+    static int compute_prod_limbs(char *new_ext,
+                                  const char *ext1, const char *ext2);
+    static int compute_quotient_limbs(char *new_ext,
+                                      const char *ext1, const char *ext2);
+
+    /* 
+     *   Convert a mantissa to base 10^9 limbs, least significant first,
+     *   treating it as an integer with 'zeros' zeros appended.  Returns the
+     *   number of limbs.  
+     */
+    static size_t mant_to_limbs(uint32_t *limbs, const char *ext,
+                                size_t zeros);
+
     /* compare extensions - return 0 if equal, <0 if a<b, >0 if a>b */
     static int compare_ext(const char *a, const char *b);
     
@@ -2246,6 +2246,365 @@ void CVmObjBigNum::compute_abs_diff_into(char *new_ext,
     normalize(new_ext);
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Binary limb arithmetic.  The BCD representation is convenient for
+ *   conversions and rounding, but it makes the long multiplication and
+ *   division loops do all of their work a decimal digit at a time, through
+ *   get_dig() and set_dig().  For products and quotients, it's much faster
+ *   to convert the mantissas to base 10^9 limbs, which let us do nine
+ *   digits at a time in native 64-bit arithmetic, and then convert the
+ *   exact integer result back to digits for rounding.  
+ */
+
+/* limb base, and number of decimal digits per limb */
+#define VMBN_LIMB_BASE    1000000000U
+#define VMBN_LIMB_DIGITS  9
+
+/* 
+ *   number of uint32_t's of working memory we'll keep on the stack; above
+ *   this we allocate from the heap 
+ */
+#define VMBN_LIMB_STACK   256
+
+/*
+ *   Working memory for a limb calculation.  Uses a stack buffer when the
+ *   calculation is small enough, otherwise allocates from the heap.  
+ */
+class CVmBigNumLimbBuf
+{
+public:
+    CVmBigNumLimbBuf(size_t cnt)
+    {
+        if (cnt <= VMBN_LIMB_STACK)
+            buf_ = stkbuf_;
+        else
+            buf_ = (uint32_t *)t3malloc(cnt * sizeof(uint32_t));
+    }
+
+    ~CVmBigNumLimbBuf()
+    {
+        if (buf_ != 0 && buf_ != stkbuf_)
+            t3free(buf_);
+    }
+
+    /* get the buffer; null if the allocation failed */
+    uint32_t *get() const { return buf_; }
+
+protected:
+    uint32_t *buf_;
+    uint32_t stkbuf_[VMBN_LIMB_STACK];
+};
+
+/* 
+ *   Convert an integer in limbs to 'ndig' decimal digits, most significant
+ *   first, padding with leading zeros as needed.  
+ */
+static void limbs_to_digits(unsigned char *dig, size_t ndig,
+                            const uint32_t *limbs, size_t nlimbs)
+{
+    size_t i, pos;
+    for (i = 0, pos = ndig ; pos != 0 ; ++i)
+    {
+        uint32_t l = (i < nlimbs ? limbs[i] : 0);
+        for (int j = 0 ; j < VMBN_LIMB_DIGITS && pos != 0 ; ++j, l /= 10)
+            dig[--pos] = (unsigned char)(l % 10);
+    }
+}
+
+/*
+ *   Divide the integer u (m+n limbs, with room for one more limb at u[m+n])
+ *   by v (n limbs, with a non-zero high limb), storing the m+1 limbs of the
+ *   quotient in q.  u and v are destroyed.  Returns true if the remainder
+ *   is non-zero.  This is Knuth's Algorithm D (TAOCP vol. 2, 4.3.1).  
+ */
+static int limbs_divide(uint32_t *q, uint32_t *u, size_t m,
+                        uint32_t *v, size_t n)
+{
+    const uint64_t B = VMBN_LIMB_BASE;
+    size_t i, j;
+
+    /* a single-limb divisor is just a short division */
+    if (n == 1)
+    {
+        uint64_t r = 0;
+        for (j = m + 1 ; j != 0 ; )
+        {
+            --j;
+            uint64_t cur = r*B + u[j];
+            q[j] = (uint32_t)(cur / v[0]);
+            r = cur % v[0];
+        }
+        return r != 0;
+    }
+
+    /* 
+     *   normalize, by scaling both numbers so that the divisor's high limb
+     *   is at least B/2, which keeps our quotient limb estimates close 
+     */
+    uint64_t d = B / ((uint64_t)v[n-1] + 1);
+    uint64_t carry = 0;
+    for (i = 0 ; i < n ; ++i)
+    {
+        uint64_t t = v[i]*d + carry;
+        v[i] = (uint32_t)(t % B);
+        carry = t / B;
+    }
+    carry = 0;
+    for (i = 0 ; i < m + n ; ++i)
+    {
+        uint64_t t = u[i]*d + carry;
+        u[i] = (uint32_t)(t % B);
+        carry = t / B;
+    }
+    u[m + n] = (uint32_t)carry;
+
+    /* figure each quotient limb, from most to least significant */
+    for (j = m + 1 ; j != 0 ; )
+    {
+        --j;
+
+        /* estimate the limb from the leading limbs */
+        uint64_t num = u[j+n]*B + u[j+n-1];
+        uint64_t qhat = num / v[n-1];
+        uint64_t rhat = num % v[n-1];
+        while (qhat >= B || qhat*v[n-2] > rhat*B + u[j+n-2])
+        {
+            --qhat;
+            rhat += v[n-1];
+            if (rhat >= B)
+                break;
+        }
+
+        /* subtract qhat*v from the current window of u */
+        int64_t borrow = 0;
+        carry = 0;
+        for (i = 0 ; i < n ; ++i)
+        {
+            uint64_t p = qhat*v[i] + carry;
+            carry = p / B;
+            int64_t t = (int64_t)u[i+j] - borrow - (int64_t)(p % B);
+            borrow = (t < 0);
+            u[i+j] = (uint32_t)(t < 0 ? t + (int64_t)B : t);
+        }
+        int64_t t = (int64_t)u[j+n] - borrow - (int64_t)carry;
+
+        /* if we went negative, the estimate was one too high - add back */
+        if (t < 0)
+        {
+            --qhat;
+            carry = 0;
+            for (i = 0 ; i < n ; ++i)
+            {
+                uint64_t s = (uint64_t)u[i+j] + v[i] + carry;
+                carry = (s >= B);
+                u[i+j] = (uint32_t)(s - (carry ? B : 0));
+            }
+            t += (int64_t)carry;
+        }
+        u[j+n] = (uint32_t)t;
+        q[j] = (uint32_t)qhat;
+    }
+
+    /* the remainder is what's left in the low n limbs of u */
+    for (i = 0 ; i < n ; ++i)
+    {
+        if (u[i] != 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ *   Convert a mantissa to limbs 
+ */
+size_t CVmObjBigNum::mant_to_limbs(uint32_t *limbs, const char *ext,
+                                   size_t zeros)
+{
+    size_t prec = get_prec(ext);
+    size_t ndig = prec + zeros;
+    size_t n = 0;
+
+    /* build each limb from up to nine digits, working up from the units */
+    for (size_t end = ndig ; end != 0 ; )
+    {
+        size_t start = (end > VMBN_LIMB_DIGITS ? end - VMBN_LIMB_DIGITS : 0);
+        uint32_t l = 0;
+        for (size_t i = start ; i < end ; ++i)
+            l = l*10 + (i < prec ? get_dig(ext, i) : 0);
+
+        limbs[n++] = l;
+        end = start;
+    }
+
+    return n;
+}
+
+/*
+ *   Compute a product using limbs.  The digit-at-a-time multiplication
+ *   keeps the most significant new_prec digits of the exact product (after
+ *   skipping a leading zero, if the product is one digit shorter than the
+ *   sum of the input precisions), then rounds based on the digits it
+ *   shifted out.  We compute the exact product and then do the same.  
+ */
+int CVmObjBigNum::compute_prod_limbs(char *new_ext,
+                                     const char *ext1, const char *ext2)
+{
+    size_t prec1 = get_prec(ext1);
+    size_t prec2 = get_prec(ext2);
+    size_t new_prec = get_prec(new_ext);
+
+    /* 
+     *   we need normalized inputs, and an accumulator at least as wide as
+     *   the top number 
+     */
+    if (new_prec < prec1 || get_dig(ext1, 0) == 0 || get_dig(ext2, 0) == 0)
+        return FALSE;
+
+    /* allocate space for the inputs, the product, and its digits */
+    size_t n1 = (prec1 + VMBN_LIMB_DIGITS - 1) / VMBN_LIMB_DIGITS;
+    size_t n2 = (prec2 + VMBN_LIMB_DIGITS - 1) / VMBN_LIMB_DIGITS;
+    size_t ndig = prec1 + prec2;
+    CVmBigNumLimbBuf buf(2*(n1 + n2) + (ndig + 3)/4);
+    uint32_t *a = buf.get();
+    if (a == 0)
+        return FALSE;
+    uint32_t *b = a + n1;
+    uint32_t *r = b + n2;
+    unsigned char *dig = (unsigned char *)(r + n1 + n2);
+
+    /* convert the inputs */
+    mant_to_limbs(a, ext1, 0);
+    mant_to_limbs(b, ext2, 0);
+
+    /* compute the product */
+    memset(r, 0, (n1 + n2) * sizeof(r[0]));
+    for (size_t i = 0 ; i < n1 ; ++i)
+    {
+        uint64_t carry = 0;
+        for (size_t j = 0 ; j < n2 ; ++j)
+        {
+            uint64_t t = (uint64_t)a[i]*b[j] + r[i+j] + carry;
+            r[i+j] = (uint32_t)(t % VMBN_LIMB_BASE);
+            carry = t / VMBN_LIMB_BASE;
+        }
+        r[i + n2] = (uint32_t)carry;
+    }
+
+    /* get the decimal digits of the product */
+    limbs_to_digits(dig, ndig, r, n1 + n2);
+
+    /* skip the leading zero, if any */
+    size_t lead = (dig[0] == 0 ? 1 : 0);
+
+    /* store the digits we're keeping */
+    size_t i;
+    for (i = 0 ; i < new_prec ; ++i)
+        set_dig(new_ext, i, lead + i < ndig ? dig[lead + i] : 0);
+
+    /* note the first dropped digit, and whether any others are non-zero */
+    i += lead;
+    int trail_dig = (i < ndig ? dig[i] : 0);
+    int trail_val = 0;
+    for (++i ; i < ndig && trail_val == 0 ; ++i)
+        trail_val = (dig[i] != 0);
+
+    /* set the exponent and sign */
+    set_exp(new_ext, get_exp(ext1) + get_exp(ext2) - (int)lead);
+    set_neg(new_ext, get_neg(ext1) != get_neg(ext2));
+
+    /* round for the dropped digits, and normalize */
+    round_for_dropped_digits(new_ext, trail_dig, trail_val);
+    normalize(new_ext);
+
+    /* we have the result */
+    return TRUE;
+}
+
+/*
+ *   Compute a quotient using limbs.  The digit-at-a-time division produces
+ *   the exact leading digits of the quotient, and rounds at the first
+ *   digit past the result precision, taking into account whether or not
+ *   the remainder at that point is zero.  We compute enough digits of the
+ *   exact quotient to do the same.  
+ */
+int CVmObjBigNum::compute_quotient_limbs(char *new_ext,
+                                         const char *ext1, const char *ext2)
+{
+    size_t prec1 = get_prec(ext1);
+    size_t prec2 = get_prec(ext2);
+    size_t quo_prec = get_prec(new_ext);
+
+    /* we need normalized inputs */
+    if (get_dig(ext1, 0) == 0 || get_dig(ext2, 0) == 0)
+        return FALSE;
+
+    /*
+     *   We need quo_prec+1 significant digits in the quotient, counting the
+     *   rounding digit.  The dividend mantissa is at least 10^(prec1-1)
+     *   and the divisor is less than 10^prec2, so scaling the dividend up
+     *   by this many digits guarantees at least that many.  
+     */
+    size_t need = quo_prec + 1;
+    size_t scale = (need + prec2 > prec1 ? need + prec2 - prec1 : 0);
+
+    /* allocate space for the operands, the quotient, and its digits */
+    size_t nu = (prec1 + scale + VMBN_LIMB_DIGITS - 1) / VMBN_LIMB_DIGITS;
+    size_t nv = (prec2 + VMBN_LIMB_DIGITS - 1) / VMBN_LIMB_DIGITS;
+    size_t nq = nu - nv + 1;
+    size_t ndig = prec1 + scale - prec2 + 1;
+    CVmBigNumLimbBuf buf((nu + 1) + nv + nq + (ndig + 3)/4);
+    uint32_t *u = buf.get();
+    if (u == 0)
+        return FALSE;
+    uint32_t *v = u + nu + 1;
+    uint32_t *q = v + nv;
+    unsigned char *dig = (unsigned char *)(q + nq);
+
+    /* note the input signs and exponents, in case new_ext overlaps them */
+    int neg = (get_neg(ext1) != get_neg(ext2));
+    int exp_diff = get_exp(ext1) - get_exp(ext2);
+
+    /* convert the operands and divide */
+    mant_to_limbs(u, ext1, scale);
+    mant_to_limbs(v, ext2, 0);
+    int rem = limbs_divide(q, u, nu - nv, v, nv);
+
+    /* get the digits of the quotient, and find the first significant one */
+    limbs_to_digits(dig, ndig, q, nq);
+    size_t first;
+    for (first = 0 ; dig[first] == 0 ; ++first) ;
+
+    /* store the digits we're keeping */
+    size_t i;
+    for (i = 0 ; i < quo_prec ; ++i)
+        set_dig(new_ext, i, dig[first + i]);
+
+    /* 
+     *   set the exponent - the quotient has ndig-first digits before the
+     *   scaling, and the mantissa values are relative to the precisions 
+     */
+    set_exp(new_ext, (int)(ndig - first) - (int)scale
+            + exp_diff - (int)prec1 + (int)prec2);
+
+    /* 
+     *   round for the next digit, noting whether anything past it (in the
+     *   digits or the remainder) is non-zero 
+     */
+    i += first;
+    int trail_dig = dig[i];
+    for (++i ; i < ndig && rem == 0 ; ++i)
+        rem = (dig[i] != 0);
+    round_for_dropped_digits(new_ext, trail_dig, rem);
+
+    /* set the sign and normalize */
+    set_neg(new_ext, neg);
+    normalize(new_ext);
+
+    /* we have the result */
+    return TRUE;
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Compute the product of the values into the given buffer 
@@ -2261,6 +2620,10 @@ void CVmObjBigNum::compute_prod_into(char *new_ext,
     size_t out_idx;
     size_t start_idx;
     int out_exp;
+
+    /* use the limb calculation if possible */
+    if (compute_prod_limbs(new_ext, ext1, ext2))
+        return;
     
     /* start out with zero in the accumulator */
     memset(new_ext + VMBN_MANT, 0, (new_prec + 1)/2);
@@ -2429,6 +2792,10 @@ void CVmObjBigNum::compute_quotient_into(char *new_ext,
         return;
     }
 
+    /* if the caller doesn't need the remainder, use the limb calculation */
+    if (new_rem_ext == 0 && compute_quotient_limbs(new_ext, ext1, ext2))
+        return;
+
     /* 
      *   Calculate the precision we need for the running remainder.  We
      *   must retain enough precision in the remainder to calculate exact
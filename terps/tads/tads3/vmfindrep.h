@@ -71,6 +71,7 @@ struct re_replace_arg
     {
         s = 0;
         pat = 0;
+        cached_pat = 0;
         pat_str = 0;
         rpl_func.set_nil();
         match_valid = FALSE;
@@ -78,9 +79,9 @@ struct re_replace_arg
 
     ~re_replace_arg()
     {
-        /* if we created the pattern object, delete it */
-        if (pat != 0 && our_pat)
-            CRegexParser::free_pattern(pat);
+        /* if we got the pattern from the cache, release it */
+        if (cached_pat != 0)
+            rex_cache->release(cached_pat);
         if (s != 0)
             delete s;
     }
@@ -103,8 +104,6 @@ struct re_replace_arg
             pat = ((CVmObjPattern *)vm_objp(vmg_ patv->val.obj))
                   ->get_pattern(vmg0_);
 
-            /* we didn't create the pattern object */
-            our_pat = FALSE;
         }
         else if ((str = patv->get_as_string(vmg0_)) != 0)
         {
@@ -114,17 +113,14 @@ struct re_replace_arg
                 /* create the searcher */
                 create_searcher(vmg0_);
 
-                /* we treat strings as regular expressions - compile it */
-                re_status_t stat;
-                stat = G_bif_tads_globals->rex_parser->compile_pattern(
-                    str + VMB_LEN, vmb_get_len(str), &pat);
-
-                /* if that failed, we don't have a pattern */
-                if (stat != RE_STATUS_SUCCESS)
-                    pat = 0;
-
-                /* make a note that we allocated the pattern */
-                our_pat = TRUE;
+                /* 
+                 *   we treat strings as regular expressions - get the
+                 *   compiled pattern from the cache (if it doesn't compile,
+                 *   we don't have a pattern) 
+                 */
+                rex_cache = G_bif_tads_globals->rex_cache;
+                cached_pat = rex_cache->get(str + VMB_LEN, vmb_get_len(str));
+                pat = (cached_pat != 0 ? cached_pat->pat : 0);
             }
             else
             {
@@ -272,8 +268,12 @@ struct re_replace_arg
     /* our search string, or null if we're searching for a pattern */
     const char *pat_str;
 
-    /* Did we create the pattern?  If so, delete it on destruction. */
-    int our_pat;
+    /* 
+     *   the cache entry for the pattern, if it came from the pattern cache
+     *   rather than a RexPattern object; we release it on destruction 
+     */
+    re_cached_pattern *cached_pat;
+    CRegexCache *rex_cache;
 
     /* our replacement string, or null if it's a callback function */
     const char *rpl_str;
@@ -562,6 +562,7 @@ inline void vmglob_delete(vm_globals *glob) { delete glob; }
 #define G_iter_get_next  VMGLOB_ACCESS(iter_get_next)
 #define G_iter_next_avail  VMGLOB_ACCESS(iter_next_avail)
 #define G_tadsobj_queue  VMGLOB_PREACCESS(tadsobj_queue)
+#define G_tadsobj_cache  VMGLOB_PREACCESS(tadsobj_cache)
 #define G_predef      VMGLOB_PREACCESS(predef)
 #define G_stk         G_interpreter
 #define G_interpreter VMGLOB_PREACCESS(interpreter)
@@ -807,7 +807,7 @@ ulong CVmObjString::rebuild_image(VMG_ char *buf, ulong buflen)
         return copy_size;
 
     /* copy the data */
-    memcpy(buf, ext_, copy_size);
+    memcpy(buf, get_as_string(vmg0_), copy_size);
 
     /* return the size */
     return copy_size;
@@ -838,7 +838,8 @@ void CVmObjString::convert_to_const_data(VMG_ CVmConstMapper *mapper,
      *   value 
      */
     if (mapper->get_pool_addr(self))
-        mapper->store_data(self, ext_, vmb_get_len(ext_) + VMB_LEN);
+        mapper->store_data(self, get_as_string(vmg0_),
+                           vmb_get_len(ext_) + VMB_LEN);
 }
 
 
@@ -61,6 +61,8 @@ struct
         cur_freed = 0;
         max_freed = 0;
         t = 0;
+        idle_runs = 0;
+        max_pause = 0;
     }
 
     void begin_pass()
@@ -71,9 +73,33 @@ struct
         cur_freed = 0;
     }
 
-    void end_pass()
+    /* 
+     *   Idle-time passes are timed slice by slice, since the time between
+     *   slices is spent waiting for input.  The pause for the pass is the
+     *   final slice, which runs from begin_slice() to end_pass(). 
+     */
+    void begin_idle_pass()
+    {
+        begin_pass();
+        idle_runs++;
+    }
+
+    void begin_slice()
+    {
+        t0 = os_get_sys_clock_ms();
+    }
+
+    void end_slice()
     {
         t += os_get_sys_clock_ms() - t0;
+    }
+
+    void end_pass()
+    {
+        long pause = os_get_sys_clock_ms() - t0;
+        t += pause;
+        if (pause > max_pause)
+            max_pause = pause;
         if (cur_freed > max_freed)
             max_freed = cur_freed;
         long garbage_bytes = pass_start_bytes - cur_bytes;
@@ -109,26 +135,33 @@ struct
     {
         printf("Garbage collection statistics:\n"
                "  collection runs:       %ld\n"
+               "  idle-time runs:        %ld\n"
                "  objects freed:         %ld\n"
                "  average freed per run: %ld\n"
                "  max freed in one run:  %ld\n"
                "  peak heap bytes:       %ld\n"
                "  peak garbage bytes:    %ld\n"
                "  total gc time (ms):    %ld\n"
-               "  average gc time (ms):  %ld\n",
+               "  average gc time (ms):  %ld\n"
+               "  max pause (ms):        %ld\n",
                runs,
+               idle_runs,
                tot_freed,
                runs != 0 ? tot_freed/runs : 0,
                max_freed,
                max_bytes,
                max_garbage_bytes,
                t,
-               runs != 0 ? t/runs : 0);
+               runs != 0 ? t/runs : 0,
+               max_pause);
     }
 
     /* number of times the gc has run */
     long runs;
 
+    /* number of those runs that were started while waiting for input */
+    long idle_runs;
+
     /* total number of objects collected */
     long tot_freed;
 
@@ -153,6 +186,9 @@ struct
     /* elapsed time in garbage collector */
     long t;
 
+    /* longest time the VM was stopped for garbage collection */
+    long max_pause;
+
     /* starting time in ticks of current run */
     long t0;
 
@@ -1495,6 +1531,9 @@ void CVmObjTable::init(VMG0_)
     /* enable the garbage collector */
     gc_enabled_ = TRUE;
 
+    /* we're not in an idle-time pass */
+    gc_idle_pass_ = FALSE;
+
     /* there are no saved image data pointers yet */
     image_ptr_head_ = 0;
     image_ptr_tail_ = 0;
@@ -1988,6 +2027,70 @@ void CVmObjTable::gc_full(VMG0_)
     IF_GC_STATS(gc_stats.end_pass());
 }
 
+/*
+ *   Idle-time garbage collection - run the next slice of the current pass,
+ *   starting a new pass if we're not already in one. 
+ */
+int CVmObjTable::gc_idle_step(VMG0_)
+{
+    int more;
+
+    /* if we're not in a pass, start one if there's anything to collect */
+    if (!gc_idle_pass_)
+    {
+        /* 
+         *   if nothing has been allocated since the last pass, the last
+         *   pass already collected everything there is to collect 
+         */
+        if (!gc_enabled_ || (allocs_since_gc_ == 0 && bytes_since_gc_ == 0))
+            return FALSE;
+
+        /* count it if in statistics mode */
+        IF_GC_STATS(gc_stats.begin_idle_pass());
+
+        /* start the pass - this traces the root set into the work queue */
+        gc_pass_init(vmg0_);
+        gc_idle_pass_ = TRUE;
+
+        /* 
+         *   that's enough for one slice - let the caller check for input
+         *   before we start on the work queue 
+         */
+        IF_GC_STATS(gc_stats.end_slice());
+        return TRUE;
+    }
+
+    /* trace the next increment of the work queue */
+    IF_GC_STATS(gc_stats.begin_slice());
+    more = gc_pass_continue(vmg0_);
+    IF_GC_STATS(gc_stats.end_slice());
+
+    /* tell the caller whether there's more to do */
+    return more;
+}
+
+/*
+ *   Idle-time garbage collection - finish the current pass, if any.  The
+ *   tracing is usually done by now, so this is just the sweep. 
+ */
+void CVmObjTable::gc_idle_finish(VMG0_)
+{
+    /* if there's no pass in progress, there's nothing to do */
+    if (!gc_idle_pass_)
+        return;
+
+    /* 
+     *   we're no longer in the pass once we start finishing it, since the
+     *   finalizers can run VM code, which could in turn ask for input 
+     */
+    gc_idle_pass_ = FALSE;
+
+    /* finish the pass */
+    IF_GC_STATS(gc_stats.begin_slice());
+    gc_pass_finish(vmg0_);
+    IF_GC_STATS(gc_stats.end_pass());
+}
+
 /*
  *   Garbage collector - initialize.  Add all globally-reachable objects
  *   to the work queue. 
@@ -1859,6 +1859,25 @@ public:
     int  gc_pass_continue(VMG0_) { return gc_pass_continue(vmg_ TRUE); }
     void gc_pass_finish(VMG0_);
 
+    /*
+     *   Idle-time garbage collection.  The UI layer can call
+     *   gc_idle_step() repeatedly while it's waiting for user input.  The
+     *   first call starts a pass, provided anything has been allocated
+     *   since the last one; each call then traces another increment of the
+     *   work queue.  Returns true if there's more tracing to do, false if
+     *   not (including when there's nothing to collect).
+     *   
+     *   The caller must call gc_idle_finish() before the VM resumes
+     *   execution - that is, before the input is returned to the program.
+     *   This completes any pass in progress, which leaves only the sweep
+     *   (and finalizers) to do at that point, since the tracing will
+     *   usually have finished while the user was typing.  The VM is
+     *   blocked in the input function in the meantime, which satisfies the
+     *   no-VM-activity rule for incremental collection.  
+     */
+    int gc_idle_step(VMG0_);
+    void gc_idle_finish(VMG0_);
+
     /*
      *   Run pending finalizers.  This can be run at any time other than
      *   during garbage collection (i.e., between gc_pass_init() and
@@ -2458,6 +2477,9 @@ private:
 
     /* garbage collection enabled */
     uint gc_enabled_ : 1;
+
+    /* an idle-time pass is in progress (see gc_idle_step()) */
+    uint gc_idle_pass_ : 1;
 };
 
 /* ------------------------------------------------------------------------ */
@@ -127,10 +127,18 @@ Modified
  *   An undo record takes up about 16 bytes (on a machine with 32-bit
  *   pointers and 32-bit alignment; this will obviously vary for hardware
  *   with different sizes or alignment requirements).
+ *   
+ *   The record limit is a memory budget, not an up-front allocation: the
+ *   undo log starts out with room for VM_UNDO_CHUNK_RECORDS records, and
+ *   grows by that much at a time as needed, until it reaches the limit.
+ *   Only then does it start discarding old savepoints.  
  */
 #ifndef VM_UNDO_MAX_RECORDS
 # define VM_UNDO_MAX_RECORDS  65536
 #endif
+#ifndef VM_UNDO_CHUNK_RECORDS
+# define VM_UNDO_CHUNK_RECORDS  4096
+#endif
 #ifndef VM_UNDO_MAX_SAVEPTS
 # define VM_UNDO_MAX_SAVEPTS  255
 #endif
@@ -879,6 +879,9 @@ re_status_t CRegexParser::compile(const char *expr_str, size_t exprlen,
     pat->case_sensitive = TRUE;
     pat->case_sensitivity_specified = FALSE;
 
+    /* we don't build a DFA for the base pattern */
+    pat->dfa = 0;
+
     /* start out with no current machine and no alternate machine */
     build_null_machine(&cur_machine);
     build_null_machine(&alter_machine);
@@ -2612,6 +2615,9 @@ re_status_t CRegexParser::compile_pattern(const char *expr_str,
         }
     }
 
+    /* set up a DFA matcher for the pattern, if it's suitable for one */
+    pat->dfa = CRegexDFA::create(pat);
+
     /* success */
     return stat;
 }
@@ -2621,10 +2627,183 @@ re_status_t CRegexParser::compile_pattern(const char *expr_str,
  */
 void CRegexParser::free_pattern(re_compiled_pattern *pattern)
 {
+    /* delete the DFA, if we built one */
+    if (pattern->dfa != 0)
+        delete pattern->dfa;
+
     /* we allocate each pattern as a single unit, so it's easy to free */
     t3free(pattern);
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Compiled pattern cache 
+ */
+CRegexCache::CRegexCache(CRegexParser *parser, size_t max_entries)
+{
+    parser_ = parser;
+    max_cnt_ = max_entries;
+    cnt_ = 0;
+    memset(buckets_, 0, sizeof(buckets_));
+    lru_head_ = lru_tail_ = 0;
+    hits_ = misses_ = evictions_ = 0;
+}
+
+CRegexCache::~CRegexCache()
+{
+    /* delete all of the entries, in use or not */
+    while (lru_head_ != 0)
+        remove(lru_head_);
+}
+
+/*
+ *   Calculate a hash value for an expression string 
+ */
+unsigned long CRegexCache::calc_hash(const char *str, size_t len)
+{
+    /* FNV-1a */
+    unsigned long h = 2166136261UL;
+    for ( ; len != 0 ; --len, ++str)
+        h = ((h ^ (unsigned char)*str) * 16777619UL) & 0xFFFFFFFFUL;
+
+    return h;
+}
+
+/*
+ *   Get the compiled pattern for an expression 
+ */
+re_cached_pattern *CRegexCache::get(const char *expr, size_t exprlen)
+{
+    /* look for an existing entry */
+    unsigned long hash = calc_hash(expr, exprlen);
+    re_cached_pattern *entry;
+    for (entry = buckets_[hash & (HASH_SIZE - 1)] ; entry != 0 ;
+         entry = entry->nxt_hash)
+    {
+        if (entry->hash == hash && entry->len == exprlen
+            && memcmp(entry->str, expr, exprlen) == 0)
+        {
+            /* found it - move it to the head of the LRU list */
+            ++hits_;
+            if (entry != lru_head_)
+            {
+                lru_unlink(entry);
+                lru_link_head(entry);
+            }
+
+            /* add the caller's reference */
+            ++entry->refs;
+            return entry;
+        }
+    }
+
+    /* it's not in the cache - compile it */
+    ++misses_;
+    re_compiled_pattern *pat;
+    if (parser_->compile_pattern(expr, exprlen, &pat) != RE_STATUS_SUCCESS)
+        return 0;
+
+    /* create the new entry */
+    entry = (re_cached_pattern *)t3malloc(
+        sizeof(re_cached_pattern) + exprlen);
+    entry->pat = pat;
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->len = exprlen;
+    memcpy(entry->str, expr, exprlen);
+
+    /* link it into its hash chain and at the head of the LRU list */
+    re_cached_pattern **bucket = &buckets_[hash & (HASH_SIZE - 1)];
+    entry->nxt_hash = *bucket;
+    *bucket = entry;
+    lru_link_head(entry);
+    ++cnt_;
+
+    /* make room if we've gone over our limit */
+    if (cnt_ > max_cnt_)
+        trim();
+
+    /* return the new entry */
+    return entry;
+}
+
+/*
+ *   Discard all unreferenced patterns 
+ */
+void CRegexCache::flush()
+{
+    re_cached_pattern *entry, *nxt;
+    for (entry = lru_head_ ; entry != 0 ; entry = nxt)
+    {
+        nxt = entry->lru_nxt;
+        if (entry->refs == 0)
+            remove(entry);
+    }
+}
+
+/*
+ *   Evict least recently used patterns until we're back within our limit.
+ *   Patterns in use can't be evicted, so we might not make it all the way
+ *   down; we'll try again on the next insertion. 
+ */
+void CRegexCache::trim()
+{
+    re_cached_pattern *entry, *prv;
+    for (entry = lru_tail_ ; entry != 0 && cnt_ > max_cnt_ ; entry = prv)
+    {
+        prv = entry->lru_prv;
+        if (entry->refs == 0)
+        {
+            remove(entry);
+            ++evictions_;
+        }
+    }
+}
+
+void CRegexCache::lru_unlink(re_cached_pattern *entry)
+{
+    if (entry->lru_prv != 0)
+        entry->lru_prv->lru_nxt = entry->lru_nxt;
+    else
+        lru_head_ = entry->lru_nxt;
+
+    if (entry->lru_nxt != 0)
+        entry->lru_nxt->lru_prv = entry->lru_prv;
+    else
+        lru_tail_ = entry->lru_prv;
+}
+
+void CRegexCache::lru_link_head(re_cached_pattern *entry)
+{
+    entry->lru_prv = 0;
+    entry->lru_nxt = lru_head_;
+    if (lru_head_ != 0)
+        lru_head_->lru_prv = entry;
+    else
+        lru_tail_ = entry;
+    lru_head_ = entry;
+}
+
+/*
+ *   Remove an entry and delete it 
+ */
+void CRegexCache::remove(re_cached_pattern *entry)
+{
+    /* unlink it from its hash chain */
+    re_cached_pattern **prv;
+    for (prv = &buckets_[entry->hash & (HASH_SIZE - 1)] ; *prv != entry ;
+         prv = &(*prv)->nxt_hash) ;
+    *prv = entry->nxt_hash;
+
+    /* unlink it from the LRU list */
+    lru_unlink(entry);
+    --cnt_;
+
+    /* delete the pattern and the entry */
+    CRegexParser::free_pattern(entry->pat);
+    t3free(entry);
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Register delta list.
@@ -2673,6 +2852,574 @@ protected:
 
 
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   DFA state 
+ */
+struct re_dfa_state
+{
+    /* cached transitions on ASCII characters (null if not yet computed) */
+    re_dfa_state *next_ascii[128];
+
+    /* next state in our hash chain, and in the master list */
+    re_dfa_state *nxt_hash;
+    re_dfa_state *nxt;
+
+    /* hash value */
+    unsigned long hash;
+
+    /* does the set include the final state? */
+    int accepting;
+
+    /* 
+     *   the NFA items in the set, sorted (the structure is overallocated to
+     *   the actual count); a set with no items is a dead end 
+     */
+    size_t item_cnt;
+    unsigned int items[1];
+};
+
+/*
+ *   Create a DFA for a pattern, if the pattern allows it 
+ */
+CRegexDFA *CRegexDFA::create(const re_compiled_pattern *pattern)
+{
+    size_t max_items;
+    if (!can_handle(pattern, &max_items))
+        return 0;
+
+    return new CRegexDFA(pattern, max_items);
+}
+
+/*
+ *   Check a pattern for features that need the backtracking matcher.  On
+ *   success, fills in *max_items with the maximum number of distinct items
+ *   a state can contain.  
+ */
+int CRegexDFA::can_handle(const re_compiled_pattern *pattern,
+                          size_t *max_items)
+{
+    /* group registers require the backtracker to keep track of them */
+    if (pattern->group_cnt != 0)
+        return FALSE;
+
+    /* we need to be able to pack state IDs into 16 bits */
+    if (pattern->tuple_cnt > 0xFFFF)
+        return FALSE;
+
+    /*
+     *   Visit every state reachable from the initial state.  The visit
+     *   marks keep us from going around cycles.  
+     */
+    re_state_id final_state = pattern->machine.final;
+    size_t cnt = pattern->tuple_cnt;
+    unsigned char *seen = (unsigned char *)t3malloc(cnt + 1);
+    re_state_id *stk = (re_state_id *)t3malloc(
+        (cnt + 1) * 2 * sizeof(re_state_id));
+    memset(seen, 0, cnt + 1);
+
+    int ok = TRUE;
+    size_t items = 0;
+    size_t sp = 0;
+    stk[sp++] = pattern->machine.init;
+    while (ok && sp != 0)
+    {
+        re_state_id id = stk[--sp];
+        if (id == RE_STATE_INVALID || id == final_state || seen[id])
+            continue;
+        seen[id] = TRUE;
+
+        const re_tuple *t = &pattern->tuples[id];
+        switch (t->typ)
+        {
+        case RE_EPSILON:
+            /* 
+             *   in <Max> mode, a shortest-preference branch makes the result
+             *   depend on which path reaches the final state, not just on
+             *   where the paths end 
+             */
+            if (pattern->longest_match && (t->flags & RE_STATE_SHORTEST) != 0)
+                ok = FALSE;
+
+            stk[sp++] = t->next_state_1;
+            stk[sp++] = t->next_state_2;
+            break;
+
+        case RE_LITSTR:
+        case RE_LITSTRA:
+            /* 
+             *   each position in the string is a separate item (an empty
+             *   string still needs a character, so leave that one to the
+             *   backtracker) 
+             */
+            {
+                size_t len = wcslen(t->info.str.str);
+                if (len == 0 || len > 0x7FFF)
+                    ok = FALSE;
+                items += len;
+            }
+            stk[sp++] = t->next_state_1;
+            break;
+
+        case RE_LITERAL:
+        case RE_WILDCARD:
+        case RE_RANGE:
+        case RE_RANGE_EXCL:
+        case RE_ALPHA:
+        case RE_DIGIT:
+        case RE_NON_DIGIT:
+        case RE_UPPER:
+        case RE_LOWER:
+        case RE_ALPHANUM:
+        case RE_SPACE:
+        case RE_NON_SPACE:
+        case RE_VSPACE:
+        case RE_NON_VSPACE:
+        case RE_PUNCT:
+        case RE_NEWLINE:
+        case RE_WORD_CHAR:
+        case RE_NON_WORD_CHAR:
+            /* simple single-character recognizers */
+            items += 1;
+            stk[sp++] = t->next_state_1;
+            break;
+
+        default:
+            /* anything else needs the backtracker */
+            ok = FALSE;
+            break;
+        }
+    }
+
+    t3free(stk);
+    t3free(seen);
+
+    *max_items = items;
+    return ok;
+}
+
+/*
+ *   construction 
+ */
+CRegexDFA::CRegexDFA(const re_compiled_pattern *pattern, size_t max_items)
+{
+    tuples_ = pattern->tuples;
+    final_ = pattern->machine.final;
+    longest_ = pattern->longest_match;
+
+    memset(buckets_, 0, sizeof(buckets_));
+    states_ = 0;
+    state_cnt_ = 0;
+
+    /* allocate the work areas */
+    size_t cnt = pattern->tuple_cnt;
+    work_ = (unsigned int *)t3malloc((max_items + 1) * sizeof(work_[0]));
+    stk_ = (re_state_id *)t3malloc((cnt + 1) * 2 * sizeof(stk_[0]));
+    marks_ = (unsigned int *)t3malloc((cnt + 1) * sizeof(marks_[0]));
+    memset(marks_, 0, (cnt + 1) * sizeof(marks_[0]));
+    mark_gen_ = 0;
+
+    /* build the starting state */
+    work_cnt_ = 0;
+    work_accepting_ = FALSE;
+    ++mark_gen_;
+    add_closure(pattern->machine.init);
+    start_ = intern();
+
+    /*
+     *   If every item in the starting state requires the same literal
+     *   character, and the empty string doesn't match, a match can only
+     *   start at that character.  
+     */
+    lead_byte_ = -1;
+    wchar_t lead = 0;
+    for (size_t i = 0 ; !start_->accepting && i < start_->item_cnt ; ++i)
+    {
+        const re_tuple *t = &tuples_[start_->items[i] & 0xFFFF];
+        wchar_t ch;
+        if (t->typ == RE_LITERAL)
+            ch = t->info.ch;
+        else if ((t->typ == RE_LITSTR || t->typ == RE_LITSTRA)
+                 && (start_->items[i] >> 16) == 0)
+            ch = t->info.str.str[0];
+        else
+        {
+            lead = 0;
+            break;
+        }
+
+        if (i != 0 && ch != lead)
+        {
+            lead = 0;
+            break;
+        }
+        lead = ch;
+    }
+    if (lead != 0)
+    {
+        char buf[4];
+        utf8_ptr::s_putch(buf, lead);
+        lead_byte_ = (unsigned char)buf[0];
+    }
+}
+
+/*
+ *   deletion 
+ */
+CRegexDFA::~CRegexDFA()
+{
+    re_dfa_state *cur, *nxt;
+    for (cur = states_ ; cur != 0 ; cur = nxt)
+    {
+        nxt = cur->nxt;
+        t3free(cur);
+    }
+
+    t3free(work_);
+    t3free(stk_);
+    t3free(marks_);
+}
+
+/*
+ *   Add the epsilon closure of an NFA state to the work list.  The caller
+ *   must bump mark_gen_ at the start of each new set.  
+ */
+void CRegexDFA::add_closure(re_state_id id)
+{
+    size_t sp = 0;
+    stk_[sp++] = id;
+    while (sp != 0)
+    {
+        id = stk_[--sp];
+
+        /* 
+         *   the backtracker stops as soon as it reaches the final state, so
+         *   we don't follow anything out of it (note that an empty pattern
+         *   can have an invalid final state, so check this first) 
+         */
+        if (id == final_)
+        {
+            work_accepting_ = TRUE;
+            continue;
+        }
+
+        /* skip dead ends and states we've already visited */
+        if (id == RE_STATE_INVALID || marks_[id] == mark_gen_)
+            continue;
+        marks_[id] = mark_gen_;
+
+        const re_tuple *t = &tuples_[id];
+        if (t->typ == RE_EPSILON)
+        {
+            /* push the second branch first, so we visit in branch order */
+            stk_[sp++] = t->next_state_2;
+            stk_[sp++] = t->next_state_1;
+        }
+        else
+        {
+            /* it's a recognizer - it's an item at its first position */
+            work_[work_cnt_++] = (unsigned int)id;
+        }
+    }
+}
+
+/* comparison callback for sorting the work list */
+static int dfa_item_cmp(const void *a, const void *b)
+{
+    unsigned int ia = *(const unsigned int *)a;
+    unsigned int ib = *(const unsigned int *)b;
+    return ia < ib ? -1 : ia > ib ? 1 : 0;
+}
+
+/*
+ *   Find or create the state for the current work list.  Returns null if we
+ *   need a new state but we're already at our limit.  
+ */
+re_dfa_state *CRegexDFA::intern()
+{
+    /* put the items in canonical order and remove duplicates */
+    if (work_cnt_ > 1)
+    {
+        qsort(work_, work_cnt_, sizeof(work_[0]), &dfa_item_cmp);
+
+        size_t i, j;
+        for (i = j = 1 ; i < work_cnt_ ; ++i)
+        {
+            if (work_[i] != work_[j-1])
+                work_[j++] = work_[i];
+        }
+        work_cnt_ = j;
+    }
+
+    /* hash the set */
+    unsigned long h = work_accepting_ ? 1 : 0;
+    for (size_t i = 0 ; i < work_cnt_ ; ++i)
+        h = (h * 31 + work_[i]) & 0xFFFFFFFFUL;
+
+    /* look for an existing state */
+    re_dfa_state **bucket = &buckets_[h & 63];
+    re_dfa_state *s;
+    for (s = *bucket ; s != 0 ; s = s->nxt_hash)
+    {
+        if (s->hash == h && s->accepting == work_accepting_
+            && s->item_cnt == work_cnt_
+            && memcmp(s->items, work_, work_cnt_ * sizeof(work_[0])) == 0)
+            return s;
+    }
+
+    /* it's a new state - make sure we have room for it */
+    if (state_cnt_ >= RE_DFA_MAX_STATES)
+        return 0;
+
+    /* create it */
+    s = (re_dfa_state *)t3malloc(
+        sizeof(re_dfa_state) + work_cnt_ * sizeof(work_[0]));
+    memset(s->next_ascii, 0, sizeof(s->next_ascii));
+    s->hash = h;
+    s->accepting = work_accepting_;
+    s->item_cnt = work_cnt_;
+    memcpy(s->items, work_, work_cnt_ * sizeof(work_[0]));
+
+    /* link it in */
+    s->nxt_hash = *bucket;
+    *bucket = s;
+    s->nxt = states_;
+    states_ = s;
+    ++state_cnt_;
+
+    return s;
+}
+
+/*
+ *   Does a single-character recognizer match the given character?  This
+ *   follows the case-sensitive rules in CRegexSearcher::match().  
+ */
+int CRegexDFA::char_matches(const re_tuple *t, wchar_t ch)
+{
+    switch (t->typ)
+    {
+    case RE_LITERAL:
+        return ch == t->info.ch;
+
+    case RE_WILDCARD:
+        return TRUE;
+
+    case RE_ALPHA:
+        return t3_is_alpha(ch);
+
+    case RE_DIGIT:
+        return t3_is_digit(ch);
+
+    case RE_NON_DIGIT:
+        return !t3_is_digit(ch);
+
+    case RE_UPPER:
+        return t3_is_upper(ch);
+
+    case RE_LOWER:
+        return t3_is_lower(ch);
+
+    case RE_ALPHANUM:
+    case RE_WORD_CHAR:
+        return t3_is_alpha(ch) || t3_is_digit(ch);
+
+    case RE_NON_WORD_CHAR:
+        return !(t3_is_alpha(ch) || t3_is_digit(ch));
+
+    case RE_SPACE:
+        return t3_is_space(ch);
+
+    case RE_NON_SPACE:
+        return !t3_is_space(ch);
+
+    case RE_VSPACE:
+        return t3_is_vspace(ch);
+
+    case RE_NON_VSPACE:
+        return !t3_is_vspace(ch);
+
+    case RE_PUNCT:
+        return t3_is_punct(ch);
+
+    case RE_NEWLINE:
+        return (ch == 0x000A || ch == 0x000D || ch == 0x000B
+                || ch == 0x2028 || ch == 0x2029);
+
+    case RE_RANGE:
+    case RE_RANGE_EXCL:
+        {
+            size_t i;
+            const wchar_t *rp;
+            int match = FALSE;
+            for (i = t->info.range.char_range_cnt,
+                 rp = t->info.range.char_range ;
+                 i != 0 && !match ; i -= 2, rp += 2)
+            {
+                if (rp[0] != '\0')
+                {
+                    /* literal range */
+                    match = (ch >= rp[0] && ch <= rp[1]);
+                    continue;
+                }
+
+                /* character class */
+                switch (rp[1])
+                {
+                case RE_ALPHA:
+                    match = t3_is_alpha(ch);
+                    break;
+
+                case RE_DIGIT:
+                    match = t3_is_digit(ch);
+                    break;
+
+                case RE_UPPER:
+                    match = t3_is_upper(ch);
+                    break;
+
+                case RE_LOWER:
+                    match = t3_is_lower(ch);
+                    break;
+
+                case RE_ALPHANUM:
+                    match = t3_is_alpha(ch) || t3_is_digit(ch);
+                    break;
+
+                case RE_SPACE:
+                    match = t3_is_space(ch);
+                    break;
+
+                case RE_VSPACE:
+                    match = t3_is_vspace(ch);
+                    break;
+
+                case RE_PUNCT:
+                    match = t3_is_punct(ch);
+                    break;
+
+                case RE_NEWLINE:
+                    match = (ch == 0x000A || ch == 0x000D || ch == 0x000B
+                             || ch == 0x2028 || ch == 0x2029);
+                    break;
+
+                case RE_NULLCHAR:
+                    match = (ch == 0);
+                    break;
+
+                default:
+                    break;
+                }
+            }
+
+            return (t->typ == RE_RANGE ? match : !match);
+        }
+
+    default:
+        return FALSE;
+    }
+}
+
+/*
+ *   Compute the transition from a state on a character 
+ */
+re_dfa_state *CRegexDFA::step(re_dfa_state *s, wchar_t ch)
+{
+    /* start a new set */
+    work_cnt_ = 0;
+    work_accepting_ = FALSE;
+    ++mark_gen_;
+
+    /* advance each item that accepts the character */
+    for (size_t i = 0 ; i < s->item_cnt ; ++i)
+    {
+        unsigned int item = s->items[i];
+        re_state_id id = (re_state_id)(item & 0xFFFF);
+        const re_tuple *t = &tuples_[id];
+
+        if (t->typ == RE_LITSTR || t->typ == RE_LITSTRA)
+        {
+            /* literal string - match the character at our position */
+            unsigned int ofs = item >> 16;
+            if (t->info.str.str[ofs] != ch)
+                continue;
+
+            /* 
+             *   if there's more to the string, move to the next position;
+             *   otherwise we're through the string 
+             */
+            if (t->info.str.str[ofs + 1] != 0)
+            {
+                work_[work_cnt_++] = ((ofs + 1) << 16) | (unsigned int)id;
+                continue;
+            }
+        }
+        else if (!char_matches(t, ch))
+            continue;
+
+        /* we're past this recognizer - add its successor's closure */
+        add_closure(t->next_state_1);
+    }
+
+    /* find or create the resulting state */
+    return intern();
+}
+
+/*
+ *   Match the leading substring of a string 
+ */
+int CRegexDFA::match(const char *str, size_t len)
+{
+    re_dfa_state *s = start_;
+    int last = (s->accepting ? 0 : -1);
+
+    /* in <Min> mode, we're done as soon as we reach the final state */
+    if (last == 0 && !longest_)
+        return 0;
+
+    /* run the subject through the DFA until we hit a dead end */
+    size_t pos = 0;
+    while (pos < len && s->item_cnt != 0)
+    {
+        unsigned char b = (unsigned char)str[pos];
+        re_dfa_state *n;
+        size_t clen;
+        if (b < 0x80)
+        {
+            /* ASCII - use the cached transition if we have one */
+            clen = 1;
+            if ((n = s->next_ascii[b]) == 0)
+            {
+                if ((n = step(s, b)) == 0)
+                    return RE_DFA_GAVE_UP;
+                s->next_ascii[b] = n;
+            }
+        }
+        else
+        {
+            /* multi-byte character - compute the transition */
+            clen = utf8_ptr::s_charsize((char)b);
+            if (clen > len - pos)
+                break;
+            if ((n = step(s, utf8_ptr::s_getch(str + pos))) == 0)
+                return RE_DFA_GAVE_UP;
+        }
+
+        /* advance */
+        pos += clen;
+        s = n;
+
+        /* note the match so far if we've reached the final state */
+        if (s->accepting)
+        {
+            last = (int)pos;
+            if (!longest_)
+                break;
+        }
+    }
+
+    return last;
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Pattern recognizer 
@@ -2714,6 +3461,17 @@ int CRegexSearcher::match(const char *entire_str, size_t entire_str_len,
                           ? pattern->case_sensitive
                           : default_case_sensitive_);
 
+    /* 
+     *   if the pattern has a DFA, and this is a case-sensitive match of the
+     *   whole pattern, let the DFA do the work 
+     */
+    if (pattern->dfa != 0 && case_sensitive && machine == &pattern->machine)
+    {
+        int m = pattern->dfa->match(str, origlen);
+        if (m != RE_DFA_GAVE_UP)
+            return m;
+    }
+
     /* macro to perform a "local return" */
     int _retval_;
 #define local_return(retval) \
@@ -3934,6 +4692,18 @@ int CRegexSearcher::search(const char *entirestr, const char *str, size_t len,
 
     /* figure the length of the overall string */
     size_t entirelen = len + (str - entirestr);
+
+    /* 
+     *   If the DFA will handle this search, and it knows the byte every
+     *   match must start with, we can skip straight to each occurrence of
+     *   that byte.  (A lead byte is never a UTF-8 continuation byte, so this
+     *   always lands on a character boundary.)  
+     */
+    int lead = -1;
+    if (pattern->dfa != 0 && machine == &pattern->machine
+        && (pattern->case_sensitivity_specified
+            ? pattern->case_sensitive : default_case_sensitive_))
+        lead = pattern->dfa->get_lead_byte();
     
     /*
      *   Starting at the first character in the string, search for the
@@ -3943,6 +4713,18 @@ int CRegexSearcher::search(const char *entirestr, const char *str, size_t len,
     utf8_ptr p;
     for (p.set((char *)str) ; p.getptr() <= max_start_pos ; p.inc(&len))
     {
+        /* skip ahead to the next possible starting point, if we can */
+        if (lead >= 0)
+        {
+            const char *nxt = (const char *)memchr(
+                p.getptr(), lead, max_start_pos - p.getptr());
+            if (nxt == 0)
+                break;
+
+            len -= nxt - p.getptr();
+            p.set((char *)nxt);
+        }
+
         /* check for a match */
         int matchlen = match(entirestr, entirelen, p.getptr(), len,
                              pattern, tuple_arr, machine, regs, loop_vars);
@@ -366,6 +366,13 @@ struct re_compiled_pattern_base
      *   ambiguity; otherwise, we match the string that ends first 
      */
     unsigned int first_begin : 1;
+
+    /* 
+     *   DFA matcher for the pattern, or null if the pattern needs the
+     *   backtracking matcher (or this is a temporary pattern that we didn't
+     *   bother building one for) 
+     */
+    class CRegexDFA *dfa;
 };
 
 /*
@@ -1041,6 +1048,114 @@ protected:
     size_t used_;
 };
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Lazy DFA matcher.  The backtracking matcher explores every path through
+ *   the machine, which can take time exponential in the subject length for
+ *   patterns with nested closures or alternations.  Many patterns don't need
+ *   anything that only a backtracker can provide, though: with no group
+ *   registers, back-references, assertions, or counted loops, the result of
+ *   a match is simply the longest (or, in <Min> mode, shortest) prefix of
+ *   the subject that some path through the machine accepts - and that's
+ *   exactly what a DFA computes, in time linear in the subject length.
+ *   
+ *   We build the DFA lazily, one state at a time, as subject characters
+ *   call for new transitions, and cache the transitions for ASCII
+ *   characters.  Each DFA state is the set of NFA states (plus offsets into
+ *   literal strings) that are alive at a given point in the subject.
+ *   
+ *   The DFA only does exact character comparisons, so it's only used for
+ *   case-sensitive matches; case folding can match different numbers of
+ *   characters on the two sides, which doesn't fit the model.  
+ */
+
+/* match() result when the DFA can't proceed */
+#define RE_DFA_GAVE_UP  (-2)
+
+/* maximum number of DFA states we'll build for a pattern */
+#define RE_DFA_MAX_STATES  128
+
+struct re_dfa_state;
+
+class CRegexDFA
+{
+public:
+    /* 
+     *   Create a DFA for a compiled pattern.  Returns null if the pattern
+     *   uses any feature that requires the backtracking matcher.  
+     */
+    static CRegexDFA *create(const re_compiled_pattern *pattern);
+
+    ~CRegexDFA();
+
+    /*
+     *   Match the leading substring of the given string, returning the byte
+     *   length of the match, or -1 if there's no match.  Returns
+     *   RE_DFA_GAVE_UP if the match needs a new state after we've reached
+     *   our state limit, in which case the caller must fall back on the
+     *   backtracking matcher.  
+     */
+    int match(const char *str, size_t len);
+
+    /*
+     *   Get the lead byte of the character that every match must start
+     *   with, or -1 if there's no single such character.  A search can use
+     *   this to skip quickly past positions where no match can start.  
+     */
+    int get_lead_byte() const { return lead_byte_; }
+
+protected:
+    CRegexDFA(const re_compiled_pattern *pattern, size_t max_items);
+
+    /* check a pattern's machine for features we can't handle */
+    static int can_handle(const re_compiled_pattern *pattern,
+                          size_t *max_items);
+
+    /* does the given single-character recognizer match a character? */
+    static int char_matches(const re_tuple *t, wchar_t ch);
+
+    /* add the epsilon closure of an NFA state to the work list */
+    void add_closure(re_state_id id);
+
+    /* find or create the DFA state for the current work list */
+    re_dfa_state *intern();
+
+    /* compute the transition from a state on a character */
+    re_dfa_state *step(re_dfa_state *s, wchar_t ch);
+
+    /* the machine's tuple array and final state */
+    const re_tuple *tuples_;
+    re_state_id final_;
+
+    /* <Max> mode? */
+    int longest_;
+
+    /* starting state */
+    re_dfa_state *start_;
+
+    /* lead byte, or -1 */
+    int lead_byte_;
+
+    /* state hash table, and the list of all states */
+    re_dfa_state *buckets_[64];
+    re_dfa_state *states_;
+    int state_cnt_;
+
+    /* 
+     *   Work list for building a state: the items found so far, and whether
+     *   the final state is in the set.  Items are encoded as (offset << 16)
+     *   | state, where offset is the position within a literal string.  
+     */
+    unsigned int *work_;
+    size_t work_cnt_;
+    int work_accepting_;
+
+    /* closure traversal stack, and visit marks (stamped with mark_gen_) */
+    re_state_id *stk_;
+    unsigned int *marks_;
+    unsigned int mark_gen_;
+};
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Regular Expression Searcher/Matcher.  This object encapsulates the
@@ -1332,5 +1447,117 @@ protected:
     class CRegexParser *parser_;
 };
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Compiled pattern cache.  Programs often pass the same regular expression
+ *   strings to the search functions over and over, typically as literals in
+ *   a loop, and compiling an expression is much more work than a typical
+ *   search with it.  This cache keeps the most recently used compiled
+ *   patterns, keyed on the expression text, so that repeated searches with
+ *   the same string can skip the compilation.
+ *   
+ *   Compilation doesn't depend on any search options (the default case
+ *   sensitivity is applied by the searcher at search time), so the text
+ *   alone is a sufficient key.
+ *   
+ *   Callers hold a reference on each pattern they're using, and must
+ *   release it when done.  A pattern with outstanding references is never
+ *   evicted, since a search could be in progress with it (a rexReplace()
+ *   callback, for example, can run further searches that would otherwise
+ *   push it out of the cache).  
+ */
+struct re_cached_pattern
+{
+    /* the compiled pattern */
+    re_compiled_pattern *pat;
+
+    /* hash chain link */
+    re_cached_pattern *nxt_hash;
+
+    /* LRU list links - the list runs from most to least recently used */
+    re_cached_pattern *lru_prv;
+    re_cached_pattern *lru_nxt;
+
+    /* hash value of the expression text */
+    unsigned long hash;
+
+    /* number of outstanding references */
+    int refs;
+
+    /* the expression text (overallocated to the actual length) */
+    size_t len;
+    char str[1];
+};
+
+class CRegexCache
+{
+public:
+    /* 
+     *   create; 'max_entries' is the maximum number of patterns we keep
+     *   (not counting patterns that are in use) 
+     */
+    CRegexCache(class CRegexParser *parser, size_t max_entries);
+    ~CRegexCache();
+
+    /* 
+     *   Get the compiled pattern for the given expression, compiling it if
+     *   it's not already in the cache.  This adds a reference to the
+     *   pattern, which the caller must drop with release() when done.
+     *   Returns null if the expression can't be compiled.  
+     */
+    re_cached_pattern *get(const char *expr, size_t exprlen);
+
+    /* release a reference obtained with get() */
+    void release(re_cached_pattern *entry)
+        { --entry->refs; }
+
+    /* discard all patterns that aren't in use */
+    void flush();
+
+    /* get statistics */
+    unsigned long get_hits() const { return hits_; }
+    unsigned long get_misses() const { return misses_; }
+    unsigned long get_evictions() const { return evictions_; }
+    size_t get_count() const { return cnt_; }
+
+protected:
+    /* number of hash buckets - a power of two */
+    static const size_t HASH_SIZE = 128;
+
+    /* calculate the hash value of a string */
+    static unsigned long calc_hash(const char *str, size_t len);
+
+    /* unlink an entry from the LRU list */
+    void lru_unlink(re_cached_pattern *entry);
+
+    /* link an entry at the head of the LRU list */
+    void lru_link_head(re_cached_pattern *entry);
+
+    /* remove an entry from the cache and delete it */
+    void remove(re_cached_pattern *entry);
+
+    /* evict least recently used unreferenced patterns to fit our limit */
+    void trim();
+
+    /* our parser, for compiling new patterns */
+    class CRegexParser *parser_;
+
+    /* hash table */
+    re_cached_pattern *buckets_[HASH_SIZE];
+
+    /* LRU list head (most recent) and tail (least recent) */
+    re_cached_pattern *lru_head_;
+    re_cached_pattern *lru_tail_;
+
+    /* number of entries, and the maximum we keep */
+    size_t cnt_;
+    size_t max_cnt_;
+
+    /* statistics */
+    unsigned long hits_;
+    unsigned long misses_;
+    unsigned long evictions_;
+};
+
 #endif /* VMREGEX_H */
 
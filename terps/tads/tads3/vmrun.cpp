@@ -46,6 +46,8 @@ Modified
 #include "vmfref.h"
 #include "vmop.h"
 #include "vmbignum.h"
+#include "vmbiftad.h"
+#include "vmregex.h"
 
 
 /* ------------------------------------------------------------------------ */
@@ -6086,11 +6088,14 @@ public:
 /*
  *   Begin profiling 
  */
-void CVmRun::start_profiling()
+void CVmRun::start_profiling(VMG0_)
 {
     /* clear any old profiler data from the master hash table */
     prof_master_table_->delete_all_entries();
 
+    /* start counting property cache lookups afresh */
+    G_tadsobj_cache->reset_stats();
+
     /* reset the profiler stack */
     prof_stack_idx_ = 0;
 
@@ -6155,6 +6160,18 @@ void CVmRun::get_profiling_data(VMG_
 
     /* enumerate the master table entries through our callback */
     prof_master_table_->enum_entries(&prof_enum_cb, &our_ctx);
+
+    /* report the property lookup cache statistics */
+    (*cb)(cb_ctx, "<property cache hits>", 0, 0,
+          G_tadsobj_cache->get_hits());
+    (*cb)(cb_ctx, "<property cache misses>", 0, 0,
+          G_tadsobj_cache->get_misses());
+
+    /* and the compiled regular expression cache statistics */
+    (*cb)(cb_ctx, "<regex cache hits>", 0, 0,
+          G_bif_tads_globals->rex_cache->get_hits());
+    (*cb)(cb_ctx, "<regex cache misses>", 0, 0,
+          G_bif_tads_globals->rex_cache->get_misses());
 }
 
 /*
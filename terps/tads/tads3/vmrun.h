@@ -1077,14 +1077,17 @@ public:
      *   end_profiling() is called.  This function is only included in the
      *   build if the profiler is included in the build.  
      */
-    void start_profiling();
+    void start_profiling(VMG0_);
 
     /* end profiling */
     void end_profiling();
 
     /* 
      *   get the profiling data - we'll invoke the callback once for each
-     *   function in our table of data 
+     *   function in our table of data, then once each for the hit and miss
+     *   counts of the TadsObject property lookup cache and the compiled
+     *   regular expression cache (as pseudo-functions with the count in
+     *   'call_cnt' and zero times) 
      */
     void get_profiling_data(VMG_
                             void (*cb)(void *ctx, const char *func_name,
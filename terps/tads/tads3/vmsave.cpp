@@ -90,6 +90,26 @@ Modified
  */
 #define VMSAVEFILE_SIG "T3-state-v000A\015\012\032"
 
+/*
+ *   Flush a file's writes through to the disk.  This isn't part of the
+ *   portable OS interface, so fall back on an ordinary flush on systems
+ *   that don't provide it.  
+ */
+#ifndef osfsync
+#define osfsync(fp) osfflush(fp)
+#endif
+
+/*
+ *   Rename a file over an existing file in one step.  This isn't part of
+ *   the portable OS interface either.  Without it, we can only rename,
+ *   and we assume that rename won't replace an existing file, so we have
+ *   to delete the old file first.  
+ */
+#ifndef os_replace_file
+#define os_replace_file(from, to) os_rename_file(from, to)
+#define VMSAVE_DELETE_BEFORE_RENAME
+#endif
+
 
 /* ------------------------------------------------------------------------ */
 /*
@@ -101,10 +121,14 @@ static unsigned long compute_checksum(CVmFile *fp, unsigned long len)
 {
     CVmCRC32 crc;
 
-    /* read the file and compute the CRC value for its contents */
+    /* 
+     *   read the file and compute the CRC value for its contents; saved
+     *   states run to hundreds of kilobytes for a big game, so read in
+     *   reasonably large blocks 
+     */
     while (len != 0)
     {
-        char buf[256];
+        char buf[8192];
         size_t cur_len;
         
         /* figure out how much we can load from the file */
@@ -274,6 +298,71 @@ void CVmSaveFile::save(VMG_ CVmFile *fp, CVmObjLookupTable *metatab)
     fp->set_pos(endpos);
 }
 
+/*
+ *   Save VM state to a named file, via a temporary file 
+ */
+void CVmSaveFile::save(VMG_ const char *fname, CVmObjLookupTable *metatab)
+{
+    /* build the temporary file name - the target name plus a suffix */
+    char tmpname[OSFNMAX + 16];
+    t3sprintf(tmpname, sizeof(tmpname), "%s.tmp", fname);
+
+    /* open the temporary file */
+    osfildef *fp = osfoprwtb(tmpname, OSFTT3SAV);
+    if (fp == 0)
+        err_throw(VMERR_CREATE_FILE);
+
+    /* set up the file writer */
+    CVmFile *file = new CVmFile();
+    file->set_file(fp, 0);
+
+    err_try
+    {
+        /* save the state */
+        save(vmg_ file, metatab);
+
+        /* make sure it's all on the disk before we replace the old file */
+        if (osfsync(fp))
+            err_throw(VMERR_WRITE_FILE);
+    }
+    err_catch_disc
+    {
+        /* close and delete the temporary file */
+        delete file;
+        osfdel(tmpname);
+
+        /* rethrow the error */
+        err_rethrow();
+    }
+    err_end;
+
+    /* close the file */
+    delete file;
+
+    /* move the new file into place, replacing the old one */
+    if (!os_replace_file(tmpname, fname))
+    {
+#ifdef VMSAVE_DELETE_BEFORE_RENAME
+        /* 
+         *   The old file might be in the way, so delete it and try again.
+         *   If the second attempt fails, the temporary file is all that's
+         *   left of the saved state, so keep it (under its temporary name)
+         *   rather than losing the game.  
+         */
+        if (osfacc(fname) == 0 && osfdel(fname) == 0)
+        {
+            if (!os_replace_file(tmpname, fname))
+                err_throw(VMERR_WRITE_FILE);
+            return;
+        }
+#endif
+
+        /* the old file is intact, so just discard the new one */
+        osfdel(tmpname);
+        err_throw(VMERR_WRITE_FILE);
+    }
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Given a saved state file, get the name of the image file that was
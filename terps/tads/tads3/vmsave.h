@@ -45,6 +45,21 @@ public:
     static void save(VMG_ class CVmFile *fp,
                      class CVmObjLookupTable *metadata);
 
+    /*
+     *   Save state to a named file.  Rather than overwriting the file in
+     *   place, we write the new state to a temporary file in the same
+     *   directory, flush it all the way to the disk, and then rename it
+     *   over the original.  This way, a save that fails partway through
+     *   (a full disk, say) leaves any existing file intact, and a crash
+     *   can't leave a half-written file behind under the real name.
+     *   On a system that can't rename over an existing file, we have to
+     *   delete the old file first; if the rename still fails after that,
+     *   we leave the new state in the temporary file ("<fname>.tmp")
+     *   rather than deleting it.  Throws an error on failure.  
+     */
+    static void save(VMG_ const char *fname,
+                     class CVmObjLookupTable *metadata);
+
     /* 
      *   given a saved state file, read the name of the image file that
      *   created it 
@@ -470,11 +470,12 @@ void CVmObjString::set_prop(VMG_ CVmUndo *, vm_obj_id_t,
  */
 void CVmObjString::save_to_file(VMG_ CVmFile *fp)
 {
-    /* get our length */
-    size_t len = vmb_get_len(ext_);
+    /* get our text and its length */
+    const char *str = get_as_string(vmg0_);
+    size_t len = vmb_get_len(str);
 
     /* write the length prefix and the string */
-    fp->write_bytes(ext_, len + VMB_LEN);
+    fp->write_bytes(str, len + VMB_LEN);
 }
 
 /*
@@ -518,7 +519,8 @@ long CVmObjString::cast_to_int(VMG0_) const
      *   explicit int cast, so don't allow BigNumber promotions 
      */
     vm_val_t val;
-    parse_num_val(vmg_ &val, ext_ + VMB_LEN, vmb_get_len(ext_), 10, TRUE);
+    const char *str = get_as_string(vmg0_);
+    parse_num_val(vmg_ &val, str + VMB_LEN, vmb_get_len(str), 10, TRUE);
 
     /* return the integer value */
     return val.val.intval;
@@ -534,7 +536,8 @@ void CVmObjString::cast_to_num(VMG_ vm_val_t *val, vm_obj_id_t self) const
      *   return whatever numeric type is needed to represent the value, so
      *   allow BigNumber promotions if necessary. 
      */
-    parse_num_val(vmg_ val, ext_ + VMB_LEN, vmb_get_len(ext_), 10, FALSE);
+    const char *str = get_as_string(vmg0_);
+    parse_num_val(vmg_ val, str + VMB_LEN, vmb_get_len(str), 10, FALSE);
 }
 
 /*
@@ -733,6 +736,69 @@ void CVmObjString::add_to_str(VMG_ vm_val_t *result,
     CVmObjString *objptr;
     vm_val_t new_obj2;
 
+    /* 
+     *   If either side is long enough, defer the copying by building a
+     *   concatenation object instead (see CVmObjStringRope).  Note that we
+     *   can only tell the right side's length in advance if it's already a
+     *   string; for other types, we count on the left side.  
+     */
+    if (val->typ != VM_NIL && get_str_len(vmg_ self, &len1))
+    {
+        vm_val_t right;
+        int is_str = get_str_len(vmg_ val, &len2);
+
+        if (len1 >= VMSTR_ROPE_MIN
+            || (is_str && len2 >= VMSTR_ROPE_MIN && len1 != 0))
+        {
+            /* 
+             *   push self to protect it from garbage collection while we
+             *   create the new objects 
+             */
+            G_stk->push(self);
+
+            /* 
+             *   if the right side is a string, use it as is; otherwise
+             *   convert it, and make sure we have the result as an object 
+             */
+            if (is_str)
+            {
+                right = *val;
+            }
+            else
+            {
+                strval2 = cvt_to_str(vmg_ &new_obj2, buf, sizeof(buf),
+                                     val, 10, 0);
+                len2 = vmb_get_len(strval2);
+
+                if (new_obj2.typ == VM_OBJ
+                    && vm_objp(vmg_ new_obj2.val.obj)->get_as_string(vmg0_)
+                       == strval2)
+                    right = new_obj2;
+                else if (len2 != 0)
+                    right.set_obj(create(vmg_ FALSE,
+                                         strval2 + VMB_LEN, len2));
+            }
+
+            if (len2 == 0)
+            {
+                /* we're appending nothing to the string; just return 'self' */
+                *result = *self;
+            }
+            else
+            {
+                /* protect the right side, and create the concatenation */
+                G_stk->push(&right);
+                result->set_obj(CVmObjStringRope::create(
+                    vmg_ self, &right, len1 + len2));
+                G_stk->discard();
+            }
+
+            /* done with the protection for self */
+            G_stk->discard();
+            return;
+        }
+    }
+
     /* 
      *   Get the string buffer pointers.  The left value is already a string,
      *   or we wouldn't be here.  The right value can be anything, though, so
@@ -792,6 +858,39 @@ void CVmObjString::add_to_str(VMG_ vm_val_t *result,
 }
 
 
+/*
+ *   Get the byte length of a string value 
+ */
+int CVmObjString::get_str_len(VMG_ const vm_val_t *val, size_t *len)
+{
+    switch (val->typ)
+    {
+    case VM_SSTRING:
+        /* constant string - read the length from the constant pool */
+        *len = vmb_get_len(G_const_pool->get_ptr(val->val.ofs));
+        return TRUE;
+
+    case VM_OBJ:
+        /* 
+         *   String object - read the length prefix from the extension.
+         *   Every kind of string object (including a concatenation whose
+         *   text we haven't built yet) keeps the length there. 
+         */
+        if (is_string_obj(vmg_ val->val.obj))
+        {
+            *len = vmb_get_len(
+                ((CVmObjString *)vm_objp(vmg_ val->val.obj))->ext_);
+            return TRUE;
+        }
+        return FALSE;
+
+    default:
+        /* other types aren't strings */
+        return FALSE;
+    }
+}
+
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Allocate a string buffer large enough to hold a given value.  We'll
@@ -1088,7 +1187,7 @@ int CVmObjString::equals(VMG_ vm_obj_id_t self,
      *   use the constant string comparison routine, using our underlying
      *   string as the constant string data 
      */
-    return const_equals(vmg_ ext_, val);
+    return const_equals(vmg_ get_as_string(vmg0_), val);
 }
 
 /*
@@ -1127,7 +1226,7 @@ int CVmObjString::const_equals(VMG_ const char *str, const vm_val_t *val)
  */
 uint CVmObjString::calc_hash(VMG_ vm_obj_id_t self, int /*depth*/) const
 {
-    return const_calc_hash(ext_);
+    return const_calc_hash(get_as_string(vmg0_));
 }
 
 /*
@@ -1160,7 +1259,7 @@ int CVmObjString::compare_to(VMG_ vm_obj_id_t /*self*/,
                              const vm_val_t *val) const
 {
     /* use the static string magnitude comparison routine */
-    return const_compare(vmg_ ext_, val);
+    return const_compare(vmg_ get_as_string(vmg0_), val);
 }
 
 /*
@@ -1425,7 +1524,8 @@ int CVmObjString::get_prop(VMG_ vm_prop_id_t prop, vm_val_t *retval,
     
     /* use the constant evaluator */
     self_val.set_obj(self);
-    if (const_get_prop(vmg_ retval, &self_val, ext_, prop, source_obj, argc))
+    if (const_get_prop(vmg_ retval, &self_val, get_as_string(vmg0_),
+                       prop, source_obj, argc))
     {
         *source_obj = metaclass_reg_->get_class_obj(vmg0_);
         return TRUE;
@@ -4301,3 +4401,174 @@ vm_obj_id_t CVmObjStringConst::create(VMG_ const char *const_ptr)
     /* return the new ID */
     return id;
 }
+
+
+/* ------------------------------------------------------------------------ */
+/*
+ *   Concatenation string object 
+ */
+
+/*
+ *   create 
+ */
+vm_obj_id_t CVmObjStringRope::create(VMG_ const vm_val_t *left,
+                                     const vm_val_t *right, size_t len)
+{
+    /* 
+     *   create our new ID - we reference our operands until we build our
+     *   text, so we can have references 
+     */
+    vm_obj_id_t id = vm_new_id(vmg_ FALSE, TRUE, FALSE);
+
+    /* create the object */
+    new (vmg_ id) CVmObjStringRope(vmg_ left, right, len);
+
+    /* return the new ID */
+    return id;
+}
+
+/*
+ *   construct 
+ */
+CVmObjStringRope::CVmObjStringRope(VMG_ const vm_val_t *left,
+                                   const vm_val_t *right, size_t len)
+{
+    /* check for the length limit */
+    if (len > 65535)
+        err_throw(VMERR_STR_TOO_LONG);
+
+    /* allocate and fill in our extension */
+    ext_ = (char *)G_mem->get_var_heap()->alloc_mem(
+        sizeof(vm_strrope_ext), this);
+    vmb_put_len(get_ext()->len, len);
+    get_ext()->flat = 0;
+    get_ext()->left = *left;
+    get_ext()->right = *right;
+}
+
+/*
+ *   receive notification of deletion 
+ */
+void CVmObjStringRope::notify_delete(VMG_ int in_root_set)
+{
+    /* free the text, if we built it */
+    if (ext_ != 0 && get_ext()->flat != 0)
+        G_mem->get_var_heap()->free_mem(get_ext()->flat);
+
+    /* inherit the default handling to free the extension */
+    CVmObjString::notify_delete(vmg_ in_root_set);
+}
+
+/*
+ *   mark references 
+ */
+void CVmObjStringRope::mark_refs(VMG_ uint state)
+{
+    /* 
+     *   mark our operands (once we've built our text, we've forgotten
+     *   these, so they'll simply be nil) 
+     */
+    if (get_ext()->left.typ == VM_OBJ)
+        G_obj_table->mark_all_refs(get_ext()->left.val.obj, state);
+    if (get_ext()->right.typ == VM_OBJ)
+        G_obj_table->mark_all_refs(get_ext()->right.val.obj, state);
+}
+
+/*
+ *   get the text 
+ */
+const char *CVmObjStringRope::get_as_string(VMG0_) const
+{
+    /* build the text if we haven't already */
+    if (get_ext()->flat == 0)
+        ((CVmObjStringRope *)this)->flatten(vmg0_);
+
+    /* return the text */
+    return get_ext()->flat;
+}
+
+/*
+ *   Build the text.  Our operands can themselves be concatenations, so we
+ *   have a tree of strings to copy.  We fill in the buffer from the end:
+ *   for each node, we stack the left operand and move on to the right
+ *   operand, until we reach a string that has its text; we copy that in
+ *   front of what we've copied so far, then pop the next node off the
+ *   stack.  Strings building up with "str += x" give us a tree that leans
+ *   to the left, which keeps the stack shallow; for the other direction,
+ *   the stack grows as needed.  
+ */
+void CVmObjStringRope::flatten(VMG0_)
+{
+    vm_strrope_ext *ext = get_ext();
+    size_t len = vmb_get_len(ext->len);
+    vm_val_t stkbuf[32];
+    vm_val_t *stk = stkbuf;
+    size_t stkmax = countof(stkbuf);
+    size_t depth;
+    vm_val_t cur;
+
+    /* allocate our text buffer */
+    char *flat = (char *)G_mem->get_var_heap()->alloc_mem(
+        len + VMB_LEN, this);
+    vmb_put_len(flat, len);
+
+    /* start at the end of the buffer, with our right operand */
+    char *dst = flat + VMB_LEN + len;
+    stk[0] = ext->left;
+    depth = 1;
+    cur = ext->right;
+
+    for (;;)
+    {
+        const vm_strrope_ext *sub;
+
+        /* descend into the right side of any unbuilt concatenations */
+        while (cur.typ == VM_OBJ
+               && (sub = ((CVmObjString *)vm_objp(vmg_ cur.val.obj))
+                   ->get_rope_ext()) != 0)
+        {
+            /* make room on the stack if necessary */
+            if (depth == stkmax)
+            {
+                stkmax *= 2;
+                if (stk == stkbuf)
+                {
+                    stk = (vm_val_t *)t3malloc(stkmax * sizeof(vm_val_t));
+                    memcpy(stk, stkbuf, sizeof(stkbuf));
+                }
+                else
+                    stk = (vm_val_t *)t3realloc(
+                        stk, stkmax * sizeof(vm_val_t));
+            }
+
+            /* stack the left side, and move on to the right side */
+            stk[depth++] = sub->left;
+            cur = sub->right;
+        }
+
+        /* copy this string's text in front of what we have so far */
+        const char *str = cur.get_as_string(vmg0_);
+        size_t curlen = vmb_get_len(str);
+        dst -= curlen;
+        memcpy(dst, str + VMB_LEN, curlen);
+
+        /* if the stack is empty, we're done */
+        if (depth == 0)
+            break;
+
+        /* go back for the next left side */
+        cur = stk[--depth];
+    }
+
+    /* free the stack if we allocated it */
+    if (stk != stkbuf)
+        t3free(stk);
+
+    /* 
+     *   Save the text.  We no longer need our operands, so forget them, so
+     *   that they can be collected if nothing else wants them. 
+     */
+    ext->flat = flat;
+    ext->left.set_nil();
+    ext->right.set_nil();
+}
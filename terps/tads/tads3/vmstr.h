@@ -208,8 +208,8 @@ public:
         /* we are the string object */
         new_str->set_obj(self);
         
-        /* return our extension directly */
-        return ext_;
+        /* return our underlying string */
+        return get_as_string(vmg0_);
     }
 
     /* convert a value to string via reflection services in the bytecode */
@@ -220,6 +220,13 @@ public:
     /* get the underlying string */
     const char *get_as_string(VMG0_) const { return ext_; }
 
+    /*
+     *   Get the pending concatenation, if this is a concatenation whose text
+     *   we haven't built yet (see CVmObjStringRope).  Returns null for an
+     *   ordinary string.  
+     */
+    virtual const struct vm_strrope_ext *get_rope_ext() const { return 0; }
+
     /* cast to integer */
     virtual long cast_to_int(VMG0_) const;
 
@@ -243,6 +250,13 @@ public:
     static void add_to_str(VMG_ vm_val_t *result,
                            const vm_val_t *self, const vm_val_t *val);
 
+    /*
+     *   Get the byte length of a string value without building the text of
+     *   a pending concatenation.  Returns false if the value isn't a string
+     *   (constant or object).  
+     */
+    static int get_str_len(VMG_ const vm_val_t *val, size_t *len);
+
     /* 
      *   Check a value for equality.  We will match any constant string
      *   that contains the same text as our string, and any other string
@@ -643,6 +657,81 @@ protected:
 };
 
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   A concatenation ("rope") string.  Building a long string with a series
+ *   of '+' operations copies the whole string so far on each step, which
+ *   makes a loop like "str += x" quadratic in the result length, and
+ *   leaves every intermediate copy behind for the garbage collector.  To
+ *   avoid this, when either operand is long, add_to_str() creates one of
+ *   these instead of copying: it simply remembers the two operands, and
+ *   builds the text on the first request for it.  Until then, a series of
+ *   concatenations forms a tree of these objects, which we flatten in one
+ *   pass, copying each leaf string once.
+ *   
+ *   To the rest of the system, this is just a string.  It reports the
+ *   String metaclass, and the text is available through get_as_string()
+ *   as usual - every CVmObjString method that needs the text goes through
+ *   that, rather than reading the extension directly.  Once built, the
+ *   text is saved, written to images, and so on like any other string's.  
+ */
+
+/* minimum operand length (in bytes) for deferring a concatenation */
+#define VMSTR_ROPE_MIN  256
+
+/* 
+ *   Concatenation extension.  The length prefix is laid out exactly as in
+ *   an ordinary string's extension, so the length of any string object can
+ *   be read from its extension without building the text.  
+ */
+struct vm_strrope_ext
+{
+    /* byte length of the string, in portable UINT2 format */
+    char len[VMB_LEN];
+
+    /* the text in ordinary string format, or null if not built yet */
+    char *flat;
+
+    /* the two strings we're concatenating */
+    vm_val_t left;
+    vm_val_t right;
+};
+
+class CVmObjStringRope: public CVmObjString
+{
+public:
+    /* 
+     *   create a concatenation of two string values (constants or objects)
+     *   with the given combined byte length 
+     */
+    static vm_obj_id_t create(VMG_ const vm_val_t *left,
+                              const vm_val_t *right, size_t len);
+
+    /* notify of deletion */
+    void notify_delete(VMG_ int in_root_set);
+
+    /* mark references - we keep our operands alive until we're built */
+    void mark_refs(VMG_ uint state);
+
+    /* get the underlying string, building it if we haven't yet */
+    const char *get_as_string(VMG0_) const;
+
+    /* get the pending concatenation */
+    const struct vm_strrope_ext *get_rope_ext() const
+        { return get_ext()->flat == 0 ? get_ext() : 0; }
+
+protected:
+    CVmObjStringRope(VMG_ const vm_val_t *left, const vm_val_t *right,
+                     size_t len);
+
+    /* get my extension */
+    vm_strrope_ext *get_ext() const { return (vm_strrope_ext *)ext_; }
+
+    /* build the text */
+    void flatten(VMG0_);
+};
+
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Registration table object 
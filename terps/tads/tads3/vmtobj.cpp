@@ -322,6 +322,11 @@ void CVmObjTads::class_init(VMG0_)
     VM_IFELSE_ALLOC_PRE_GLOBAL(
         G_tadsobj_queue = new CVmObjTadsInhQueue(),
         G_tadsobj_queue->init());
+
+    /* allocate the property lookup cache */
+    VM_IFELSE_ALLOC_PRE_GLOBAL(
+        G_tadsobj_cache = new CVmObjTadsPropCache(),
+        G_tadsobj_cache->init());
 }
 
 /*
@@ -333,6 +338,9 @@ void CVmObjTads::class_term(VMG0_)
     VM_IF_ALLOC_PRE_GLOBAL(
         delete G_tadsobj_queue;
         G_tadsobj_queue = 0;
+
+        delete G_tadsobj_cache;
+        G_tadsobj_cache = 0;
     )
 }
 
@@ -796,6 +804,13 @@ void CVmObjTads::set_prop(VMG_ CVmUndo *undo, vm_obj_id_t self,
         /* allocate a new entry */
         entry = hdr->alloc_prop_entry(prop, val, 0);
 
+        /* 
+         *   if we're on a cached search path, the new property could
+         *   override an inherited definition recorded in the cache 
+         */
+        if ((hdr->intern_obj_flags & VMTO_OBJ_PCACHE) != 0)
+            G_tadsobj_cache->invalidate();
+
         /* 
          *   The old value didn't exist, so mark it emtpy, with an intval of
          *   zero.  The zero indicates that this is a newly created property
@@ -1033,6 +1048,34 @@ struct tadsobj_sc_search_ctx
         return FALSE;
     }
 
+    /*
+     *   Find the given property, as in find_prop(), marking each object we
+     *   visit as lying on a cached search path.  Use this when the result
+     *   will be stored in the property lookup cache.  
+     */
+    int find_prop_for_cache(VMG_ uint prop, vm_val_t *val,
+                            vm_obj_id_t *source)
+    {
+        do
+        {
+            /* changes to this object's properties now affect the cache */
+            curhdr->intern_obj_flags |= VMTO_OBJ_PCACHE;
+
+            /* look for this property in the current object */
+            vm_tadsobj_prop *entry = curhdr->find_prop_entry(prop);
+            if (entry != 0)
+            {
+                *val = entry->val;
+                *source = cur;
+                return TRUE;
+            }
+        }
+        while (to_next(vmg0_));
+
+        /* not found */
+        return FALSE;
+    }
+
     /*  
      *   Move to the next superclass.  This updates 'cur' to refer to the
      *   next object in inheritance order.  Returns true if there is a next
@@ -1226,6 +1269,74 @@ int CVmObjTads::search_for_prop_from(VMG_ uint prop,
     return curpos.find_prop(vmg_ prop, val, source_obj);
 }
 
+/*
+ *   Search my superclasses for a property.  With a single superclass, the
+ *   search is exactly a search starting at that superclass, so that's the
+ *   key we use for the lookup cache, which lets all of the instances of a
+ *   class share its cache entries.  With multiple superclasses, the search
+ *   follows my own linearized inheritance path, so we key on myself.  
+ */
+int CVmObjTads::search_sc_for_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
+                                   vm_obj_id_t self, vm_obj_id_t *source_obj)
+{
+    vm_tadsobj_hdr *hdr = get_hdr();
+    vm_obj_id_t key;
+    CVmObjTads *keyp;
+
+    /* figure the cache key */
+    if (hdr->sc_cnt == 1)
+    {
+        key = hdr->sc[0].id;
+        keyp = hdr->sc[0].objp;
+    }
+    else
+    {
+        key = self;
+        keyp = this;
+    }
+
+    /* check the cache, if the key is eligible */
+    int cacheable = G_obj_table->is_obj_in_root_set(key);
+    vm_obj_id_t src;
+    if (cacheable && G_tadsobj_cache->find(key, prop, &src))
+    {
+        /* if the cache says it's not defined, we're done */
+        if (src == VM_INVALID_OBJ)
+            return FALSE;
+
+        /* fetch the current value from the defining object */
+        vm_tadsobj_prop *entry =
+            ((CVmObjTads *)vm_objp(vmg_ src))->get_hdr()
+            ->find_prop_entry(prop);
+        if (entry != 0)
+        {
+            *val = entry->val;
+            *source_obj = src;
+            return TRUE;
+        }
+
+        /* 
+         *   we shouldn't get here, since any change that drops the
+         *   definition invalidates the cache, but if we do, simply fall
+         *   back on a full search 
+         */
+    }
+
+    /* set up the search; if I'm the key, skip myself, as I've been searched */
+    tadsobj_sc_search_ctx curpos(vmg_ key, keyp);
+    if (key == self && !curpos.to_next(vmg0_))
+        return FALSE;
+
+    /* if we can't cache the result, just search */
+    if (!cacheable)
+        return curpos.find_prop(vmg_ prop, val, source_obj);
+
+    /* search, and remember the result */
+    int found = curpos.find_prop_for_cache(vmg_ prop, val, source_obj);
+    G_tadsobj_cache->add(key, prop, found ? *source_obj : VM_INVALID_OBJ);
+    return found;
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Get a property.  We first look in this object; if we can't find the
@@ -1235,12 +1346,19 @@ int CVmObjTads::get_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
                          vm_obj_id_t self, vm_obj_id_t *source_obj,
                          uint *argc)
 {
-    /* 
-     *   try finding the property in my own direct property list or a
-     *   superclass property list 
-     */
-    tadsobj_sc_search_ctx curpos(vmg_ self, this);
-    if (curpos.find_prop(vmg_ prop, val, source_obj))
+    /* try finding the property in my own direct property list */
+    vm_tadsobj_hdr *hdr = get_hdr();
+    vm_tadsobj_prop *entry = hdr->find_prop_entry(prop);
+    if (entry != 0)
+    {
+        *val = entry->val;
+        *source_obj = self;
+        return TRUE;
+    }
+
+    /* try inheriting it from a superclass property list */
+    if (hdr->sc_cnt != 0
+        && search_sc_for_prop(vmg_ prop, val, self, source_obj))
         return TRUE;
 
     /* 
@@ -1524,6 +1642,10 @@ void CVmObjTads::apply_undo(VMG_ CVmUndoRecord *rec)
                     /* return it to the free list */
                     hdr->prop_entry_free -= 1;
                     assert(entry == &hdr->prop_entry_arr[hdr->prop_entry_free]);
+
+                    /* the cache might point to this definition */
+                    if ((hdr->intern_obj_flags & VMTO_OBJ_PCACHE) != 0)
+                        G_tadsobj_cache->invalidate();
                 }
                 else
                 {
@@ -1730,9 +1852,10 @@ void CVmObjTads::restore_from_file(VMG_ vm_obj_id_t self,
 
     /* 
      *   invalidate any existing inheritance path, in case the superclass
-     *   list changed 
+     *   list changed, and likewise any cached property lookups 
      */
     hdr->inval_inh_path();
+    G_tadsobj_cache->invalidate();
 
     /* read the modified properties */
     for (ushort i = 0 ; i < mod_count ; ++i)
@@ -1814,6 +1937,12 @@ void CVmObjTads::load_from_image(VMG_ vm_obj_id_t self,
     /* read the object flags from the image file and store them */
     hdr->li_obj_flags = osrp2(ptr + 4);
 
+    /* 
+     *   a newly loaded object (from dynamic code, say) can change the
+     *   inheritance structure, so forget any cached lookups 
+     */
+    G_tadsobj_cache->invalidate();
+
     /* 
      *   set our internal flags - we come from the load image file, and we're
      *   not yet modified from the load image data
@@ -1851,6 +1980,9 @@ void CVmObjTads::reload_from_image(VMG_ vm_obj_id_t self,
     hdr->prop_entry_free = 0;
     memset(hdr->hash_arr, 0, hdr->hash_siz * sizeof(hdr->hash_arr[0]));
 
+    /* that drops any runtime additions, so forget cached lookups */
+    G_tadsobj_cache->invalidate();
+
     /* if we need space for more superclasses, reallocate the header */
     if (sc_cnt > hdr->sc_cnt)
     {
@@ -2265,8 +2397,9 @@ void CVmObjTads::change_superclass_list(VMG_ const vm_val_t *lst, int cnt)
         hdr->sc[i].objp = (CVmObjTads *)vm_objp(vmg_ ele.val.obj);
     }
 
-    /* invalidate the cached inheritance path */
+    /* invalidate the cached inheritance path and property lookups */
     hdr->inval_inh_path();
+    G_tadsobj_cache->invalidate();
 }
 
 /* ------------------------------------------------------------------------ */
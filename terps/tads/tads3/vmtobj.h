@@ -43,6 +43,7 @@ Modified
 #include "vmglob.h"
 #include "vmobj.h"
 #include "vmundo.h"
+#include "vmprof.h"
 
 /* forward-declare our main class */
 class CVmObjTads;
@@ -230,6 +231,13 @@ struct vm_tadsobj_prop
 /* modified - object has been modified since being loaded from image */
 #define VMTO_OBJ_MOD     0x0002
 
+/* 
+ *   cached - the object lies on an inheritance search path recorded in the
+ *   global property lookup cache, so adding or removing one of its
+ *   properties must invalidate the cache 
+ */
+#define VMTO_OBJ_PCACHE  0x0004
+
 
 /*
  *   Property entry flags 
@@ -559,6 +567,14 @@ protected:
                                     vm_obj_id_t *source_obj,
                                     vm_obj_id_t defining_obj);
 
+    /*
+     *   Search my superclasses for a property, after failing to find it in
+     *   my own property table.  This consults the global property lookup
+     *   cache when the search starts from a root-set object.  
+     */
+    int search_sc_for_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
+                           vm_obj_id_t self, vm_obj_id_t *source_obj);
+
     /* load the image file properties and superclasses */
     void load_image_props_and_scs(VMG_ const char *ptr, size_t siz);
 
@@ -798,6 +814,139 @@ struct tadsobj_objid_and_ptr
     CVmObjTads *objp;
 };
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Property lookup cache.  This maps a (class, property) pair to the object
+ *   that defines the property when it's inherited from that class, or to
+ *   VM_INVALID_OBJ if no object in the class's inheritance path defines the
+ *   property.  Inherited property lookups that would otherwise walk a deep
+ *   superclass chain can thus go straight to the defining object.
+ *   
+ *   We only record the defining object, not the property value itself, so
+ *   the caller always fetches the current value from the defining object's
+ *   own property table; changing a property's value therefore never makes a
+ *   cache entry stale.  Only changes to the shape of an inheritance path -
+ *   a property added to or removed from an object on the path, or a change
+ *   to a superclass list - do that, and we handle those by bumping a
+ *   generation number, which discards every entry at once.
+ *   
+ *   The keys are object IDs, so we only cache lookups keyed on root-set
+ *   objects, which are never deleted and thus never have their IDs reused.
+ *   
+ *   This is a simple direct-mapped table: a new entry overwrites whatever
+ *   was in its slot.  
+ */
+struct vm_tadsobj_pcache_ent
+{
+    /* the class where the search starts */
+    vm_obj_id_t key;
+
+    /* the defining object, or VM_INVALID_OBJ if the property is undefined */
+    vm_obj_id_t source;
+
+    /* generation number when the entry was stored */
+    unsigned long gen;
+
+    /* the property */
+    vm_prop_id_t prop;
+};
+
+class CVmObjTadsPropCache
+{
+public:
+    CVmObjTadsPropCache()
+    {
+        init();
+    }
+
+    void init()
+    {
+        /* clear the table and start at the first generation */
+        clear();
+
+        /* no lookups yet */
+        VM_IF_PROFILER(hits_ = misses_ = 0);
+    }
+
+    /*
+     *   Look up a property.  Returns true if we have a valid entry for the
+     *   key/property pair, and fills in *source with the defining object
+     *   (which is VM_INVALID_OBJ if the property isn't defined).  
+     */
+    int find(vm_obj_id_t key, vm_prop_id_t prop, vm_obj_id_t *source)
+    {
+        const vm_tadsobj_pcache_ent *ent = &ents_[hash(key, prop)];
+        if (ent->gen == gen_ && ent->key == key && ent->prop == prop)
+        {
+            VM_IF_PROFILER(++hits_);
+            *source = ent->source;
+            return TRUE;
+        }
+
+        VM_IF_PROFILER(++misses_);
+        return FALSE;
+    }
+
+    /* store the result of a lookup */
+    void add(vm_obj_id_t key, vm_prop_id_t prop, vm_obj_id_t source)
+    {
+        vm_tadsobj_pcache_ent *ent = &ents_[hash(key, prop)];
+        ent->key = key;
+        ent->prop = prop;
+        ent->source = source;
+        ent->gen = gen_;
+    }
+
+    /* discard all entries */
+    void invalidate()
+    {
+        /* 
+         *   move to the next generation; if the counter wraps, explicitly
+         *   clear the table so that ancient entries can't come back 
+         */
+        if (++gen_ == 0)
+            clear();
+    }
+
+#ifdef VM_PROFILER
+    /* get/reset the hit statistics */
+    unsigned long get_hits() const { return hits_; }
+    unsigned long get_misses() const { return misses_; }
+    void reset_stats() { hits_ = misses_ = 0; }
+#endif
+
+protected:
+    /* number of entries in the table - must be a power of two */
+    static const size_t CACHE_SIZE = 4096;
+
+    /* clear the table */
+    void clear()
+    {
+        memset(ents_, 0, sizeof(ents_));
+        gen_ = 1;
+    }
+
+    /* calculate the table index for a key/property pair */
+    static size_t hash(vm_obj_id_t key, vm_prop_id_t prop)
+    {
+        unsigned long h = ((unsigned long)key * 2654435761UL)
+                          ^ ((unsigned long)prop * 40503UL);
+        return (size_t)((h ^ (h >> 15)) & (CACHE_SIZE - 1));
+    }
+
+    /* the table */
+    vm_tadsobj_pcache_ent ents_[CACHE_SIZE];
+
+    /* current generation number; entries from other generations are dead */
+    unsigned long gen_;
+
+#ifdef VM_PROFILER
+    /* lookup statistics */
+    unsigned long hits_;
+    unsigned long misses_;
+#endif
+};
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Queue element for the inheritance path search queue 
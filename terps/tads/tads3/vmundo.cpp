@@ -24,6 +24,7 @@ Modified
 #include "vmtype.h"
 #include "vmobj.h"
 #include "vmundo.h"
+#include "vmparam.h"
 
 /*
  *   create the undo manager 
@@ -42,11 +43,19 @@ CVmUndo::CVmUndo(size_t undo_record_cnt, uint max_savepts)
     /* no savepoints have been created yet */
     savept_cnt_ = 0;
 
-    /* create the undo record array */
-    rec_arr_size_ = undo_record_cnt;
+    /* 
+     *   create the undo record array - start with one chunk, up to the
+     *   maximum size 
+     */
+    rec_arr_max_ = undo_record_cnt;
+    rec_arr_size_ = (undo_record_cnt < VM_UNDO_CHUNK_RECORDS
+                     ? undo_record_cnt : VM_UNDO_CHUNK_RECORDS);
     rec_arr_ = (CVmUndoMeta *)t3malloc(rec_arr_size_
                                        * sizeof(rec_arr_[0]));
 
+    /* we're not applying undo */
+    applying_ = FALSE;
+
     /* we have no records at all yet, so we have no "firsts" */
     cur_first_ = 0;
     oldest_first_ = 0;
@@ -188,6 +197,18 @@ void CVmUndo::drop_undo(VMG0_)
     cur_first_ = 0;
     oldest_first_ = 0;
 
+    /* 
+     *   if the array has grown, go back to a single chunk - there's no
+     *   need to hold onto the memory until we actually need it again 
+     */
+    if (rec_arr_size_ > VM_UNDO_CHUNK_RECORDS)
+    {
+        t3free(rec_arr_);
+        rec_arr_size_ = VM_UNDO_CHUNK_RECORDS;
+        rec_arr_ = (CVmUndoMeta *)t3malloc(rec_arr_size_
+                                           * sizeof(rec_arr_[0]));
+    }
+
     /* start allocating from the start of the array */
     next_free_ = rec_arr_;
 }
@@ -227,6 +248,13 @@ CVmUndoMeta *CVmUndo::alloc_rec(VMG0_)
             /* return the record */
             return ret;
         }
+
+        /* 
+         *   The array is full.  If we haven't reached the size limit yet,
+         *   expand the array and try again. 
+         */
+        if (grow_rec_arr())
+            continue;
         
         /* 
          *   If we have at least one old savepoint, discard the oldest
@@ -255,6 +283,118 @@ CVmUndoMeta *CVmUndo::alloc_rec(VMG0_)
     }
 }
 
+/*
+ *   Expand the record array 
+ */
+int CVmUndo::grow_rec_arr()
+{
+    /* if we're already at the limit, we can't grow */
+    if (rec_arr_size_ >= rec_arr_max_)
+        return FALSE;
+
+    /* add a chunk, up to the limit */
+    size_t new_size = rec_arr_size_ + VM_UNDO_CHUNK_RECORDS;
+    if (new_size > rec_arr_max_)
+        new_size = rec_arr_max_;
+
+    /* allocate the new array */
+    CVmUndoMeta *new_arr = (CVmUndoMeta *)t3malloc(
+        new_size * sizeof(new_arr[0]));
+    if (new_arr == 0)
+        return FALSE;
+
+    /* move the records into the new array, oldest first */
+    pack_recs(new_arr, new_size, new_arr);
+
+    /* drop the old array and switch to the new one */
+    t3free(rec_arr_);
+    rec_arr_ = new_arr;
+    rec_arr_size_ = new_size;
+
+    /* success */
+    return TRUE;
+}
+
+/*
+ *   Pack the records into a circular array.  We walk through the records
+ *   from the oldest to the newest, copying each one to the next slot in
+ *   the destination, and skipping records the garbage collector has
+ *   deleted.  Compacting in place is safe, since the destination slot is
+ *   never ahead of the source slot.  The link records move too, so we
+ *   relink each savepoint to the new location of the one before it.  
+ */
+void CVmUndo::pack_recs(CVmUndoMeta *arr, size_t arr_size,
+                        CVmUndoMeta *start)
+{
+    CVmUndoMeta *src;
+    CVmUndoMeta *dst;
+    CVmUndoMeta *next_link;
+    CVmUndoMeta *prev_link;
+
+    /* if we don't have any records, just start over at 'start' */
+    if (oldest_first_ == 0)
+    {
+        next_free_ = start;
+        return;
+    }
+
+    /* the first record is a linking record */
+    next_link = oldest_first_;
+    prev_link = 0;
+
+    /* copy everything from the oldest record to the newest */
+    src = oldest_first_;
+    dst = start;
+    do
+    {
+        /* check to see if this is a linking record or an ordinary record */
+        if (src == next_link)
+        {
+            /* 
+             *   this is a linking record - note the next one before we
+             *   overwrite anything, then link the new copy to the previous
+             *   savepoint's new copy 
+             */
+            next_link = src->link.next_first;
+            dst->link.prev_first = prev_link;
+            dst->link.next_first = 0;
+            if (prev_link != 0)
+                prev_link->link.next_first = dst;
+
+            /* this is now the latest savepoint */
+            prev_link = dst;
+        }
+        else if (src->rec.obj != VM_INVALID_OBJ)
+        {
+            /* it's a live undo record - copy it */
+            if (dst != src)
+                *dst = *src;
+        }
+        else
+        {
+            /* it's a deleted record - skip it */
+            inc_rec_ptr(&src);
+            continue;
+        }
+
+        /* advance to the next slot in each array */
+        inc_rec_ptr(&src);
+        if (++dst == arr + arr_size)
+            dst = arr;
+    }
+    while (src != next_free_);
+
+    /* 
+     *   the first record we copied is the oldest savepoint's link, and the
+     *   last link we copied is the current savepoint's 
+     */
+    oldest_first_ = start;
+    cur_first_ = prev_link;
+
+    /* the next free record is the one after the last one we copied */
+    next_free_ = dst;
+}
+
 /*
  *   Add a new record with a property ID key 
  */
@@ -372,6 +512,13 @@ void CVmUndo::undo_to_savept(VMG0_)
     if (savept_cnt_ == 0)
         return;
 
+    /* 
+     *   Note that we're applying undo.  The records we're walking through
+     *   have to stay put until we're done, so don't let the garbage
+     *   collector compact them if an object allocation triggers a pass. 
+     */
+    applying_ = TRUE;
+
     /* 
      *   Starting with the most recently-added record, apply each record
      *   in sequence until we reach the first savepoint in the undo list.  
@@ -398,6 +545,9 @@ void CVmUndo::undo_to_savept(VMG0_)
         G_obj_table->apply_undo(vmg_ &meta->rec);
     }
 
+    /* we're done applying records */
+    applying_ = FALSE;
+
     /*
      *   Unwind the undo stack -- get the first record in the previous
      *   savepoint from the link pointer. 
@@ -505,6 +655,7 @@ void CVmUndo::gc_remove_stale_weak_refs(VMG0_)
 {
     CVmUndoMeta *cur;
     CVmUndoMeta *next_link;
+    size_t deleted = 0;
 
     /* if we don't have any records, there's nothing to do */
     if (oldest_first_ == 0)
@@ -554,6 +705,7 @@ void CVmUndo::gc_remove_stale_weak_refs(VMG0_)
                  *   setting the owning object to 'invalid' 
                  */
                 cur->rec.obj = VM_INVALID_OBJ;
+                ++deleted;
             }
         }
 
@@ -566,5 +718,13 @@ void CVmUndo::gc_remove_stale_weak_refs(VMG0_)
         if (cur == next_free_)
             break;
     }
-}
 
+    /* 
+     *   If we deleted any records, compact the array to squeeze out the
+     *   deleted records, so that the space is available for new records
+     *   without having to discard old savepoints.  Skip this if we're in
+     *   the middle of applying undo, since that's walking the array. 
+     */
+    if (deleted != 0 && !applying_)
+        pack_recs(rec_arr_, rec_arr_size_, oldest_first_);
+}
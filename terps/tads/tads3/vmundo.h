@@ -102,7 +102,9 @@ class CVmUndo
 public:
     /* 
      *   create the undo manager, specifying the upper limit for memory
-     *   usage and retained savepoints 
+     *   usage and retained savepoints.  'undo_record_cnt' is the most
+     *   records we'll keep; we start with room for fewer (see
+     *   VM_UNDO_CHUNK_RECORDS), and grow toward the limit as needed.  
      */
     CVmUndo(size_t undo_record_cnt, uint max_savepts);
 
@@ -194,6 +196,20 @@ private:
      */
     CVmUndoMeta *alloc_rec(VMG0_);
 
+    /* 
+     *   Expand the record array by a chunk, if we haven't reached the
+     *   limit yet.  Returns true if we made the array bigger.  
+     */
+    int grow_rec_arr();
+
+    /*
+     *   Pack the records, from the oldest to the newest, into the given
+     *   circular array, starting at 'start', and dropping records that
+     *   the garbage collector has deleted.  The array can be our own
+     *   record array, in which case we compact it in place.  
+     */
+    void pack_recs(CVmUndoMeta *arr, size_t arr_size, CVmUndoMeta *start);
+
     /* 
      *   increment a record pointer, wrapping back at the end of the array
      *   to the first record 
@@ -257,11 +273,19 @@ private:
 
     /*
      *   Master array of undo records, and the number of records in this
-     *   list.  We pre-allocate a fixed array of these records.  If we run
-     *   out, we start discarding old undo.  
+     *   list.  We start with a chunk of records, and expand the array a
+     *   chunk at a time until it reaches the maximum size.  If we run out
+     *   at the maximum size, we start discarding old undo.  
      */
     CVmUndoMeta *rec_arr_;
     size_t rec_arr_size_;
+    size_t rec_arr_max_;
+
+    /* 
+     *   flag: we're applying undo records, so the records mustn't be
+     *   moved (by compacting them during garbage collection) 
+     */
+    int applying_;
 };
 
 